@@ -0,0 +1,97 @@
+; CRC-16/CCITT
+; Fills 2048 words at DATA_START with a xorshift sequence and runs the
+; bitwise CRC-16 (polynomial 0x1021, initial value 0xFFFF) over the 4096
+; bytes, low byte of each word first, 16 times without resetting it.
+; Prints the final CRC. Stresses shifts, carry branches and XOR.
+
+START:
+    MOVI R6, 1
+    SHLI R6, R6, 15     ; R6 = 0x8000, start of the buffer
+    MOVI R7, 9
+    SHLI R7, R7, 12     ; R7 = 0x9000, end of the buffer (2048 words)
+
+    ; Fill with xorshift16 (7, 9, 8) from seed 0x1234
+    MOVI R0, 18
+    SHLI R0, R0, 4
+    ORI R0, R0, 3
+    SHLI R0, R0, 4
+    ORI R0, R0, 4       ; R0 = 0x1234
+    MOV R3, R6
+FILL:
+    SHLI R4, R0, 7
+    XOR R0, R0, R4
+    SHRI R4, R0, 9
+    XOR R0, R0, R4
+    SHLI R4, R0, 8
+    XOR R0, R0, R4
+    STORE R0, [R3]
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC FILL
+
+    MOVI R5, 1
+    SHLI R5, R5, 12
+    ORI R5, R5, 1
+    MOVI R4, 32
+    OR R5, R5, R4       ; R5 = 0x1021
+    MOVI R0, -1         ; R0 = CRC
+    MOVI R1, 16         ; Passes
+    STORE R1, 0xE000
+
+PASS:
+    MOV R3, R6
+WORD:
+    LOAD R1, [R3]
+    SHLI R2, R1, 8      ; Low byte, in the high half
+    XOR R0, R0, R2
+    CALL CRC_BYTE
+    SHRI R2, R1, 8
+    SHLI R2, R2, 8      ; High byte
+    XOR R0, R0, R2
+    CALL CRC_BYTE
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC WORD
+
+    LOAD R1, 0xE000
+    DEC R1
+    STORE R1, 0xE000
+    JNZ PASS
+
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; Shift 8 bits out of the CRC in R0, applying the polynomial in R5.
+; Clobbers R4.
+CRC_BYTE:
+    MOVI R4, 8
+CRC_BIT:
+    SHLI R0, R0, 1
+    JNC CRC_NEXT        ; The bit shifted out was 0
+    XOR R0, R0, R5
+CRC_NEXT:
+    DEC R4
+    JNZ CRC_BIT
+    RET
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "BB03\n"
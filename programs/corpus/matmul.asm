@@ -0,0 +1,145 @@
+; Matrix multiply
+; A and B are 16x16 matrices of words, row-major, at 0x8000 and 0x8200,
+; filled with a xorshift sequence. Forty times over, computes C = A * B
+; (mod 65536) at 0x8400 and copies C into B. Prints a checksum of the
+; final C (c = c * 31 + C[i][j]). Stresses MUL and strided loads.
+; Loop counters live in memory at 0xE000-0xE008.
+
+START:
+    ; Fill A and B with xorshift16 (7, 9, 8) from seed 1
+    MOVI R0, 1
+    MOVI R3, 1
+    SHLI R3, R3, 15     ; R3 = 0x8000
+    MOVI R7, 33
+    SHLI R7, R7, 10     ; R7 = 0x8400, end of B
+FILL:
+    SHLI R4, R0, 7
+    XOR R0, R0, R4
+    SHRI R4, R0, 9
+    XOR R0, R0, R4
+    SHLI R4, R0, 8
+    XOR R0, R0, R4
+    STORE R0, [R3]
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC FILL
+
+    MOVI R0, 40         ; Passes
+    STORE R0, 0xE000
+
+PASS:
+    MOVI R7, 33
+    SHLI R7, R7, 10     ; R7 = next element of C
+    MOVI R4, 1
+    SHLI R4, R4, 15
+    STORE R4, 0xE002    ; Current row of A
+    MOVI R4, 16
+    STORE R4, 0xE006    ; Rows left
+
+ROW:
+    MOVI R4, 1
+    SHLI R4, R4, 6
+    ORI R4, R4, 1
+    SHLI R4, R4, 9
+    STORE R4, 0xE004    ; Current column of B (0x8200)
+    MOVI R4, 16
+    STORE R4, 0xE008    ; Columns left
+
+COLUMN:
+    LOAD R1, 0xE002
+    LOAD R2, 0xE004
+    MOVI R0, 0          ; R0 = dot product
+    MOVI R3, 16
+    MOVI R6, 32         ; Row stride
+DOT:
+    LOAD R4, [R1]
+    LOAD R5, [R2]
+    MUL R4, R4, R5
+    ADD R0, R0, R4
+    ADDI R1, R1, 2
+    ADD R2, R2, R6
+    DEC R3
+    JNZ DOT
+    STORE R0, [R7]
+    ADDI R7, R7, 2
+
+    LOAD R2, 0xE004
+    ADDI R2, R2, 2
+    STORE R2, 0xE004
+    LOAD R3, 0xE008
+    DEC R3
+    STORE R3, 0xE008
+    JNZ COLUMN
+
+    LOAD R1, 0xE002
+    MOVI R6, 32
+    ADD R1, R1, R6
+    STORE R1, 0xE002
+    LOAD R3, 0xE006
+    DEC R3
+    STORE R3, 0xE006
+    JNZ ROW
+
+    ; B = C
+    MOVI R1, 33
+    SHLI R1, R1, 10     ; C
+    MOVI R2, 1
+    SHLI R2, R2, 6
+    ORI R2, R2, 1
+    SHLI R2, R2, 9      ; B
+    MOVI R3, 1
+    SHLI R3, R3, 8      ; 256 words
+COPY:
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    DEC R3
+    JNZ COPY
+
+    LOAD R0, 0xE000
+    DEC R0
+    STORE R0, 0xE000
+    JNZ PASS
+
+    ; Checksum of C
+    MOVI R1, 0
+    MOVI R2, 31
+    MOVI R3, 33
+    SHLI R3, R3, 10
+    MOVI R7, 1
+    SHLI R7, R7, 9
+    ADD R7, R7, R3      ; R7 = 0x8600, end of C
+CHECK:
+    LOAD R4, [R3]
+    MUL R1, R1, R2
+    ADD R1, R1, R4
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC CHECK
+
+    MOV R0, R1
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "A2C2\n"
@@ -0,0 +1,118 @@
+; Block copies
+; Fills 2048 words at DATA_START with a xorshift sequence, then 64 times
+; over copies them to 0xA000 with a word loop, copies them back with a
+; loop unrolled four times, and flips bits in one word so that every pass
+; moves different data. Prints a checksum of the final buffer
+; (c = c * 31 + word). Stresses sequential loads and stores.
+
+START:
+    MOVI R6, 1
+    SHLI R6, R6, 15     ; R6 = 0x8000, source
+    MOVI R7, 9
+    SHLI R7, R7, 12     ; R7 = 0x9000, end of the source (2048 words)
+
+    ; Fill with xorshift16 (7, 9, 8) from seed 7
+    MOVI R0, 7
+    MOV R3, R6
+FILL:
+    SHLI R4, R0, 7
+    XOR R0, R0, R4
+    SHRI R4, R0, 9
+    XOR R0, R0, R4
+    SHLI R4, R0, 8
+    XOR R0, R0, R4
+    STORE R0, [R3]
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC FILL
+
+    MOVI R0, 63
+    INC R0              ; Passes
+    STORE R0, 0xE000
+
+PASS:
+    ; Source to 0xA000, one word per iteration
+    MOV R1, R6
+    MOVI R2, 5
+    SHLI R2, R2, 13     ; R2 = 0xA000
+COPY_OUT:
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    CMP R1, R7
+    JC COPY_OUT
+
+    ; And back, four words per iteration
+    MOVI R1, 5
+    SHLI R1, R1, 13
+    MOV R2, R6
+COPY_BACK:
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    LOAD R4, [R1]
+    STORE R4, [R2]
+    ADDI R1, R1, 2
+    ADDI R2, R2, 2
+    CMP R2, R7
+    JC COPY_BACK
+
+    ; source[pass] ^= pass
+    LOAD R0, 0xE000
+    ADD R3, R0, R0
+    ADD R3, R3, R6
+    LOAD R4, [R3]
+    XOR R4, R4, R0
+    STORE R4, [R3]
+
+    DEC R0
+    STORE R0, 0xE000
+    JNZ PASS
+
+    ; Checksum of the source
+    MOVI R1, 0
+    MOVI R2, 31
+    MOV R3, R6
+CHECK:
+    LOAD R4, [R3]
+    MUL R1, R1, R2
+    ADD R1, R1, R4
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC CHECK
+
+    MOV R0, R1
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "A5D3\n"
@@ -0,0 +1,60 @@
+; Recursive Fibonacci
+; Computes fib(24) with the naive doubly recursive definition, keeping
+; arguments and partial results on the stack, and counts the calls.
+; Prints fib(24) and the call count (mod 65536) as hex words.
+; Stresses CALL/RET, PUSH/POP and stack memory.
+
+START:
+    MOVI R7, 0          ; Calls
+    MOVI R0, 24
+    CALL FIB
+
+    MOV R0, R1
+    CALL PRINT_HEX
+    MOVI R4, 32
+    STORE R4, 0xF000
+    MOV R0, R7
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; R1 = fib(R0). Clobbers R0 and R2; counts itself in R7.
+FIB:
+    INC R7
+    MOVI R2, 2
+    CMP R0, R2
+    JC FIB_BASE         ; fib(n) = n for n < 2
+    PUSH R0
+    DEC R0
+    CALL FIB            ; fib(n - 1)
+    POP R0
+    PUSH R1
+    SUBI R0, R0, 2
+    CALL FIB            ; fib(n - 2)
+    POP R2
+    ADD R1, R1, R2
+    RET
+FIB_BASE:
+    MOV R1, R0
+    RET
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "B520 4A21\n" (fib(24) = 46368, 150049 calls)
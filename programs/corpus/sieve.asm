@@ -0,0 +1,101 @@
+; Sieve of Eratosthenes
+; Finds the primes below 8192 twenty times over, keeping one word per
+; number at DATA_START (0 = prime), then prints how many there are and
+; their sum (mod 65536) as hex words.
+; Stresses indirect loads and stores, compares and loop branches.
+
+START:
+    MOVI R0, 20         ; Passes
+    STORE R0, 0xE000
+
+PASS:
+    MOVI R6, 1
+    SHLI R6, R6, 15     ; R6 = 0x8000, flag of number 0
+    MOVI R7, 3
+    SHLI R7, R7, 14     ; R7 = 0xC000, end of the flags (8192 words)
+
+    ; Mark every number as a candidate
+    MOV R3, R6
+    MOVI R4, 0
+CLEAR:
+    STORE R4, [R3]
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC CLEAR
+
+    ; Cross out the multiples of each prime i, from i*i up
+    MOVI R1, 2
+MARK_OUTER:
+    MUL R2, R1, R1
+    ADD R3, R2, R2
+    ADD R3, R3, R6      ; R3 = address of i*i
+    CMP R3, R7
+    JNC COUNT           ; Done once i*i >= 8192
+    ADD R4, R1, R1
+    ADD R4, R4, R6
+    LOAD R4, [R4]
+    CMPI R4, 0
+    JNZ MARK_NEXT       ; i is composite
+    ADD R5, R1, R1      ; Step between multiples
+    MOVI R4, 1
+MARK_INNER:
+    STORE R4, [R3]
+    ADD R3, R3, R5
+    CMP R3, R7
+    JC MARK_INNER
+MARK_NEXT:
+    INC R1
+    JMP MARK_OUTER
+
+    ; R1 = count, R2 = sum of the primes
+COUNT:
+    MOVI R1, 0
+    MOVI R2, 0
+    MOVI R5, 2
+    ADDI R3, R6, 4      ; Flag of number 2
+COUNT_LOOP:
+    LOAD R4, [R3]
+    CMPI R4, 0
+    JNZ COUNT_NEXT
+    INC R1
+    ADD R2, R2, R5
+COUNT_NEXT:
+    INC R5
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC COUNT_LOOP
+
+    LOAD R0, 0xE000
+    DEC R0
+    STORE R0, 0xE000
+    JNZ PASS
+
+    MOV R0, R1
+    CALL PRINT_HEX
+    MOVI R4, 32
+    STORE R4, 0xF000
+    MOV R0, R2
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "0404 A421\n" (1028 primes below 8192)
@@ -0,0 +1,98 @@
+; Insertion sort
+; Fills 1024 words at DATA_START with a xorshift sequence, sorts them in
+; ascending unsigned order, then prints a checksum of the sorted array
+; (c = c * 31 + a[i]) and the number of out-of-order neighbours (0).
+; Stresses indirect loads and stores and data-dependent branches.
+
+START:
+    MOVI R6, 1
+    SHLI R6, R6, 15     ; R6 = 0x8000, first element
+    MOVI R7, 17
+    SHLI R7, R7, 11     ; R7 = 0x8800, end of the array (1024 words)
+
+    ; Fill with xorshift16 (7, 9, 8) from seed 1
+    MOVI R0, 1
+    MOV R3, R6
+FILL:
+    SHLI R4, R0, 7
+    XOR R0, R0, R4
+    SHRI R4, R0, 9
+    XOR R0, R0, R4
+    SHLI R4, R0, 8
+    XOR R0, R0, R4
+    STORE R0, [R3]
+    ADDI R3, R3, 2
+    CMP R3, R7
+    JC FILL
+
+    ; R1 = address of the next element to insert, R2 = its value,
+    ; R3 = the hole it moves down through
+    ADDI R1, R6, 2
+SORT_OUTER:
+    CMP R1, R7
+    JNC SORT_DONE
+    LOAD R2, [R1]
+    MOV R3, R1
+SORT_INNER:
+    CMP R3, R6
+    JZ SORT_PLACE
+    SUBI R5, R3, 2
+    LOAD R4, [R5]
+    CMP R2, R4
+    JNC SORT_PLACE      ; Stop once a[j] <= key
+    STORE R4, [R3]
+    MOV R3, R5
+    JMP SORT_INNER
+SORT_PLACE:
+    STORE R2, [R3]
+    ADDI R1, R1, 2
+    JMP SORT_OUTER
+
+    ; R1 = checksum, R2 = out-of-order count, R3 = previous element
+SORT_DONE:
+    MOVI R1, 0
+    MOVI R2, 0
+    MOVI R3, 0
+    MOVI R0, 31
+CHECK:
+    LOAD R4, [R6]
+    MUL R1, R1, R0
+    ADD R1, R1, R4
+    CMP R4, R3
+    JNC CHECK_NEXT
+    INC R2
+CHECK_NEXT:
+    MOV R3, R4
+    ADDI R6, R6, 2
+    CMP R6, R7
+    JC CHECK
+
+    MOV R0, R1
+    CALL PRINT_HEX
+    MOVI R4, 32
+    STORE R4, 0xF000
+    MOV R0, R2
+    CALL PRINT_HEX
+    MOVI R4, 10
+    STORE R4, 0xF000
+    HALT
+
+; Print R0 as four hex digits. Clobbers R0 and R4-R6.
+PRINT_HEX:
+    MOVI R5, 4
+PRINT_DIGIT:
+    SHRI R4, R0, 12
+    SHLI R0, R0, 4
+    MOVI R6, 10
+    CMP R4, R6
+    JC PRINT_DECIMAL
+    ADDI R4, R4, 7      ; 'A' - '0' - 10
+PRINT_DECIMAL:
+    MOVI R6, 48
+    ADD R4, R4, R6
+    STORE R4, 0xF000
+    DEC R5
+    JNZ PRINT_DIGIT
+    RET
+
+; Expected output: "7302 0000\n"
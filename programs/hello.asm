@@ -3,88 +3,63 @@
 
 START:
     ; Output "Hello, World!\n" character by character
-    ; Note: MOVI supports -64 to 63, ADDI/SUBI use 4-bit signed (-8 to 7)
-    
+    ; LI loads any 16-bit value; the assembler picks MOVI, a two-instruction
+    ; sequence or a constant pool load, whichever is smallest
+    LI R1, 0xF000       ; Console output address
+
     ; 'H' = 72
-    MOVI R0, 60
-    ADDI R0, R0, 7
-    ADDI R0, R0, 5
-    STORE R0, 0xF000
-    
+    LI R0, 72
+    STORE R0, [R1]
+
     ; 'e' = 101
-    MOVI R0, 60
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 6
-    STORE R0, 0xF000
-    
+    LI R0, 101
+    STORE R0, [R1]
+
     ; 'l' = 108
     ADDI R0, R0, 7
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; 'l' again
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; 'o' = 111
     ADDI R0, R0, 3
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; ',' = 44
-    MOVI R0, 40
-    ADDI R0, R0, 4
-    STORE R0, 0xF000
-    
+    MOVI R0, 44
+    STORE R0, [R1]
+
     ; ' ' = 32
     MOVI R0, 32
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; 'W' = 87
-    MOVI R0, 60
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 6
-    STORE R0, 0xF000
-    
+    LI R0, 87
+    STORE R0, [R1]
+
     ; 'o' = 111
-    MOVI R0, 60
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 2
-    STORE R0, 0xF000
-    
+    LI R0, 111
+    STORE R0, [R1]
+
     ; 'r' = 114
     ADDI R0, R0, 3
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; 'l' = 108
     SUBI R0, R0, 6
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; 'd' = 100
-    MOVI R0, 60
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 7
-    ADDI R0, R0, 5
-    STORE R0, 0xF000
-    
+    LI R0, 100
+    STORE R0, [R1]
+
     ; '!' = 33
     MOVI R0, 33
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     ; '\n' = 10
     MOVI R0, 10
-    STORE R0, 0xF000
-    
+    STORE R0, [R1]
+
     HALT
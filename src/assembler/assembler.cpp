@@ -9,178 +9,348 @@
  * 
  * Pass 2: Generates the actual machine code using the resolved symbols,
  *         encoding each instruction according to the ISA specification.
+ *
+ * The LI pseudo-instruction loads any 16-bit value: as the shortest MOVI
+ * and ALU sequence when that is at most two instructions, otherwise as a
+ * LOAD from a constant pool the assembler appends to the code.
  * 
+ * The source is parsed in place: tokens are StringRefs into the mapped
+ * file, operands of all lines share one array, and mnemonics and labels
+ * are found by hashing rather than by string comparison chains. Large
+ * sources are split into chunks of lines that are parsed, sized and
+ * encoded on separate threads.
  */
 
 #include "assembler.h"
+#include "peephole.h"
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
-#include <sstream>
+#include <thread>
 
-Assembler::Assembler() : current_address(0), error_count(0) {}
+// Below this much text per thread, starting the thread costs more than it
+// saves
+static const size_t MIN_CHUNK_SIZE = 64 * 1024;
 
-// Remove leading and trailing whitespace from a string
-std::string Assembler::trim(const std::string &str) {
-  size_t start = str.find_first_not_of(" \t\r\n");
-  if (start == std::string::npos)
-    return "";
-  size_t end = str.find_last_not_of(" \t\r\n");
-  return str.substr(start, end - start + 1);
+Assembler::Assembler()
+    : pool_address(0), thread_count(0), optimize(false), error_count(0) {}
+
+// Run task(i) for i in [0, count), each on its own thread, the first on the
+// calling one
+template <typename Task>
+static void run_parallel(size_t count, const Task &task) {
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < count; i++) {
+    threads.push_back(std::thread([&task, i] { task(i); }));
+  }
+  task(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
 }
 
-// Split a string by delimiter and return non-empty tokens
-std::vector<std::string> Assembler::split(const std::string &str,
-                                          char delimiter) {
-  std::vector<std::string> tokens;
-  std::stringstream ss(str);
-  std::string token;
-  while (std::getline(ss, token, delimiter)) {
-    token = trim(token);
-    if (!token.empty()) {
-      tokens.push_back(token);
-    }
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static char to_upper(char c) {
+  return c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : c;
+}
+
+// Remove leading and trailing whitespace
+static StringRef trim(StringRef str) {
+  while (str.size > 0 && is_space(str[0])) {
+    str.data++;
+    str.size--;
+  }
+  while (str.size > 0 && is_space(str[str.size - 1])) {
+    str.size--;
   }
-  return tokens;
+  return str;
 }
 
-// Parse a single line of assembly code into its components (label, opcode, operands)
-AssemblyLine Assembler::parse_line(const std::string &line, int line_number) {
+// Split one line into label, mnemonic and operands; lines with neither a
+// label nor a mnemonic are dropped
+void Assembler::parse_line(StringRef text, int line_number,
+                           std::vector<AssemblyLine> &parsed_lines,
+                           std::vector<StringRef> &parsed_operands) {
   AssemblyLine result;
   result.line_number = line_number;
+  result.address = 0;
+  result.opcode = -1;
+  result.form = FORM_NONE;
+  result.first_operand = (uint32_t)parsed_operands.size();
+  result.operand_count = 0;
 
   // Remove comments (everything after semicolon)
-  std::string code = line;
-  size_t comment_pos = code.find(';');
-  if (comment_pos != std::string::npos) {
-    result.comment = trim(code.substr(comment_pos + 1));
-    code = code.substr(0, comment_pos);
+  const char *comment = (const char *)memchr(text.data, ';', text.size);
+  if (comment != nullptr) {
+    text.size = comment - text.data;
   }
 
-  code = trim(code);
+  StringRef code = trim(text);
   if (code.empty())
-    return result;
+    return;
 
   // Check for label (ends with ':')
-  size_t colon_pos = code.find(':');
-  if (colon_pos != std::string::npos) {
-    result.label = trim(code.substr(0, colon_pos));
-    code = trim(code.substr(colon_pos + 1));
+  const char *colon = (const char *)memchr(code.data, ':', code.size);
+  if (colon != nullptr) {
+    result.label = trim(StringRef(code.data, colon - code.data));
+    code = trim(StringRef(colon + 1, code.data + code.size - colon - 1));
   }
 
-  if (code.empty())
-    return result;
-
-  // Parse opcode and operands
-  std::vector<std::string> parts = split(code, ' ');
-  if (!parts.empty()) {
-    result.opcode = parts[0];
-
-    // Join remaining parts and split by comma for operands
-    if (parts.size() > 1) {
-      std::string operands_str;
-      for (size_t i = 1; i < parts.size(); i++) {
-        operands_str += parts[i];
-        if (i < parts.size() - 1)
-          operands_str += " ";
+  if (!code.empty()) {
+    // Mnemonic up to the first blank, then comma-separated operands
+    size_t length = 0;
+    while (length < code.size && code[length] != ' ' &&
+           code[length] != '\t') {
+      length++;
+    }
+    result.mnemonic = StringRef(code.data, length);
+    result.opcode = get_opcode(result.mnemonic, result.form);
+
+    const char *p = code.data + length;
+    const char *end = code.data + code.size;
+    while (p < end) {
+      const char *comma = (const char *)memchr(p, ',', end - p);
+      const char *stop = comma != nullptr ? comma : end;
+      StringRef operand = trim(StringRef(p, stop - p));
+      if (!operand.empty()) {
+        parsed_operands.push_back(operand);
+        result.operand_count++;
+      }
+      p = stop + 1;
+    }
+  }
+
+  if (!result.label.empty() || !result.mnemonic.empty()) {
+    parsed_lines.push_back(result);
+  }
+}
+
+void Assembler::parse_source(StringRef text) {
+  // Split at line ends into one chunk per thread
+  size_t count = thread_count != 0 ? thread_count
+                                   : std::thread::hardware_concurrency();
+  count = std::max<size_t>(1, std::min(count, text.size / MIN_CHUNK_SIZE + 1));
+  chunks.clear();
+  chunks.resize(count);
+  const char *p = text.data;
+  const char *end = text.data + text.size;
+  for (size_t i = 0; i < count; i++) {
+    const char *stop = end;
+    if (i + 1 < count) {
+      stop = std::max(p, text.data + text.size / count * (i + 1));
+      const char *newline = (const char *)memchr(stop, '\n', end - stop);
+      stop = newline != nullptr ? newline + 1 : end;
+    }
+    chunks[i].text = StringRef(p, stop - p);
+    p = stop;
+  }
+
+  run_parallel(count, [this](size_t i) {
+    SourceChunk &chunk = chunks[i];
+    const char *p = chunk.text.data;
+    const char *end = chunk.text.data + chunk.text.size;
+
+    // Counting lines first (memchr is cheap) saves regrowing the vectors
+    chunk.newlines = 0;
+    for (const char *q = p; q < end; q++) {
+      q = (const char *)memchr(q, '\n', end - q);
+      if (q == nullptr) {
+        break;
+      }
+      chunk.newlines++;
+    }
+    chunk.parsed_lines.reserve(chunk.newlines + 1);
+    chunk.parsed_operands.reserve((chunk.newlines + 1) * 2);
+
+    int line_number = 1;
+    while (p < end) {
+      const char *newline = (const char *)memchr(p, '\n', end - p);
+      const char *stop = newline != nullptr ? newline : end;
+      parse_line(StringRef(p, stop - p), line_number, chunk.parsed_lines,
+                 chunk.parsed_operands);
+      line_number++;
+      p = stop + 1;
+    }
+  });
+
+  if (count == 1) {
+    lines.swap(chunks[0].parsed_lines);
+    operands.swap(chunks[0].parsed_operands);
+    chunks[0].line_begin = 0;
+    chunks[0].line_end = lines.size();
+    return;
+  }
+
+  // Every chunk but the last ends a line, so line numbers, lines and
+  // operands of each chunk follow on from the previous chunk's
+  std::vector<int> line_number_base(count);
+  std::vector<size_t> operand_base(count);
+  size_t line_total = 0;
+  size_t operand_total = 0;
+  int newline_total = 0;
+  for (size_t i = 0; i < count; i++) {
+    SourceChunk &chunk = chunks[i];
+    line_number_base[i] = newline_total;
+    operand_base[i] = operand_total;
+    chunk.line_begin = line_total;
+    chunk.line_end = line_total + chunk.parsed_lines.size();
+    newline_total += chunk.newlines;
+    line_total = chunk.line_end;
+    operand_total += chunk.parsed_operands.size();
+  }
+
+  lines.resize(line_total);
+  operands.resize(operand_total);
+  run_parallel(count, [&](size_t i) {
+    SourceChunk &chunk = chunks[i];
+    AssemblyLine *line = lines.data() + chunk.line_begin;
+    for (const auto &parsed : chunk.parsed_lines) {
+      *line = parsed;
+      line->line_number += line_number_base[i];
+      line->first_operand += (uint32_t)operand_base[i];
+      line++;
+    }
+    std::copy(chunk.parsed_operands.begin(), chunk.parsed_operands.end(),
+              operands.begin() + operand_base[i]);
+    std::vector<AssemblyLine>().swap(chunk.parsed_lines);
+    std::vector<StringRef>().swap(chunk.parsed_operands);
+  });
+}
+
+struct Mnemonic {
+  const char *name;
+  int opcode;
+  OperandForm form;
+};
+
+// LOAD and STORE are listed with their indirect opcodes; the operands
+// decide between indirect and direct addressing
+static const Mnemonic MNEMONICS[] = {
+    {"NOP", OP_NOP, FORM_NONE},
+    {"MOV", OP_MOV, FORM_REG_REG},
+    {"MOVI", OP_MOVI, FORM_MOVI},
+    {"LOAD", OP_LOAD_IND, FORM_LOAD},
+    {"STORE", OP_STORE_IND, FORM_STORE},
+    {"ADD", OP_ADD, FORM_REG_REG_REG},
+    {"ADDI", OP_ADDI, FORM_REG_REG_IMM},
+    {"SUB", OP_SUB, FORM_REG_REG_REG},
+    {"SUBI", OP_SUBI, FORM_REG_REG_IMM},
+    {"MUL", OP_MUL, FORM_REG_REG_REG},
+    {"DIV", OP_DIV, FORM_REG_REG_REG},
+    {"INC", OP_INC, FORM_REG},
+    {"DEC", OP_DEC, FORM_REG},
+    {"AND", OP_AND, FORM_REG_REG_REG},
+    {"ANDI", OP_ANDI, FORM_REG_REG_IMM},
+    {"OR", OP_OR, FORM_REG_REG_REG},
+    {"ORI", OP_ORI, FORM_REG_REG_IMM},
+    {"XOR", OP_XOR, FORM_REG_REG_REG},
+    {"NOT", OP_NOT, FORM_REG_REG},
+    {"SHL", OP_SHL, FORM_REG_REG_REG},
+    {"SHLI", OP_SHLI, FORM_REG_REG_IMM},
+    {"SHR", OP_SHR, FORM_REG_REG_REG},
+    {"SHRI", OP_SHRI, FORM_REG_REG_IMM},
+    {"CMP", OP_CMP, FORM_CMP},
+    {"CMPI", OP_CMPI, FORM_CMPI},
+    {"JMP", OP_JMP, FORM_JUMP},
+    {"JZ", OP_JZ, FORM_JUMP},
+    {"JNZ", OP_JNZ, FORM_JUMP},
+    {"JC", OP_JC, FORM_JUMP},
+    {"JNC", OP_JNC, FORM_JUMP},
+    {"JN", OP_JN, FORM_JUMP},
+    {"CALL", OP_CALL, FORM_JUMP},
+    {"RET", OP_RET, FORM_NONE},
+    {"PUSH", OP_PUSH, FORM_REG},
+    {"POP", OP_POP, FORM_REG},
+    {"EI", OP_EI, FORM_NONE},
+    {"DI", OP_DI, FORM_NONE},
+    {"RETI", OP_RETI, FORM_NONE},
+    {"WAIT", OP_WAIT, FORM_NONE},
+    {"HALT", OP_HALT, FORM_NONE},
+    {"LI", OP_MOVI, FORM_LI}}; // Pseudo-instruction; opcode unused
+
+static const size_t NUM_MNEMONICS = sizeof(MNEMONICS) / sizeof(MNEMONICS[0]);
+static const size_t MAX_MNEMONIC_LENGTH = 5;
+static const size_t MNEMONIC_SLOTS = 128;
+
+// Perfect hash of the upper-cased mnemonic: the multiplier was found by
+// search so that every entry of MNEMONICS lands in its own slot
+static size_t mnemonic_slot(StringRef text) {
+  uint32_t h = 0;
+  for (size_t i = 0; i < text.size; i++) {
+    h = h * 1937 + (uint8_t)to_upper(text[i]);
+  }
+  return (h ^ (h >> 15)) & (MNEMONIC_SLOTS - 1);
+}
+
+class MnemonicTable {
+private:
+  int8_t slots[MNEMONIC_SLOTS]; // Index into MNEMONICS, -1 if free
+
+public:
+  MnemonicTable() {
+    memset(slots, -1, sizeof(slots));
+    for (size_t i = 0; i < NUM_MNEMONICS; i++) {
+      StringRef name(MNEMONICS[i].name, strlen(MNEMONICS[i].name));
+      slots[mnemonic_slot(name)] = (int8_t)i;
+    }
+  }
+
+  const Mnemonic *find(StringRef text) const {
+    if (text.size > MAX_MNEMONIC_LENGTH) {
+      return nullptr;
+    }
+    int index = slots[mnemonic_slot(text)];
+    if (index < 0) {
+      return nullptr;
+    }
+    const char *name = MNEMONICS[index].name;
+    for (size_t i = 0; i < text.size; i++) {
+      if (to_upper(text[i]) != name[i]) {
+        return nullptr;
       }
-      result.operands = split(operands_str, ',');
     }
+    return name[text.size] == '\0' ? &MNEMONICS[index] : nullptr;
   }
+};
+
+static const MnemonicTable &mnemonic_table() {
+  static const MnemonicTable table;
+  return table;
+}
 
+// Upper-cased copy, for messages
+static std::string upper(StringRef text) {
+  std::string result = text.str();
+  for (size_t i = 0; i < result.size(); i++) {
+    result[i] = to_upper(result[i]);
+  }
   return result;
 }
 
 // Convert assembly mnemonic to numeric opcode (case-insensitive)
-int Assembler::get_opcode(const std::string &mnemonic) {
-  std::string upper = mnemonic;
-  std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
-
-  if (upper == "NOP")
-    return OP_NOP;
-  if (upper == "MOV")
-    return OP_MOV;
-  if (upper == "MOVI")
-    return OP_MOVI;
-  if (upper == "LOAD")
-    return OP_LOAD_IND; // Will determine indirect vs direct later
-  if (upper == "STORE")
-    return OP_STORE_IND;
-  if (upper == "ADD")
-    return OP_ADD;
-  if (upper == "ADDI")
-    return OP_ADDI;
-  if (upper == "SUB")
-    return OP_SUB;
-  if (upper == "SUBI")
-    return OP_SUBI;
-  if (upper == "MUL")
-    return OP_MUL;
-  if (upper == "DIV")
-    return OP_DIV;
-  if (upper == "INC")
-    return OP_INC;
-  if (upper == "DEC")
-    return OP_DEC;
-  if (upper == "AND")
-    return OP_AND;
-  if (upper == "ANDI")
-    return OP_ANDI;
-  if (upper == "OR")
-    return OP_OR;
-  if (upper == "ORI")
-    return OP_ORI;
-  if (upper == "XOR")
-    return OP_XOR;
-  if (upper == "NOT")
-    return OP_NOT;
-  if (upper == "SHL")
-    return OP_SHL;
-  if (upper == "SHLI")
-    return OP_SHLI;
-  if (upper == "SHR")
-    return OP_SHR;
-  if (upper == "SHRI")
-    return OP_SHRI;
-  if (upper == "CMP")
-    return OP_CMP;
-  if (upper == "CMPI")
-    return OP_CMPI;
-  if (upper == "JMP")
-    return OP_JMP;
-  if (upper == "JZ")
-    return OP_JZ;
-  if (upper == "JNZ")
-    return OP_JNZ;
-  if (upper == "JC")
-    return OP_JC;
-  if (upper == "JNC")
-    return OP_JNC;
-  if (upper == "JN")
-    return OP_JN;
-  if (upper == "CALL")
-    return OP_CALL;
-  if (upper == "RET")
-    return OP_RET;
-  if (upper == "PUSH")
-    return OP_PUSH;
-  if (upper == "POP")
-    return OP_POP;
-  if (upper == "HALT")
-    return OP_HALT;
-
-  return -1; // Unknown opcode
+int Assembler::get_opcode(StringRef mnemonic, OperandForm &form) {
+  const Mnemonic *entry = mnemonic_table().find(mnemonic);
+  if (entry == nullptr) {
+    return -1; // Unknown opcode
+  }
+  form = entry->form;
+  return entry->opcode;
 }
 
 // Parse register operand (e.g., "R0" through "R7")
-bool Assembler::parse_register(const std::string &operand, byte_t &reg) {
-  std::string upper = operand;
-  std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
-
+bool Assembler::parse_register(StringRef operand, byte_t &reg) const {
   // Check format: 'R' followed by a digit 0-7
-  if (upper.length() >= 2 && upper[0] == 'R' && isdigit(upper[1])) {
-    int r = upper[1] - '0';
+  if (operand.size >= 2 && to_upper(operand[0]) == 'R' &&
+      isdigit((unsigned char)operand[1])) {
+    int r = operand[1] - '0';
     if (r >= 0 && r < NUM_REGISTERS) {
       reg = (byte_t)r;
       return true;
@@ -189,36 +359,83 @@ bool Assembler::parse_register(const std::string &operand, byte_t &reg) {
   return false;
 }
 
-// Parse immediate value supporting hex (0x), binary (0b), and decimal formats
-bool Assembler::parse_immediate(const std::string &operand, int16_t &value) {
-  try {
-    // Check for hex (0x prefix)
-    if (operand.length() > 2 && operand[0] == '0' &&
-        (operand[1] == 'x' || operand[1] == 'X')) {
-      value = (int16_t)std::stoi(operand.substr(2), nullptr, 16);
-      return true;
+// Parse "[Rx]": the register operand with all brackets removed
+bool Assembler::parse_indirect(StringRef operand, byte_t &reg) const {
+  char kept[2];
+  size_t count = 0;
+  for (size_t i = 0; i < operand.size && count < sizeof(kept); i++) {
+    if (operand[i] != '[' && operand[i] != ']') {
+      kept[count++] = operand[i];
     }
-    // Check for binary (0b prefix)
-    else if (operand.length() > 2 && operand[0] == '0' &&
-             (operand[1] == 'b' || operand[1] == 'B')) {
-      value = (int16_t)std::stoi(operand.substr(2), nullptr, 2);
-      return true;
+  }
+  return parse_register(StringRef(kept, count), reg);
+}
+
+// An int by std::stoi's rules (leading blanks, sign and trailing characters
+// allowed; out of range fails) without a heap copy for normal operands
+static bool parse_int(StringRef text, int base, int &value) {
+  char buffer[64];
+  std::string long_text;
+  const char *str = buffer;
+  if (text.size < sizeof(buffer)) {
+    memcpy(buffer, text.data, text.size);
+    buffer[text.size] = '\0';
+  } else {
+    long_text = text.str();
+    str = long_text.c_str();
+  }
+
+  char *end;
+  errno = 0;
+  long result = strtol(str, &end, base);
+  if (end == str || errno == ERANGE || result < INT_MIN || result > INT_MAX) {
+    return false;
+  }
+  value = (int)result;
+  return true;
+}
+
+// Parse a number supporting hex (0x), binary (0b), and decimal formats
+bool Assembler::parse_value(StringRef operand, int &result) const {
+  // Check for hex (0x prefix)
+  if (operand.size > 2 && operand[0] == '0' &&
+      (operand[1] == 'x' || operand[1] == 'X')) {
+    if (!parse_int(StringRef(operand.data + 2, operand.size - 2), 16,
+                   result)) {
+      return false;
     }
-    // Decimal
-    else {
-      value = (int16_t)std::stoi(operand);
-      return true;
+  }
+  // Check for binary (0b prefix)
+  else if (operand.size > 2 && operand[0] == '0' &&
+           (operand[1] == 'b' || operand[1] == 'B')) {
+    if (!parse_int(StringRef(operand.data + 2, operand.size - 2), 2,
+                   result)) {
+      return false;
     }
-  } catch (...) {
+  }
+  // Decimal
+  else if (!parse_int(operand, 10, result)) {
     return false;
   }
+  return true;
+}
+
+// Parse an immediate value, keeping its low 16 bits
+bool Assembler::parse_immediate(StringRef operand, int16_t &value) const {
+  int result;
+  if (!parse_value(operand, result)) {
+    return false;
+  }
+  value = (int16_t)result;
+  return true;
 }
 
 // Resolve address from either a label name or numeric value
-bool Assembler::parse_address(const std::string &operand, addr_t &address) {
+bool Assembler::parse_address(StringRef operand, addr_t &address) const {
   // Check if it's a label defined in the symbol table
-  if (symbol_table.find(operand) != symbol_table.end()) {
-    address = symbol_table[operand];
+  const LabelTable::Entry *label = symbol_table.find(operand);
+  if (label != nullptr) {
+    address = label->address;
     return true;
   }
 
@@ -232,17 +449,12 @@ bool Assembler::parse_address(const std::string &operand, addr_t &address) {
   return false;
 }
 
-// Write a single byte to the output buffer
-void Assembler::emit_byte(byte_t value) {
-  machine_code.push_back(value);
-  current_address++;
-}
-
-// Write a 16-bit word in little-endian format
-void Assembler::emit_word(word_t value) {
+// Write a 16-bit word in little-endian format and advance past it
+static void put_word(byte_t *&out, word_t value) {
   // Little-endian: low byte first, then high byte
-  emit_byte((byte_t)(value & 0xFF));
-  emit_byte((byte_t)((value >> 8) & 0xFF));
+  out[0] = (byte_t)(value & 0xFF);
+  out[1] = (byte_t)((value >> 8) & 0xFF);
+  out += 2;
 }
 
 void Assembler::report_error(int line_number, const std::string &message) {
@@ -250,329 +462,493 @@ void Assembler::report_error(int line_number, const std::string &message) {
   error_count++;
 }
 
-// First pass: build symbol table by calculating addresses for all labels
-bool Assembler::first_pass() {
-  current_address = PROGRAM_START;
+bool Assembler::li_number(const AssemblyLine &line, word_t &value) const {
+  int16_t number;
+  if (line.operand_count != 2 ||
+      !parse_immediate(operands[line.first_operand + 1], number)) {
+    return false;
+  }
+  value = (word_t)number;
+  return true;
+}
 
-  for (const auto &line : lines) {
-    // Record label positions in the symbol table
-    if (!line.label.empty()) {
-      if (symbol_table.find(line.label) != symbol_table.end()) {
-        report_error(line.line_number, "Duplicate label '" + line.label + "'");
-        return false;
-      }
-      symbol_table[line.label] = current_address;
+size_t Assembler::li_length(const AssemblyLine &line) const {
+  word_t value;
+  if (!li_number(line, value)) {
+    return 0;
+  }
+  size_t length = constant_length(value);
+  return length <= MAX_LI_INLINE ? length : 0;
+}
+
+// Give an LI line's value a pool entry unless it has one
+void Assembler::add_pool_entry(const AssemblyLine &line) {
+  if (line.operand_count != 2) {
+    return; // The second pass reports it
+  }
+  PoolEntry entry;
+  entry.value = 0;
+  if (li_number(line, entry.value)) {
+    if (!pool_numbers.insert(std::make_pair(entry.value, pool.size()))
+             .second) {
+      return;
+    }
+  } else {
+    entry.label = operands[line.first_operand + 1];
+    if (!pool_labels.insert(entry.label, (addr_t)pool.size())) {
+      return;
     }
+  }
+  pool.push_back(entry);
+}
 
-    // Calculate instruction size to determine next address
-    if (!line.opcode.empty()) {
-      int opcode = get_opcode(line.opcode);
-      if (opcode < 0) {
-        report_error(line.line_number, "Unknown opcode '" + line.opcode + "'");
-        return false;
-      }
+// Bytes of machine code for an instruction line
+size_t Assembler::instruction_size(const AssemblyLine &line) const {
+  int opcode = line.opcode;
+
+  if (line.form == FORM_LI) {
+    size_t length = li_length(line);
+    return length != 0 ? 2 * length : 4; // Else LOAD Rd, Addr
+  }
+
+  // Most instructions are 2 bytes (single word)
+  size_t size = 2;
 
-      // Most instructions are 2 bytes (single word)
-      current_address += 2;
+  // Jump, call, and direct memory access instructions need extra word for target address
+  if (opcode == OP_LOAD_DIR || opcode == OP_STORE_DIR || opcode == OP_JMP ||
+      opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_JC ||
+      opcode == OP_JNC || opcode == OP_JN || opcode == OP_CALL) {
+    size += 2;
+  }
+  // Determine if LOAD/STORE uses direct addressing (needs extra address word)
+  else if ((opcode == OP_LOAD_IND || opcode == OP_STORE_IND) &&
+           line.operand_count > 0) {
+    // Direct addressing is used when operand lacks brackets (not [Rx] format)
+    StringRef op =
+        operands[line.first_operand + (line.operand_count > 1 ? 1 : 0)];
+    if (memchr(op.data, '[', op.size) == nullptr) {
+      size += 2; // Extra word for address
+    }
+  }
+  return size;
+}
+
+// First pass: build symbol table by calculating addresses for all labels.
+// Chunks are sized concurrently; a prefix sum of their sizes then places
+// each one in the output, and the constant pool after them.
+bool Assembler::first_pass() {
+  symbol_table.clear();
+  pool.clear();
+  pool_numbers.clear();
+  pool_labels.clear();
 
-      // Jump, call, and direct memory access instructions need extra word for target address
-      if (opcode == OP_LOAD_DIR || opcode == OP_STORE_DIR || opcode == OP_JMP ||
-          opcode == OP_JZ || opcode == OP_JNZ || opcode == OP_JC ||
-          opcode == OP_JNC || opcode == OP_JN || opcode == OP_CALL) {
-        current_address += 2;
+  run_parallel(chunks.size(), [this](size_t i) {
+    SourceChunk &chunk = chunks[i];
+    chunk.labels.clear();
+    chunk.pool_loads.clear();
+    chunk.bad_opcode = chunk.line_end;
+    size_t offset = 0;
+    for (size_t j = chunk.line_begin; j < chunk.line_end; j++) {
+      AssemblyLine &line = lines[j];
+      line.address = (addr_t)offset; // Relative to the chunk, for now
+      if (!line.label.empty()) {
+        chunk.labels.push_back(j);
       }
-      // Determine if LOAD/STORE uses direct addressing (needs extra address word)
-      else if ((opcode == OP_LOAD_IND || opcode == OP_STORE_IND) &&
-               !line.operands.empty()) {
-        // Direct addressing is used when operand lacks brackets (not [Rx] format)
-        std::string op =
-            line.operands.size() > 1 ? line.operands[1] : line.operands[0];
-        if (op.find('[') == std::string::npos) {
-          current_address += 2; // Extra word for address
+      if (!line.mnemonic.empty()) {
+        if (line.opcode < 0) {
+          chunk.bad_opcode = j;
+          break;
+        }
+        offset += instruction_size(line);
+        if (line.form == FORM_LI && li_length(line) == 0) {
+          chunk.pool_loads.push_back(j);
         }
       }
     }
+    chunk.code_size = offset;
+  });
+
+  size_t offset = 0;
+  for (auto &chunk : chunks) {
+    chunk.code_offset = offset;
+    offset += chunk.code_size;
+  }
+  pool_address = (addr_t)(PROGRAM_START + offset);
+
+  run_parallel(chunks.size(), [this](size_t i) {
+    SourceChunk &chunk = chunks[i];
+    addr_t start = (addr_t)(PROGRAM_START + chunk.code_offset);
+    if (start == 0) {
+      return; // Relative addresses are already the right ones
+    }
+    for (size_t j = chunk.line_begin; j < chunk.line_end; j++) {
+      lines[j].address = (addr_t)(start + lines[j].address);
+    }
+  });
+
+  // Record label positions in the symbol table in line order, stopping at
+  // the first unknown opcode, so errors are the ones a walk over the lines
+  // would have hit first
+  for (const auto &chunk : chunks) {
+    for (size_t j : chunk.labels) {
+      const AssemblyLine &line = lines[j];
+      if (!symbol_table.insert(line.label, line.address)) {
+        report_error(line.line_number,
+                     "Duplicate label '" + line.label.str() + "'");
+        return false;
+      }
+    }
+    if (chunk.bad_opcode != chunk.line_end) {
+      const AssemblyLine &line = lines[chunk.bad_opcode];
+      report_error(line.line_number,
+                   "Unknown opcode '" + line.mnemonic.str() + "'");
+      return false;
+    }
+  }
+
+  for (const auto &chunk : chunks) {
+    for (size_t j : chunk.pool_loads) {
+      add_pool_entry(lines[j]);
+    }
   }
 
   return true;
 }
 
+// One step of an inline LI sequence, on reg
+static word_t encode_step(const ConstantStep &step, byte_t reg) {
+  if (step.opcode == OP_MOVI) {
+    return MAKE_INSTR_IMM7(OP_MOVI, reg, step.imm & 0x7F);
+  }
+  return MAKE_INSTR(step.opcode, reg, reg, step.imm & 0x0F);
+}
+
 // Second pass: encode each instruction into machine code
-bool Assembler::encode_instruction(const AssemblyLine &line) {
-  int opcode = get_opcode(line.opcode);
+bool Assembler::encode_instruction(const AssemblyLine &line, byte_t *&out,
+                                   std::string &error) const {
+  int opcode = line.opcode;
   if (opcode < 0) {
-    report_error(line.line_number, "Unknown opcode");
+    error = "Unknown opcode";
     return false;
   }
 
-  std::string upper_opcode = line.opcode;
-  std::transform(upper_opcode.begin(), upper_opcode.end(), upper_opcode.begin(),
-                 ::toupper);
+  const StringRef *ops = operands.data() + line.first_operand;
+  size_t count = line.operand_count;
 
   // Encode based on instruction format (operand count and types vary)
-  if (upper_opcode == "NOP") {
-    emit_word(MAKE_INSTR(OP_NOP, 0, 0, 0));
-  } else if (upper_opcode == "HALT") {
-    emit_word(MAKE_INSTR(OP_HALT, 0, 0, 0));
-  } else if (upper_opcode == "RET") {
-    emit_word(MAKE_INSTR(OP_RET, 0, 0, 0));
-  } else if (upper_opcode == "MOV") {
-    // MOV Rd, Rs
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "MOV requires 2 operands");
+  switch (line.form) {
+  case FORM_NONE:
+    put_word(out, MAKE_INSTR(opcode, 0, 0, 0));
+    break;
+  case FORM_REG_REG: {
+    // MOV Rd, Rs or NOT Rd, Rs
+    if (count != 2) {
+      error = upper(line.mnemonic) + " requires 2 operands";
       return false;
     }
     byte_t rd, rs;
-    if (!parse_register(line.operands[0], rd) ||
-        !parse_register(line.operands[1], rs)) {
-      report_error(line.line_number, "Invalid register operands");
+    if (!parse_register(ops[0], rd) || !parse_register(ops[1], rs)) {
+      error = "Invalid register operands";
       return false;
     }
-    emit_word(MAKE_INSTR(OP_MOV, rd, rs, 0));
-  } else if (upper_opcode == "MOVI") {
+    put_word(out, MAKE_INSTR(opcode, rd, rs, 0));
+    break;
+  }
+  case FORM_MOVI: {
     // MOVI Rd, Imm
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "MOVI requires 2 operands");
+    if (count != 2) {
+      error = "MOVI requires 2 operands";
       return false;
     }
     byte_t rd;
     int16_t imm;
-    if (!parse_register(line.operands[0], rd) ||
-        !parse_immediate(line.operands[1], imm)) {
-      report_error(line.line_number, "Invalid operands for MOVI");
+    if (!parse_register(ops[0], rd) || !parse_immediate(ops[1], imm)) {
+      error = "Invalid operands for MOVI";
       return false;
     }
     if (imm < -64 || imm > 63) {
-      report_error(line.line_number,
-                   "Immediate value out of range (-64 to 63)");
+      error = "Immediate value out of range (-64 to 63)";
       return false;
     }
-    emit_word(MAKE_INSTR_IMM7(OP_MOVI, rd, imm & 0x7F));
-  } else if (upper_opcode == "LOAD") {
+    put_word(out, MAKE_INSTR_IMM7(OP_MOVI, rd, imm & 0x7F));
+    break;
+  }
+  case FORM_LOAD: {
     // LOAD Rd, [Rs] or LOAD Rd, Addr
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "LOAD requires 2 operands");
+    if (count != 2) {
+      error = "LOAD requires 2 operands";
       return false;
     }
     byte_t rd;
-    if (!parse_register(line.operands[0], rd)) {
-      report_error(line.line_number, "First operand must be a register");
+    if (!parse_register(ops[0], rd)) {
+      error = "First operand must be a register";
       return false;
     }
 
-    std::string src = line.operands[1];
+    StringRef src = ops[1];
     // Distinguish between register indirect [Rs] and direct addressing
-    if (src.find('[') != std::string::npos) {
-      // Remove brackets
-      src.erase(std::remove(src.begin(), src.end(), '['), src.end());
-      src.erase(std::remove(src.begin(), src.end(), ']'), src.end());
+    if (memchr(src.data, '[', src.size) != nullptr) {
       byte_t rs;
-      if (!parse_register(src, rs)) {
-        report_error(line.line_number, "Invalid register in brackets");
+      if (!parse_indirect(src, rs)) {
+        error = "Invalid register in brackets";
         return false;
       }
-      emit_word(MAKE_INSTR(OP_LOAD_IND, rd, rs, 0));
+      put_word(out, MAKE_INSTR(OP_LOAD_IND, rd, rs, 0));
     } else {
       // Direct addressing
       addr_t addr;
       if (!parse_address(src, addr)) {
-        report_error(line.line_number, "Invalid address");
+        error = "Invalid address";
         return false;
       }
-      emit_word(MAKE_INSTR(OP_LOAD_DIR, rd, 0, 0));
-      emit_word(addr);
+      put_word(out, MAKE_INSTR(OP_LOAD_DIR, rd, 0, 0));
+      put_word(out, addr);
     }
-  } else if (upper_opcode == "STORE") {
+    break;
+  }
+  case FORM_STORE: {
     // STORE Rs, [Rd] or STORE Rs, Addr
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "STORE requires 2 operands");
+    if (count != 2) {
+      error = "STORE requires 2 operands";
       return false;
     }
     byte_t rs;
-    if (!parse_register(line.operands[0], rs)) {
-      report_error(line.line_number, "First operand must be a register");
+    if (!parse_register(ops[0], rs)) {
+      error = "First operand must be a register";
       return false;
     }
 
-    std::string dst = line.operands[1];
+    StringRef dst = ops[1];
     // Distinguish between register indirect [Rd] and direct addressing
-    if (dst.find('[') != std::string::npos) {
-      // Remove brackets
-      dst.erase(std::remove(dst.begin(), dst.end(), '['), dst.end());
-      dst.erase(std::remove(dst.begin(), dst.end(), ']'), dst.end());
+    if (memchr(dst.data, '[', dst.size) != nullptr) {
       byte_t rd;
-      if (!parse_register(dst, rd)) {
-        report_error(line.line_number, "Invalid register in brackets");
+      if (!parse_indirect(dst, rd)) {
+        error = "Invalid register in brackets";
         return false;
       }
-      emit_word(MAKE_INSTR(OP_STORE_IND, rd, rs, 0));
+      put_word(out, MAKE_INSTR(OP_STORE_IND, rd, rs, 0));
     } else {
       // Direct addressing
       addr_t addr;
       if (!parse_address(dst, addr)) {
-        report_error(line.line_number, "Invalid address");
+        error = "Invalid address";
         return false;
       }
-      emit_word(MAKE_INSTR(OP_STORE_DIR, 0, rs, 0));
-      emit_word(addr);
-    }
-  } else if (upper_opcode == "INC" || upper_opcode == "DEC" ||
-             upper_opcode == "PUSH" || upper_opcode == "POP") {
-    // Single register operand
-    if (line.operands.size() != 1) {
-      report_error(line.line_number, upper_opcode + " requires 1 operand");
-      return false;
+      put_word(out, MAKE_INSTR(OP_STORE_DIR, 0, rs, 0));
+      put_word(out, addr);
     }
-    byte_t rd;
-    if (!parse_register(line.operands[0], rd)) {
-      report_error(line.line_number, "Operand must be a register");
+    break;
+  }
+  case FORM_REG: {
+    // Single register operand; PUSH reads Rs, the others write Rd
+    if (count != 1) {
+      error = upper(line.mnemonic) + " requires 1 operand";
       return false;
     }
-    emit_word(MAKE_INSTR(opcode, rd, 0, 0));
-  } else if (upper_opcode == "NOT") {
-    // NOT Rd, Rs
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "NOT requires 2 operands");
+    byte_t reg;
+    if (!parse_register(ops[0], reg)) {
+      error = "Operand must be a register";
       return false;
     }
-    byte_t rd, rs;
-    if (!parse_register(line.operands[0], rd) ||
-        !parse_register(line.operands[1], rs)) {
-      report_error(line.line_number, "Invalid register operands");
-      return false;
+    if (opcode == OP_PUSH) {
+      put_word(out, MAKE_INSTR(opcode, 0, reg, 0));
+    } else {
+      put_word(out, MAKE_INSTR(opcode, reg, 0, 0));
     }
-    emit_word(MAKE_INSTR(OP_NOT, rd, rs, 0));
-  } else if (upper_opcode == "CMP") {
+    break;
+  }
+  case FORM_CMP: {
     // CMP Rs, Rt
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "CMP requires 2 operands");
+    if (count != 2) {
+      error = "CMP requires 2 operands";
       return false;
     }
     byte_t rs, rt;
-    if (!parse_register(line.operands[0], rs) ||
-        !parse_register(line.operands[1], rt)) {
-      report_error(line.line_number, "Invalid register operands");
+    if (!parse_register(ops[0], rs) || !parse_register(ops[1], rt)) {
+      error = "Invalid register operands";
       return false;
     }
-    emit_word(MAKE_INSTR(OP_CMP, 0, rs, rt));
-  } else if (upper_opcode == "CMPI") {
+    put_word(out, MAKE_INSTR(OP_CMP, 0, rs, rt));
+    break;
+  }
+  case FORM_CMPI: {
     // CMPI Rs, Imm
-    if (line.operands.size() != 2) {
-      report_error(line.line_number, "CMPI requires 2 operands");
+    if (count != 2) {
+      error = "CMPI requires 2 operands";
       return false;
     }
     byte_t rs;
     int16_t imm;
-    if (!parse_register(line.operands[0], rs) ||
-        !parse_immediate(line.operands[1], imm)) {
-      report_error(line.line_number, "Invalid operands for CMPI");
+    if (!parse_register(ops[0], rs) || !parse_immediate(ops[1], imm)) {
+      error = "Invalid operands for CMPI";
       return false;
     }
-    emit_word(MAKE_INSTR(OP_CMPI, 0, rs, imm & 0x0F));
-  } else if (upper_opcode == "JMP" || upper_opcode == "JZ" ||
-             upper_opcode == "JNZ" || upper_opcode == "JC" ||
-             upper_opcode == "JNC" || upper_opcode == "JN" ||
-             upper_opcode == "CALL") {
+    put_word(out, MAKE_INSTR(OP_CMPI, 0, rs, imm & 0x0F));
+    break;
+  }
+  case FORM_JUMP: {
     // Control flow instructions that take a target address or label
-    if (line.operands.size() != 1) {
-      report_error(line.line_number, upper_opcode + " requires 1 operand");
+    if (count != 1) {
+      error = upper(line.mnemonic) + " requires 1 operand";
       return false;
     }
     addr_t addr;
-    if (!parse_address(line.operands[0], addr)) {
-      report_error(line.line_number, "Invalid address or label");
+    if (!parse_address(ops[0], addr)) {
+      error = "Invalid address or label";
       return false;
     }
-    emit_word(MAKE_INSTR(opcode, 0, 0, 0));
-    emit_word(addr);
-  } else if (upper_opcode == "ADDI" || upper_opcode == "SUBI" ||
-             upper_opcode == "ANDI" || upper_opcode == "ORI" ||
-             upper_opcode == "SHLI" || upper_opcode == "SHRI") {
+    put_word(out, MAKE_INSTR(opcode, 0, 0, 0));
+    put_word(out, addr);
+    break;
+  }
+  case FORM_REG_REG_IMM: {
     // Three operands: Rd, Rs, Imm
-    if (line.operands.size() != 3) {
-      report_error(line.line_number, upper_opcode + " requires 3 operands");
+    if (count != 3) {
+      error = upper(line.mnemonic) + " requires 3 operands";
       return false;
     }
     byte_t rd, rs;
     int16_t imm;
-    if (!parse_register(line.operands[0], rd) ||
-        !parse_register(line.operands[1], rs) ||
-        !parse_immediate(line.operands[2], imm)) {
-      report_error(line.line_number, "Invalid operands");
+    if (!parse_register(ops[0], rd) || !parse_register(ops[1], rs) ||
+        !parse_immediate(ops[2], imm)) {
+      error = "Invalid operands";
       return false;
     }
-    emit_word(MAKE_INSTR(opcode, rd, rs, imm & 0x0F));
-  } else {
+    put_word(out, MAKE_INSTR(opcode, rd, rs, imm & 0x0F));
+    break;
+  }
+  case FORM_REG_REG_REG: {
     // Three register operands: Rd, Rs, Rt
-    if (line.operands.size() != 3) {
-      report_error(line.line_number, upper_opcode + " requires 3 operands");
+    if (count != 3) {
+      error = upper(line.mnemonic) + " requires 3 operands";
       return false;
     }
     byte_t rd, rs, rt;
-    if (!parse_register(line.operands[0], rd) ||
-        !parse_register(line.operands[1], rs) ||
-        !parse_register(line.operands[2], rt)) {
-      report_error(line.line_number, "Invalid register operands");
+    if (!parse_register(ops[0], rd) || !parse_register(ops[1], rs) ||
+        !parse_register(ops[2], rt)) {
+      error = "Invalid register operands";
+      return false;
+    }
+    put_word(out, MAKE_INSTR(opcode, rd, rs, rt));
+    break;
+  }
+  case FORM_LI: {
+    // LI Rd, Value or LI Rd, Label: built inline or loaded from the pool
+    if (count != 2) {
+      error = "LI requires 2 operands";
+      return false;
+    }
+    byte_t rd;
+    if (!parse_register(ops[0], rd)) {
+      error = "First operand must be a register";
+      return false;
+    }
+    int number;
+    if (parse_value(ops[1], number) && (number < -32768 || number > 65535)) {
+      error = "Value out of range (-32768 to 65535)";
       return false;
     }
-    emit_word(MAKE_INSTR(opcode, rd, rs, rt));
+    word_t value;
+    size_t entry;
+    if (li_number(line, value)) {
+      if (li_length(line) != 0) {
+        for (const auto &step : constant_sequence(value)) {
+          put_word(out, encode_step(step, rd));
+        }
+        break;
+      }
+      entry = pool_numbers.find(value)->second;
+    } else {
+      if (symbol_table.find(ops[1]) == nullptr) {
+        error = "Invalid value or label";
+        return false;
+      }
+      entry = pool_labels.find(ops[1])->address;
+    }
+    put_word(out, MAKE_INSTR(OP_LOAD_DIR, rd, 0, 0));
+    put_word(out, (word_t)(pool_address + 2 * entry));
+    break;
+  }
   }
 
   return true;
 }
 
-// Second pass: generate actual machine code using resolved symbols
+// Second pass: generate actual machine code using resolved symbols. Each
+// chunk encodes into its own part of the output concurrently.
 bool Assembler::second_pass() {
-  current_address = PROGRAM_START;
-  machine_code.clear();
+  const SourceChunk &last = chunks.back();
+  size_t code_size = last.code_offset + last.code_size;
+  machine_code.resize(code_size + 2 * pool.size());
 
-  for (const auto &line : lines) {
-    if (!line.opcode.empty()) {
-      if (!encode_instruction(line)) {
-        return false;
+  run_parallel(chunks.size(), [this](size_t i) {
+    SourceChunk &chunk = chunks[i];
+    chunk.error_line = 0;
+    chunk.error.clear();
+    byte_t *out = machine_code.data() + chunk.code_offset;
+    for (size_t j = chunk.line_begin; j < chunk.line_end; j++) {
+      const AssemblyLine &line = lines[j];
+      if (!line.mnemonic.empty() &&
+          !encode_instruction(line, out, chunk.error)) {
+        chunk.error_line = line.line_number;
+        break;
       }
     }
-  }
-
-  return true;
-}
+  });
 
-// Main assembly process: read source, run two passes, write binary output
-bool Assembler::assemble(const std::string &input_file,
-                         const std::string &output_file) {
-  // Read input file
-  std::ifstream infile(input_file);
-  if (!infile.is_open()) {
-    std::cerr << "Error: Could not open input file '" << input_file << "'"
-              << std::endl;
-    return false;
+  // Report the first error in line order
+  for (const auto &chunk : chunks) {
+    if (chunk.error_line != 0) {
+      report_error(chunk.error_line, chunk.error);
+      return false;
+    }
   }
 
-  // Parse all lines
-  std::string line;
-  int line_number = 1;
-  while (std::getline(infile, line)) {
-    AssemblyLine parsed = parse_line(line, line_number);
-    if (!parsed.label.empty() || !parsed.opcode.empty()) {
-      lines.push_back(parsed);
+  // The constant pool; every label in it was found by an LI above
+  byte_t *out = machine_code.data() + code_size;
+  for (const auto &entry : pool) {
+    if (entry.label.empty()) {
+      put_word(out, entry.value);
+    } else {
+      put_word(out, symbol_table.find(entry.label)->address);
     }
-    line_number++;
   }
-  infile.close();
 
-  std::cout << "Assembling '" << input_file << "'..." << std::endl;
+  return true;
+}
+
+bool Assembler::assemble_loaded(bool verbose) {
+  symbol_table.clear();
+  lines.clear();
+  operands.clear();
+  generated_text.clear();
+  machine_code.clear();
+  error_count = 0;
+  parse_source(source.text());
 
   // First pass: build symbol table
-  std::cout << "Pass 1: Building symbol table..." << std::endl;
+  if (verbose) {
+    std::cout << "Pass 1: Building symbol table..." << std::endl;
+  }
   if (!first_pass()) {
     std::cerr << "Assembly failed in first pass" << std::endl;
     return false;
   }
 
-  std::cout << "Found " << symbol_table.size() << " labels" << std::endl;
+  // Optional peephole pass, which places the labels again
+  if (optimize && !Peephole(*this).run(verbose ? &std::cout : nullptr)) {
+    std::cerr << "Assembly failed in optimizer" << std::endl;
+    return false;
+  }
+
+  if (verbose) {
+    std::cout << "Found " << symbol_table.size() << " labels" << std::endl;
+  }
 
   // Second pass: generate machine code
-  std::cout << "Pass 2: Generating machine code..." << std::endl;
+  if (verbose) {
+    std::cout << "Pass 2: Generating machine code..." << std::endl;
+  }
   if (!second_pass()) {
     std::cerr << "Assembly failed in second pass" << std::endl;
     return false;
@@ -583,6 +959,21 @@ bool Assembler::assemble(const std::string &input_file,
               << std::endl;
     return false;
   }
+  return true;
+}
+
+// Main assembly process: read source, run two passes, write binary output
+bool Assembler::assemble(const std::string &input_file,
+                         const std::string &output_file) {
+  // Map the input file and parse all lines in place
+  if (!source.open(input_file)) {
+    return false;
+  }
+
+  std::cout << "Assembling '" << input_file << "'..." << std::endl;
+  if (!assemble_loaded(true)) {
+    return false;
+  }
 
   // Write output file
   std::ofstream outfile(output_file, std::ios::binary);
@@ -598,5 +989,46 @@ bool Assembler::assemble(const std::string &input_file,
   std::cout << "Successfully assembled " << machine_code.size() << " bytes to '"
             << output_file << "'" << std::endl;
 
-  return true;
+  // Symbols for the emulator's reports
+  return write_symbols(symbol_file_path(output_file));
+}
+
+bool Assembler::assemble_source(const std::string &text) {
+  source.assign(text.data(), text.size());
+  return assemble_loaded(false);
+}
+
+bool Assembler::assemble_source(const char *text, size_t size) {
+  source.refer_to(text, size);
+  return assemble_loaded(false);
+}
+
+bool Assembler::assemble_file(const std::string &input_file) {
+  return source.open(input_file) && assemble_loaded(false);
+}
+
+std::vector<std::pair<addr_t, std::string>> Assembler::get_symbols() const {
+  std::vector<std::pair<addr_t, std::string>> symbols;
+  symbols.reserve(symbol_table.size());
+  for (const auto &entry : symbol_table.get_entries()) {
+    symbols.push_back(std::make_pair(entry.address, entry.name.str()));
+  }
+  std::sort(symbols.begin(), symbols.end());
+  return symbols;
+}
+
+bool Assembler::write_symbols(const std::string &symbol_file) const {
+  std::vector<std::pair<addr_t, std::string>> symbols = get_symbols();
+
+  std::ofstream outfile(symbol_file);
+  if (!outfile.is_open()) {
+    std::cerr << "Error: Could not create symbol file '" << symbol_file
+              << "'" << std::endl;
+    return false;
+  }
+  for (const auto &symbol : symbols) {
+    outfile << std::hex << std::setw(4) << std::setfill('0') << symbol.first
+            << ' ' << symbol.second << '\n';
+  }
+  return outfile.good();
 }
@@ -2,60 +2,174 @@
 #define ASSEMBLER_H
 
 #include "../common/instructions.h"
+#include "../common/symbols.h"
 #include "../common/types.h"
-#include <map>
+#include "constants.h"
+#include "label_table.h"
+#include "source.h"
+#include <cstdint>
+#include <deque>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// How an instruction's operands are written, which decides its encoding
+enum OperandForm {
+  FORM_NONE,        // NOP, RET, HALT, ...
+  FORM_REG,         // INC Rd, PUSH Rs, ...
+  FORM_REG_REG,     // MOV Rd, Rs and NOT Rd, Rs
+  FORM_REG_REG_REG, // ADD Rd, Rs, Rt, ...
+  FORM_REG_REG_IMM, // ADDI Rd, Rs, Imm, ...
+  FORM_MOVI,        // MOVI Rd, Imm
+  FORM_LOAD,        // LOAD Rd, [Rs] or LOAD Rd, Addr
+  FORM_STORE,       // STORE Rs, [Rd] or STORE Rs, Addr
+  FORM_CMP,         // CMP Rs, Rt
+  FORM_CMPI,        // CMPI Rs, Imm
+  FORM_JUMP,        // JMP Addr, CALL Addr, ...
+  FORM_LI           // LI Rd, Value or LI Rd, Label (a pseudo-instruction)
+};
+
+// One source line with a label, an instruction or both. Text fields point
+// into the source buffer; operands are a range of Assembler::operands.
 struct AssemblyLine {
   int line_number;
-  std::string label;
-  std::string opcode;
-  std::vector<std::string> operands;
-  std::string comment;
+  addr_t address; // Set by first_pass
+  int opcode; // From get_opcode; -1 if none or unknown
+  OperandForm form;
+  StringRef label;
+  StringRef mnemonic; // As written
+  uint32_t first_operand;
+  uint32_t operand_count;
+};
+
+// A constant pool entry: a number, or the address of a label
+struct PoolEntry {
+  StringRef label; // Empty for a number
+  word_t value;
+};
+
+// A run of whole source lines that one thread parses, sizes and encodes:
+// [line_begin, line_end) of Assembler::lines
+struct SourceChunk {
+  StringRef text;
+  size_t line_begin;
+  size_t line_end;
+
+  // Parsed with chunk-relative line numbers and operand indices, before
+  // being moved into place
+  std::vector<AssemblyLine> parsed_lines;
+  std::vector<StringRef> parsed_operands;
+  int newlines;
+
+  // First pass
+  std::vector<size_t> labels; // Its lines with labels
+  std::vector<size_t> pool_loads; // Its LI lines that use the constant pool
+  size_t bad_opcode;          // First line with an unknown opcode, or line_end
+  size_t code_offset;         // Into the machine code
+  size_t code_size;
+
+  // Second pass: the first error, if error_line is not 0
+  int error_line;
+  std::string error;
 };
 
 class Assembler {
 private:
-  std::map<std::string, addr_t> symbol_table; // Labels -> addresses
+  SourceBuffer source;
+  LabelTable symbol_table; // Labels -> addresses
   std::vector<AssemblyLine> lines;
+  std::vector<StringRef> operands; // Of all lines, in order
+  std::vector<SourceChunk> chunks;
   std::vector<byte_t> machine_code;
-  addr_t current_address;
+
+  // Constant pool, placed after the code: LI values that take fewer bytes
+  // loaded than built, each once, in order of first use
+  std::vector<PoolEntry> pool;
+  std::unordered_map<word_t, size_t> pool_numbers; // Value -> entry
+  LabelTable pool_labels; // Label -> entry
+  addr_t pool_address;
+
+  unsigned thread_count; // 0: one per hardware thread
+  bool optimize;
+  std::deque<std::string> generated_text; // Operands the optimizer wrote
   int error_count;
 
-  // Parsing helpers
-  AssemblyLine parse_line(const std::string &line, int line_number);
-  std::string trim(const std::string &str);
-  std::vector<std::string> split(const std::string &str, char delimiter);
+  friend class Peephole; // Rewrites lines between the passes
+
+  // Parsing: split text into chunks of lines, parse them concurrently and
+  // gather the results into lines and operands
+  void parse_source(StringRef text);
+  static void parse_line(StringRef text, int line_number,
+                         std::vector<AssemblyLine> &parsed_lines,
+                         std::vector<StringRef> &parsed_operands);
 
   // Assembly passes
   bool first_pass();  // Build symbol table
   bool second_pass(); // Generate machine code
 
-  // Code generation
-  bool encode_instruction(const AssemblyLine &line);
-  void emit_word(word_t value);
-  void emit_byte(byte_t value);
+  // LI is built inline from at most this many one-word instructions;
+  // longer sequences lose to a two-word LOAD and a shared pool word
+  static const size_t MAX_LI_INLINE = 2;
+
+  // LI: its value if written as a number, which a label isn't
+  bool li_number(const AssemblyLine &line, word_t &value) const;
+  // Instructions of LI's inline sequence, or 0 if it loads from the pool
+  size_t li_length(const AssemblyLine &line) const;
+  void add_pool_entry(const AssemblyLine &line);
+
+  // Code generation. Encoding writes at out and advances it, or sets error
+  // and returns false; it is safe to run on several lines at once.
+  size_t instruction_size(const AssemblyLine &line) const;
+  bool encode_instruction(const AssemblyLine &line, byte_t *&out,
+                          std::string &error) const;
 
   // Operand parsing
-  bool parse_register(const std::string &operand, byte_t &reg);
-  bool parse_immediate(const std::string &operand, int16_t &value);
-  bool parse_address(const std::string &operand, addr_t &address);
+  bool parse_register(StringRef operand, byte_t &reg) const;
+  bool parse_indirect(StringRef operand, byte_t &reg) const; // [Rx]
+  bool parse_value(StringRef operand, int &value) const; // Not truncated
+  bool parse_immediate(StringRef operand, int16_t &value) const;
+  bool parse_address(StringRef operand, addr_t &address) const;
 
-  // Opcode lookup
-  int get_opcode(const std::string &mnemonic);
+  // Opcode and operand form lookup (case-insensitive); -1 if unknown
+  static int get_opcode(StringRef mnemonic, OperandForm &form);
 
   // Error reporting
   void report_error(int line_number, const std::string &message);
 
+  // Parse source and run both passes, replacing any earlier results;
+  // verbose reports progress on cout
+  bool assemble_loaded(bool verbose);
+
 public:
   Assembler();
 
+  // Threads to parse and encode with; 0 (the default) for one per hardware
+  // thread. Small sources use fewer.
+  void set_threads(unsigned threads) { thread_count = threads; }
+
+  // Run the peephole optimizer (peephole.h) between the passes. When
+  // assembling a file, the changes are listed on cout.
+  void set_optimize(bool enable) { optimize = enable; }
+
   // Main assembly function
   bool assemble(const std::string &input_file, const std::string &output_file);
 
+  // Assemble into memory only, printing nothing but errors (on cerr). The
+  // code is for PROGRAM_START; load it with Memory::load_image. An
+  // Assembler can be reused, each call replacing the previous results.
+  bool assemble_source(const std::string &text); // Copies text
+  bool assemble_source(const char *text, size_t size); // Must outlive this
+  bool assemble_file(const std::string &input_file);
+
   // Get assembled code
   const std::vector<byte_t> &get_machine_code() const { return machine_code; }
+  const LabelTable &get_symbol_table() const { return symbol_table; }
+
+  // Labels and their addresses, sorted by address, then name
+  std::vector<std::pair<addr_t, std::string>> get_symbols() const;
+
+  // Write the symbol table in the format described in symbols.h
+  bool write_symbols(const std::string &symbol_file) const;
 };
 
 #endif // ASSEMBLER_H
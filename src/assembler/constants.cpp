@@ -0,0 +1,102 @@
+/*
+ * constants.cpp
+ *
+ * Constant synthesis. A breadth-first search over all 65536 register
+ * values, starting from the ones a MOVI can load and stepping with every
+ * single-register immediate operation, finds the shortest way to build
+ * each value. The search runs once, on first use.
+ */
+
+#include "constants.h"
+#include "../common/instructions.h"
+#include <cstdint>
+
+namespace {
+
+struct ConstantTable {
+  std::vector<uint8_t> length; // Instructions; 0 until reached
+  std::vector<uint16_t> previous;
+  std::vector<ConstantStep> last;
+
+  ConstantTable();
+};
+
+} // namespace
+
+static word_t apply_step(word_t value, const ConstantStep &step) {
+  switch (step.opcode) {
+  case OP_ADDI:
+    return (word_t)(value + step.imm);
+  case OP_SUBI:
+    return (word_t)(value - step.imm);
+  case OP_SHLI:
+    return (word_t)(value << step.imm);
+  case OP_SHRI:
+    return (word_t)(value >> step.imm);
+  case OP_ORI:
+    return (word_t)(value | step.imm);
+  case OP_ANDI:
+    return (word_t)(value & step.imm);
+  default: // OP_NOT
+    return (word_t)~value;
+  }
+}
+
+ConstantTable::ConstantTable()
+    : length(0x10000, 0), previous(0x10000, 0), last(0x10000) {
+  // Operations that change some value; SUBI adds only -8 that ADDI can't
+  std::vector<ConstantStep> steps;
+  for (int imm = -8; imm <= 7; imm++) {
+    if (imm != 0) {
+      steps.push_back(ConstantStep{OP_ADDI, imm});
+    }
+  }
+  steps.push_back(ConstantStep{OP_SUBI, -8});
+  for (int imm = 1; imm <= 15; imm++) {
+    steps.push_back(ConstantStep{OP_SHLI, imm});
+    steps.push_back(ConstantStep{OP_SHRI, imm});
+    steps.push_back(ConstantStep{OP_ORI, imm});
+  }
+  for (int imm = 0; imm < 15; imm++) {
+    steps.push_back(ConstantStep{OP_ANDI, imm});
+  }
+  steps.push_back(ConstantStep{OP_NOT, 0});
+
+  std::vector<uint16_t> queue;
+  queue.reserve(0x10000);
+  for (int imm = -64; imm <= 63; imm++) {
+    word_t value = (word_t)imm;
+    length[value] = 1;
+    last[value] = ConstantStep{OP_MOVI, imm};
+    queue.push_back(value);
+  }
+  for (size_t head = 0; head < queue.size(); head++) {
+    word_t value = queue[head];
+    for (const auto &step : steps) {
+      word_t next = apply_step(value, step);
+      if (length[next] == 0) {
+        length[next] = (uint8_t)(length[value] + 1);
+        previous[next] = value;
+        last[next] = step;
+        queue.push_back(next);
+      }
+    }
+  }
+}
+
+static const ConstantTable &constant_table() {
+  static const ConstantTable table;
+  return table;
+}
+
+std::vector<ConstantStep> constant_sequence(word_t value) {
+  const ConstantTable &table = constant_table();
+  std::vector<ConstantStep> sequence(table.length[value]);
+  for (size_t i = sequence.size(); i-- > 0;) {
+    sequence[i] = table.last[value];
+    value = table.previous[value];
+  }
+  return sequence;
+}
+
+size_t constant_length(word_t value) { return constant_table().length[value]; }
@@ -0,0 +1,20 @@
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include "../common/types.h"
+#include <vector>
+
+// One instruction of a sequence that builds a constant in a register: a
+// MOVI, then ALU operations with that register as both Rd and Rs
+struct ConstantStep {
+  int opcode; // OP_MOVI, OP_ADDI, OP_SUBI, OP_SHLI, OP_SHRI, OP_ORI,
+              // OP_ANDI or OP_NOT
+  int imm;    // As written in the source; unused by OP_NOT
+};
+
+// The shortest such sequence that leaves value in the register. Every
+// instruction in it is one word, so it is also the smallest.
+std::vector<ConstantStep> constant_sequence(word_t value);
+size_t constant_length(word_t value); // Its size, without building it
+
+#endif // CONSTANTS_H
@@ -0,0 +1,76 @@
+/*
+ * label_table.cpp
+ *
+ * Open-addressing hash table for assembler labels. Slots keep the full
+ * hash, so probing compares names only on a real hash match, and growing
+ * never rehashes a string.
+ */
+
+#include "label_table.h"
+
+static const size_t INITIAL_SLOTS = 256;
+
+LabelTable::LabelTable() : slots(INITIAL_SLOTS) {}
+
+// FNV-1a
+uint32_t LabelTable::hash(StringRef name) {
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < name.size; i++) {
+    h = (h ^ (uint8_t)name[i]) * 16777619u;
+  }
+  return h;
+}
+
+void LabelTable::grow() {
+  std::vector<Slot> old;
+  old.swap(slots);
+  slots.resize(old.size() * 2);
+  size_t mask = slots.size() - 1;
+  for (size_t i = 0; i < old.size(); i++) {
+    if (old[i].index != 0) {
+      size_t s = old[i].hash & mask;
+      while (slots[s].index != 0) {
+        s = (s + 1) & mask;
+      }
+      slots[s] = old[i];
+    }
+  }
+}
+
+bool LabelTable::insert(StringRef name, addr_t address) {
+  if ((entries.size() + 1) * 2 > slots.size()) {
+    grow();
+  }
+  uint32_t h = hash(name);
+  size_t mask = slots.size() - 1;
+  size_t s = h & mask;
+  while (slots[s].index != 0) {
+    if (slots[s].hash == h && entries[slots[s].index - 1].name == name) {
+      return false;
+    }
+    s = (s + 1) & mask;
+  }
+  Entry entry;
+  entry.name = name;
+  entry.address = address;
+  entries.push_back(entry);
+  slots[s].hash = h;
+  slots[s].index = (uint32_t)entries.size();
+  return true;
+}
+
+const LabelTable::Entry *LabelTable::find(StringRef name) const {
+  uint32_t h = hash(name);
+  size_t mask = slots.size() - 1;
+  for (size_t s = h & mask; slots[s].index != 0; s = (s + 1) & mask) {
+    if (slots[s].hash == h && entries[slots[s].index - 1].name == name) {
+      return &entries[slots[s].index - 1];
+    }
+  }
+  return nullptr;
+}
+
+void LabelTable::clear() {
+  entries.clear();
+  slots.assign(INITIAL_SLOTS, Slot());
+}
@@ -0,0 +1,42 @@
+#ifndef LABEL_TABLE_H
+#define LABEL_TABLE_H
+
+#include "../common/types.h"
+#include "source.h"
+#include <cstdint>
+#include <vector>
+
+// Labels -> addresses, hashed with open addressing. Names are StringRefs,
+// so the table must not outlive the text they point into.
+class LabelTable {
+public:
+  struct Entry {
+    StringRef name;
+    addr_t address;
+  };
+
+private:
+  struct Slot {
+    uint32_t hash;
+    uint32_t index; // Into entries, plus 1; 0 when free
+  };
+
+  std::vector<Entry> entries; // In definition order
+  std::vector<Slot> slots;    // Power of two, at most half full
+
+  static uint32_t hash(StringRef name);
+  void grow();
+
+public:
+  LabelTable();
+
+  // Add a label; false if it is already defined
+  bool insert(StringRef name, addr_t address);
+  const Entry *find(StringRef name) const;
+
+  size_t size() const { return entries.size(); }
+  const std::vector<Entry> &get_entries() const { return entries; }
+  void clear();
+};
+
+#endif // LABEL_TABLE_H
@@ -1,23 +1,68 @@
 #include "assembler.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 #include <iostream>
+#include <vector>
 
 // Display usage information when incorrect arguments are provided
 void print_usage(const char *program_name) {
-  std::cout << "Usage: " << program_name << " <input.asm> <output.bin>\n";
+  std::cout << "Usage: " << program_name
+            << " [-O] [-j threads] <input.asm> <output.bin>\n";
   std::cout << "Assembles assembly code into binary machine code\n";
+  std::cout << "  -O          Optimize: execute fewer instructions, listing "
+               "each change\n";
+  std::cout << "  -j threads  Threads to assemble with (default: one per "
+               "CPU)\n";
+}
+
+// Parse a whole positive number no greater than UINT_MAX
+static bool parse_count(const char *text, unsigned &value) {
+  if (!isdigit((unsigned char)text[0])) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long parsed = std::strtoull(text, &end, 10);
+  if (errno != 0 || *end != '\0' || parsed == 0 || parsed > UINT_MAX) {
+    return false;
+  }
+  value = (unsigned)parsed;
+  return true;
 }
 
 int main(int argc, char *argv[]) {
-  // Verify we have exactly 2 arguments: input and output files
-  if (argc != 3) {
+  std::vector<std::string> files;
+  unsigned threads = 0;
+  bool optimize = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "-O") {
+      optimize = true;
+    } else if (arg == "-j" && i + 1 < argc) {
+      if (!parse_count(argv[++i], threads)) {
+        std::cerr << "Error: Invalid thread count '" << argv[i] << "'\n";
+        print_usage(argv[0]);
+        return 1;
+      }
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  // Verify we have exactly 2 files: input and output
+  if (files.size() != 2) {
     print_usage(argv[0]);
     return 1;
   }
 
-  std::string input_file = argv[1];
-  std::string output_file = argv[2];
+  std::string input_file = files[0];
+  std::string output_file = files[1];
 
   Assembler assembler;
+  assembler.set_threads(threads);
+  assembler.set_optimize(optimize);
 
   // Run the two-pass assembler and return appropriate exit code
   if (!assembler.assemble(input_file, output_file)) {
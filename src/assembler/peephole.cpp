@@ -0,0 +1,543 @@
+/*
+ * peephole.cpp
+ *
+ * Peephole optimizer for the assembler's -O option. After the first pass
+ * has placed every label, it decodes each line from its own encoding and
+ * rewrites short patterns into fewer instructions:
+ *
+ *   - MOV Rx, Rx, which does nothing
+ *   - a jump to the instruction right after it
+ *   - CMPI Rx, 0 after an instruction that computed Rx and so already set
+ *     Z and N from it
+ *   - MOVI Rx, Imm followed by immediate operations on Rx, replaced with
+ *     the MOVI or LI that loads the same constant
+ *   - runs of ADDI, SUBI, INC and DEC on one register, added up
+ *
+ * Most rewrites leave different flags behind, so each is made only where
+ * no path from it reads the flags that differ before something writes
+ * them. Calls, returns and running off the end of the code count as
+ * reads; HALT doesn't, so the flags it leaves, like its PC, may differ.
+ * Nothing is moved across a label, which other code may jump to.
+ */
+
+#include "peephole.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static const word_t ALL_FLAGS =
+    FLAG_ZERO | FLAG_CARRY | FLAG_NEGATIVE | FLAG_OVERFLOW;
+
+// Instructions walked per flags_read before giving up and assuming a read
+static const size_t MAX_FLAG_SCAN = 4096;
+
+// Rounds of rewriting; each can only enable small further changes
+static const int MAX_ROUNDS = 8;
+
+// A step of rewrite() that stands for LI Rx, Imm
+static const int PSEUDO_LI = -1;
+
+static const char *const REGISTER_NAMES[NUM_REGISTERS] = {
+    "R0", "R1", "R2", "R3", "R4", "R5", "R6", "R7"};
+
+static bool writes_flags(int opcode) {
+  return (opcode >= OP_ADD && opcode <= OP_DEC) ||
+         (opcode >= OP_AND && opcode <= OP_NOT) ||
+         (opcode >= OP_SHL && opcode <= OP_CMPI);
+}
+
+// Whether Z and N after the instruction are those of the value it wrote
+// to Rd. DIV isn't: dividing by zero writes 0xFFFF but clears N.
+static bool sets_flags_from_result(int opcode) {
+  return writes_flags(opcode) && opcode != OP_DIV && opcode != OP_CMP &&
+         opcode != OP_CMPI;
+}
+
+static bool is_jump(int opcode) {
+  return opcode >= OP_JMP && opcode <= OP_JN;
+}
+
+Peephole::Peephole(Assembler &assembler)
+    : assembler(assembler), lines(assembler.lines), visit_mark(0),
+      listing(nullptr), changes(0) {}
+
+void Peephole::decode(size_t index) {
+  Instruction &instr = code[index];
+  byte_t bytes[4];
+  byte_t *out = bytes;
+  std::string error;
+  instr.known = lines[index].opcode >= 0 &&
+                assembler.encode_instruction(lines[index], out, error);
+  if (!instr.known) {
+    return;
+  }
+
+  word_t word = (word_t)(bytes[0] | (bytes[1] << 8));
+  instr.pseudo = lines[index].form == FORM_LI;
+  if (instr.pseudo && GET_OPCODE(word) != OP_LOAD_DIR && out - bytes == 4) {
+    word = (word_t)(bytes[2] | (bytes[3] << 8)); // MOVI, then an ALU step
+  }
+  instr.opcode = GET_OPCODE(word);
+  instr.rd = GET_RD(word);
+  instr.rs = GET_RS(word);
+  instr.rt = GET_RT(word);
+  instr.target = is_jump(instr.opcode) || instr.opcode == OP_CALL
+                     ? (addr_t)(bytes[2] | (bytes[3] << 8))
+                     : 0;
+  switch (instr.opcode) {
+  case OP_MOVI:
+    instr.imm = sign_extend_7bit(GET_IMM7(word));
+    break;
+  case OP_ADDI:
+  case OP_SUBI:
+  case OP_CMPI:
+    instr.imm = sign_extend_4bit(GET_IMM4(word));
+    break;
+  default:
+    instr.imm = GET_IMM4(word);
+    break;
+  }
+}
+
+std::string Peephole::text(const AssemblyLine &line) const {
+  std::string result = line.mnemonic.str();
+  for (uint32_t i = 0; i < line.operand_count; i++) {
+    result += i == 0 ? " " : ", ";
+    result += assembler.operands[line.first_operand + i].str();
+  }
+  return result;
+}
+
+size_t Peephole::next_instruction(size_t index, bool &labeled) const {
+  labeled = false;
+  for (size_t i = index + 1; i < lines.size(); i++) {
+    labeled = labeled || !lines[i].label.empty();
+    if (!lines[i].mnemonic.empty()) {
+      return i;
+    }
+  }
+  return lines.size();
+}
+
+size_t Peephole::previous_instruction(size_t index, bool &labeled) const {
+  labeled = !lines[index].label.empty();
+  for (size_t i = index; i-- > 0;) {
+    if (!lines[i].mnemonic.empty()) {
+      return i;
+    }
+    labeled = labeled || !lines[i].label.empty();
+  }
+  return lines.size();
+}
+
+// Addresses are those of the last first pass; lines removed since then
+// keep theirs, so a jump to one lands on whatever follows it
+size_t Peephole::target_line(addr_t target) const {
+  auto line = std::lower_bound(
+      lines.begin(), lines.end(), target,
+      [](const AssemblyLine &l, addr_t address) {
+        return l.address < address;
+      });
+  if (line == lines.end() || line->address != target) {
+    return lines.size();
+  }
+  size_t index = (size_t)(line - lines.begin());
+  while (index < lines.size() && lines[index].mnemonic.empty()) {
+    index++;
+  }
+  return index;
+}
+
+bool Peephole::flags_read(size_t index, word_t mask) {
+  if (++visit_mark == 0) {
+    std::fill(visited.begin(), visited.end(), 0);
+    visit_mark = 1;
+  }
+
+  std::vector<size_t> pending(1, index + 1);
+  size_t scanned = 0;
+  while (!pending.empty()) {
+    size_t i = pending.back();
+    pending.pop_back();
+    for (; i < lines.size(); i++) {
+      if (visited[i] == visit_mark) {
+        break;
+      }
+      visited[i] = visit_mark;
+      if (lines[i].mnemonic.empty()) {
+        continue;
+      }
+      const Instruction &instr = code[i];
+      if (!instr.known || ++scanned > MAX_FLAG_SCAN) {
+        return true;
+      }
+      if (writes_flags(instr.opcode) || instr.opcode == OP_HALT) {
+        break;
+      }
+
+      word_t reads = 0;
+      switch (instr.opcode) {
+      case OP_JZ:
+      case OP_JNZ:
+        reads = FLAG_ZERO;
+        break;
+      case OP_JC:
+      case OP_JNC:
+        reads = FLAG_CARRY;
+        break;
+      case OP_JN:
+        reads = FLAG_NEGATIVE;
+        break;
+      case OP_CALL:
+      case OP_RET:
+      case OP_RETI:
+        return true;
+      }
+      if (reads & mask) {
+        return true;
+      }
+      if (is_jump(instr.opcode)) {
+        size_t target = target_line(instr.target);
+        if (target == lines.size()) {
+          return true;
+        }
+        pending.push_back(target);
+        if (instr.opcode == OP_JMP) {
+          break;
+        }
+      }
+    }
+    if (i == lines.size()) {
+      return true; // Runs off the end of the program
+    }
+  }
+  return false;
+}
+
+void Peephole::rewrite(size_t first, size_t last, int reg,
+                       const std::vector<ConstantStep> &steps) {
+  std::string before, after;
+  size_t step = 0;
+  for (size_t i = first; i <= last; i++) {
+    AssemblyLine &line = lines[i];
+    if (line.mnemonic.empty()) {
+      continue;
+    }
+    before += (before.empty() ? "" : "; ") + text(line);
+    if (step == steps.size()) {
+      line.mnemonic = StringRef();
+      line.opcode = -1;
+      line.operand_count = 0;
+      continue;
+    }
+
+    // Operands go at the end of the shared array, their text in
+    // generated_text, whose strings never move
+    const ConstantStep &s = steps[step++];
+    const char *name = s.opcode == PSEUDO_LI ? "LI" : OPCODE_NAMES[s.opcode];
+    line.mnemonic = StringRef(name, strlen(name));
+    line.opcode = Assembler::get_opcode(line.mnemonic, line.form);
+    line.first_operand = (uint32_t)assembler.operands.size();
+    StringRef r(REGISTER_NAMES[reg], 2);
+    assembler.operands.push_back(r);
+    if (s.opcode != OP_MOVI && s.opcode != PSEUDO_LI) {
+      assembler.operands.push_back(r);
+    }
+    if (s.opcode != OP_NOT) {
+      assembler.generated_text.push_back(std::to_string(s.imm));
+      const std::string &imm = assembler.generated_text.back();
+      assembler.operands.push_back(StringRef(imm.data(), imm.size()));
+    }
+    line.operand_count =
+        (uint32_t)(assembler.operands.size() - line.first_operand);
+    after += (after.empty() ? "" : "; ") + text(line);
+    if (s.opcode == PSEUDO_LI && assembler.li_length(line) == 0) {
+      assembler.add_pool_entry(line); // Placed by the next first pass
+    }
+    decode(i);
+  }
+
+  changes++;
+  if (listing != nullptr) {
+    *listing << "  Line " << lines[first].line_number;
+    if (lines[last].line_number != lines[first].line_number) {
+      *listing << "-" << lines[last].line_number;
+    }
+    *listing << ": " << before << "\n    -> "
+             << (after.empty() ? "(removed)" : after) << "\n";
+  }
+}
+
+bool Peephole::remove_self_move(size_t index) {
+  const Instruction &instr = code[index];
+  if (instr.opcode != OP_MOV || lines[index].form != FORM_REG_REG ||
+      instr.rd != instr.rs) {
+    return false;
+  }
+  rewrite(index, index, 0, std::vector<ConstantStep>());
+  return true;
+}
+
+bool Peephole::remove_jump_to_next(size_t index) {
+  const Instruction &instr = code[index];
+  bool labeled;
+  if (!is_jump(instr.opcode) ||
+      target_line(instr.target) != next_instruction(index, labeled)) {
+    return false;
+  }
+  rewrite(index, index, 0, std::vector<ConstantStep>());
+  return true;
+}
+
+// CMPI Rx, 0 sets Z and N as any instruction that just wrote Rx did; only
+// C (and O) can differ
+bool Peephole::remove_compare_with_zero(size_t index) {
+  const Instruction &instr = code[index];
+  if (instr.opcode != OP_CMPI || instr.imm != 0) {
+    return false;
+  }
+  bool labeled;
+  size_t previous = previous_instruction(index, labeled);
+  if (labeled || previous == lines.size() || !code[previous].known ||
+      !sets_flags_from_result(code[previous].opcode) ||
+      code[previous].rd != instr.rs ||
+      flags_read(index, FLAG_CARRY | FLAG_OVERFLOW)) {
+    return false;
+  }
+  rewrite(index, index, 0, std::vector<ConstantStep>());
+  return true;
+}
+
+// Apply an instruction to value if it only computes Rx = f(Rx, Imm)
+static bool constant_step(int reg, int opcode, int rd, int rs, int imm,
+                          word_t &value) {
+  if (rd != reg) {
+    return false;
+  }
+  switch (opcode) {
+  case OP_MOVI:
+    value = (word_t)imm;
+    return true;
+  case OP_INC:
+    value = (word_t)(value + 1);
+    return true;
+  case OP_DEC:
+    value = (word_t)(value - 1);
+    return true;
+  }
+  if (rs != reg) {
+    return false;
+  }
+  switch (opcode) {
+  case OP_ADDI:
+    value = (word_t)(value + imm);
+    return true;
+  case OP_SUBI:
+    value = (word_t)(value - imm);
+    return true;
+  case OP_ANDI:
+    value = (word_t)(value & imm);
+    return true;
+  case OP_ORI:
+    value = (word_t)(value | imm);
+    return true;
+  case OP_SHLI:
+    value = (word_t)(value << imm);
+    return true;
+  case OP_SHRI:
+    value = (word_t)(value >> imm);
+    return true;
+  case OP_NOT:
+    value = (word_t)~value;
+    return true;
+  }
+  return false;
+}
+
+bool Peephole::fold_constant(size_t index) {
+  const Instruction &start = code[index];
+  if (start.opcode != OP_MOVI) {
+    return false;
+  }
+
+  int reg = start.rd;
+  word_t value = (word_t)start.imm;
+  size_t count = 1;
+  size_t last = index;
+  for (;;) {
+    bool labeled;
+    size_t next = next_instruction(last, labeled);
+    if (labeled || next == lines.size() || !code[next].known) {
+      break;
+    }
+    const Instruction &instr = code[next];
+    if (instr.pseudo) {
+      break;
+    }
+    bool self_move = instr.opcode == OP_MOV &&
+                     lines[next].form == FORM_REG_REG && instr.rd == reg &&
+                     instr.rs == reg;
+    if (!self_move && !constant_step(reg, instr.opcode, instr.rd, instr.rs,
+                                     instr.imm, value)) {
+      break;
+    }
+    count++;
+    last = next;
+  }
+
+  // LI builds the value in at most MAX_LI_INLINE instructions or loads it
+  // in one. Either leaves other flags, or none, behind.
+  if (count < 2) {
+    return false;
+  }
+  size_t length = constant_length(value);
+  size_t executed = length <= Assembler::MAX_LI_INLINE ? length : 1;
+  if (executed >= count || flags_read(last, ALL_FLAGS)) {
+    return false;
+  }
+  std::vector<ConstantStep> steps = constant_sequence(value);
+  if (length > 1) {
+    steps.assign(1, ConstantStep{PSEUDO_LI, (int)value});
+  }
+  rewrite(index, last, reg, steps);
+  return true;
+}
+
+// Additions of the same total give the same Z and N; C and O can differ
+bool Peephole::merge_additions(size_t index) {
+  int reg = code[index].rd;
+  int total = 0;
+  size_t count = 0;
+  size_t last = index;
+  for (size_t i = index; i < lines.size();) {
+    const Instruction &instr = code[i];
+    if (!instr.known || instr.pseudo || instr.rd != reg) {
+      break;
+    }
+    if (instr.opcode == OP_INC || instr.opcode == OP_DEC) {
+      total += instr.opcode == OP_INC ? 1 : -1;
+    } else if ((instr.opcode == OP_ADDI || instr.opcode == OP_SUBI) &&
+               instr.rs == reg) {
+      total += instr.opcode == OP_ADDI ? instr.imm : -instr.imm;
+    } else {
+      break;
+    }
+    count++;
+    last = i;
+
+    bool labeled;
+    i = next_instruction(i, labeled);
+    if (labeled) {
+      break;
+    }
+  }
+  if (count < 2) {
+    return false;
+  }
+
+  // Steps of at most 8 either way, as even as possible: ADDI reaches -8,
+  // SUBI Rx, Rx, -8 reaches +8
+  total = (int16_t)total;
+  size_t needed = (size_t)((std::abs(total) + 7) / 8);
+  word_t live = needed == 0 ? ALL_FLAGS : FLAG_CARRY | FLAG_OVERFLOW;
+  if (needed >= count || flags_read(last, live)) {
+    return false;
+  }
+  std::vector<ConstantStep> steps;
+  for (size_t left = needed; left > 0; left--) {
+    int step = total > 0 ? (total + (int)left - 1) / (int)left
+                         : -((-total + (int)left - 1) / (int)left);
+    steps.push_back(step == 8 ? ConstantStep{OP_SUBI, -8}
+                              : ConstantStep{OP_ADDI, step});
+    total -= step;
+  }
+  rewrite(index, last, reg, steps);
+  return true;
+}
+
+// Jumps to numbers, or labels used as data addresses, would go stale when
+// code moves
+bool Peephole::uses_fixed_addresses() const {
+  for (const auto &line : lines) {
+    if (line.mnemonic.empty() || line.operand_count == 0) {
+      continue;
+    }
+    StringRef last = assembler.operands[line.first_operand +
+                                        line.operand_count - 1];
+    bool is_label = assembler.symbol_table.find(last) != nullptr;
+    bool direct = memchr(last.data, '[', last.size) == nullptr;
+    const char *problem = nullptr;
+    if (line.form == FORM_JUMP && !is_label) {
+      problem = "jumps to a fixed address";
+    } else if ((line.form == FORM_LOAD || line.form == FORM_STORE) &&
+               direct && is_label) {
+      problem = "uses a label as data";
+    }
+    if (problem != nullptr) {
+      if (listing != nullptr) {
+        *listing << "  Not optimizing: line " << line.line_number << " "
+                 << problem << "\n";
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Peephole::optimize_round() {
+  size_t before = changes;
+  for (size_t i = 0; i < lines.size(); i++) {
+    if (lines[i].mnemonic.empty() || !code[i].known || code[i].pseudo) {
+      continue;
+    }
+    if (remove_self_move(i) || remove_jump_to_next(i) ||
+        remove_compare_with_zero(i) || fold_constant(i)) {
+      continue;
+    }
+    merge_additions(i);
+  }
+  return changes != before;
+}
+
+bool Peephole::run(std::ostream *out) {
+  listing = out;
+  changes = 0;
+  if (listing != nullptr) {
+    *listing << "Optimizing..." << std::endl;
+  }
+  if (uses_fixed_addresses()) {
+    return true;
+  }
+
+  size_t instructions_before = 0;
+  for (const auto &line : lines) {
+    instructions_before += line.mnemonic.empty() ? 0 : 1;
+  }
+
+  code.resize(lines.size());
+  visited.assign(lines.size(), 0);
+  for (int round = 0; round < MAX_ROUNDS; round++) {
+    for (size_t i = 0; i < lines.size(); i++) {
+      if (!lines[i].mnemonic.empty()) {
+        decode(i);
+      }
+    }
+    if (!optimize_round()) {
+      break;
+    }
+    // Place labels after what moved
+    if (!assembler.first_pass()) {
+      return false;
+    }
+  }
+
+  if (listing != nullptr) {
+    size_t instructions_after = 0;
+    for (const auto &line : lines) {
+      instructions_after += line.mnemonic.empty() ? 0 : 1;
+    }
+    *listing << "  " << changes << " changes, " << instructions_before
+             << " -> " << instructions_after << " instructions" << std::endl;
+  }
+  return true;
+}
@@ -0,0 +1,69 @@
+#ifndef PEEPHOLE_H
+#define PEEPHOLE_H
+
+#include "assembler.h"
+#include "constants.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The -O pass: rewrites an Assembler's lines, between its two passes, into
+// ones that execute fewer instructions. Code addresses must only come from
+// labels, since everything after a change moves.
+class Peephole {
+private:
+  // A line's instruction, decoded from its encoding
+  struct Instruction {
+    bool known; // False if it doesn't encode; the second pass reports that
+    bool pseudo; // LI, described by the last instruction it expands to
+    int opcode;
+    int rd, rs, rt;
+    int imm; // Sign-extended where the ISA does
+    addr_t target; // Jumps and calls
+  };
+
+  Assembler &assembler;
+  std::vector<AssemblyLine> &lines;
+  std::vector<Instruction> code; // Per line
+  std::vector<uint32_t> visited; // Per line, for flags_read
+  uint32_t visit_mark;
+  std::ostream *listing;
+  size_t changes;
+
+  bool uses_fixed_addresses() const;
+  bool optimize_round();
+  void decode(size_t index);
+
+  // Neighbouring instruction lines; labeled tells whether a label sits
+  // between the two, making the second a possible jump target
+  size_t next_instruction(size_t index, bool &labeled) const;
+  size_t previous_instruction(size_t index, bool &labeled) const;
+  size_t target_line(addr_t target) const; // lines.size() if none
+
+  // Whether some path after lines[index] may read one of mask's flags
+  // before writing it
+  bool flags_read(size_t index, word_t mask);
+
+  // Patterns; each rewrites lines from index on and returns true, or
+  // leaves them alone
+  bool remove_self_move(size_t index);
+  bool remove_jump_to_next(size_t index);
+  bool remove_compare_with_zero(size_t index);
+  bool fold_constant(size_t index);
+  bool merge_additions(size_t index);
+
+  // Replace the instructions of lines [first, last] with steps on reg (none
+  // to remove them; PSEUDO_LI for LI) and list the change
+  void rewrite(size_t first, size_t last, int reg,
+               const std::vector<ConstantStep> &steps);
+  std::string text(const AssemblyLine &line) const;
+
+public:
+  explicit Peephole(Assembler &assembler);
+
+  // Optimize until nothing changes, running the first pass again after
+  // each round. Changes are listed on listing, if not null.
+  bool run(std::ostream *listing);
+};
+
+#endif // PEEPHOLE_H
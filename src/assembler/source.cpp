@@ -0,0 +1,89 @@
+/*
+ * source.cpp
+ *
+ * Source text for the assembler. Mapping the file lets every token be a
+ * StringRef into the page cache, so reading a large source costs no more
+ * than touching its pages once.
+ */
+
+#include "source.h"
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SourceBuffer::SourceBuffer()
+    : data(""), size(0), mapping(nullptr), mapping_size(0) {}
+
+SourceBuffer::~SourceBuffer() { release(); }
+
+void SourceBuffer::release() {
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+  }
+  copy.clear();
+  data = "";
+  size = 0;
+}
+
+bool SourceBuffer::open(const std::string &path) {
+  release();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Error: Could not open input file '" << path << "'"
+              << std::endl;
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    if (info.st_size == 0) {
+      close(fd);
+      return true;
+    }
+    void *map = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, (size_t)info.st_size, MADV_SEQUENTIAL);
+      close(fd);
+      mapping = map;
+      mapping_size = (size_t)info.st_size;
+      data = (const char *)map;
+      size = mapping_size;
+      return true;
+    }
+  }
+  close(fd);
+
+  std::ifstream infile(path, std::ios::binary);
+  if (!infile.is_open()) {
+    std::cerr << "Error: Could not open input file '" << path << "'"
+              << std::endl;
+    return false;
+  }
+  std::ostringstream contents;
+  contents << infile.rdbuf();
+  copy = contents.str();
+  data = copy.data();
+  size = copy.size();
+  return true;
+}
+
+void SourceBuffer::assign(const char *text, size_t length) {
+  release();
+  copy.assign(text, length);
+  data = copy.data();
+  size = copy.size();
+}
+
+void SourceBuffer::refer_to(const char *text, size_t length) {
+  release();
+  data = text;
+  size = length;
+}
@@ -0,0 +1,58 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// A view of characters owned by someone else, normally a SourceBuffer.
+// Tokens of the source are kept as these instead of as copies.
+struct StringRef {
+  const char *data;
+  size_t size;
+
+  StringRef() : data(nullptr), size(0) {}
+  StringRef(const char *data, size_t size) : data(data), size(size) {}
+
+  bool empty() const { return size == 0; }
+  char operator[](size_t i) const { return data[i]; }
+  std::string str() const { return std::string(data, size); }
+
+  bool operator==(const StringRef &other) const {
+    return size == other.size && memcmp(data, other.data, size) == 0;
+  }
+  bool operator!=(const StringRef &other) const { return !(*this == other); }
+};
+
+// The text of a source file. Regular files are mapped into memory, anything
+// else (a pipe, say) is read into a private copy. Not copyable: tokens point
+// into it.
+class SourceBuffer {
+private:
+  const char *data;
+  size_t size;
+  void *mapping; // Mapped file, if any
+  size_t mapping_size;
+  std::string copy;
+
+  SourceBuffer(const SourceBuffer &);
+  SourceBuffer &operator=(const SourceBuffer &);
+
+  void release();
+
+public:
+  SourceBuffer();
+  ~SourceBuffer();
+
+  // Replace the contents with the file at path. Reports errors on cerr.
+  bool open(const std::string &path);
+
+  // Replace the contents with size bytes at data: a private copy, or with
+  // refer_to, the caller's buffer, which must then outlive this one's use
+  void assign(const char *data, size_t size);
+  void refer_to(const char *data, size_t size);
+
+  StringRef text() const { return StringRef(data, size); }
+};
+
+#endif // SOURCE_H
@@ -0,0 +1,468 @@
+#include "../emulator/cpu.h"
+#include "../emulator/memory.h"
+#include "../emulator/program.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Each kernel is a generated loop whose body repeats one class of
+// instruction; programs are run from a snapshot until they halt. Every
+// measurement is repeated after a warmup, and ns/instruction is reported
+// as the median and p99 over the repetitions.
+
+// Data words the kernels use
+const addr_t BENCH_ITERATIONS = 0x8000; // Loop count
+const addr_t BENCH_POINTER = 0x8002;    // Address for indirect accesses
+const addr_t BENCH_DATA = 0x8004;       // Target of loads and stores
+
+// Copies of the measured instruction per loop iteration. The loop adds a
+// DEC and a JNZ, so about 3% of each kernel is overhead.
+const int KERNEL_REPEAT = 64;
+
+struct Options {
+  std::vector<ExecEngine> engines;
+  int reps = 11;
+  int warmup = 2;
+  uint64_t instructions = 2000000; // Per repetition, roughly
+  std::string json_file;
+  std::string compare_file;
+  std::vector<std::string> programs;
+};
+
+struct Result {
+  std::string name;
+  std::string engine;
+  uint64_t instructions; // Per repetition
+  int reps;
+  double median_ns; // Per instruction
+  double p99_ns;
+  double mips;
+};
+
+static const char *const ENGINE_NAMES[] = {"switch", "predecoded", "threaded",
+                                           "block", "jit"};
+
+// Code for a kernel, laid out from PROGRAM_START
+class ProgramBuilder {
+private:
+  std::vector<byte_t> image;
+
+public:
+  addr_t address() const { return (addr_t)(PROGRAM_START + image.size()); }
+
+  void emit(word_t word) {
+    image.push_back((byte_t)word);
+    image.push_back((byte_t)(word >> 8));
+  }
+  void emit(word_t instruction, word_t operand) {
+    emit(instruction);
+    emit(operand);
+  }
+  void patch(addr_t at, word_t word) {
+    image[at - PROGRAM_START] = (byte_t)word;
+    image[at - PROGRAM_START + 1] = (byte_t)(word >> 8);
+  }
+
+  const std::vector<byte_t> &get_image() const { return image; }
+};
+
+enum KernelKind {
+  KERNEL_ALU_REG,
+  KERNEL_ALU_IMM,
+  KERNEL_LOAD_DIRECT,
+  KERNEL_STORE_DIRECT,
+  KERNEL_LOAD_INDIRECT,
+  KERNEL_STORE_INDIRECT,
+  KERNEL_BRANCH_TAKEN,
+  KERNEL_BRANCH_NOT_TAKEN,
+  KERNEL_CALL_RET,
+  KERNEL_PUSH_POP,
+  NUM_KERNELS
+};
+
+static const char *const KERNEL_NAMES[] = {
+    "alu_reg",        "alu_imm",          "load_direct",
+    "store_direct",   "load_indirect",    "store_indirect",
+    "branch_taken",   "branch_not_taken", "call_ret",
+    "push_pop"};
+
+// One iteration's worth of the measured instructions. R1 and R3 are
+// scratch, R2 holds BENCH_DATA and Z is clear.
+static void emit_body(ProgramBuilder &code, KernelKind kind,
+                      std::vector<addr_t> &call_sites) {
+  static const byte_t ALU_REG[] = {OP_ADD, OP_SUB, OP_AND, OP_OR, OP_XOR};
+  static const byte_t ALU_IMM[] = {OP_ADDI, OP_SUBI, OP_ANDI,
+                                   OP_ORI,  OP_SHLI, OP_SHRI};
+  for (int i = 0; i < KERNEL_REPEAT; i++) {
+    switch (kind) {
+    case KERNEL_ALU_REG:
+      code.emit(MAKE_INSTR(ALU_REG[i % 5], 1, 1, 3));
+      break;
+    case KERNEL_ALU_IMM:
+      code.emit(MAKE_INSTR(ALU_IMM[i % 6], 1, 1, 3));
+      break;
+    case KERNEL_LOAD_DIRECT:
+      code.emit(MAKE_INSTR(OP_LOAD_DIR, 1, 0, 0), BENCH_DATA);
+      break;
+    case KERNEL_STORE_DIRECT:
+      code.emit(MAKE_INSTR(OP_STORE_DIR, 0, 1, 0), BENCH_DATA);
+      break;
+    case KERNEL_LOAD_INDIRECT:
+      code.emit(MAKE_INSTR(OP_LOAD_IND, 1, 2, 0));
+      break;
+    case KERNEL_STORE_INDIRECT:
+      code.emit(MAKE_INSTR(OP_STORE_IND, 2, 1, 0));
+      break;
+    case KERNEL_BRANCH_TAKEN:
+      code.emit(MAKE_INSTR(OP_JNZ, 0, 0, 0), (word_t)(code.address() + 4));
+      break;
+    case KERNEL_BRANCH_NOT_TAKEN:
+      code.emit(MAKE_INSTR(OP_JZ, 0, 0, 0), PROGRAM_START);
+      break;
+    case KERNEL_CALL_RET:
+      // Each CALL and its RET count as two instructions
+      if (i % 2 == 0) {
+        call_sites.push_back((addr_t)(code.address() + 2));
+        code.emit(MAKE_INSTR(OP_CALL, 0, 0, 0), 0);
+      }
+      break;
+    case KERNEL_PUSH_POP:
+      code.emit(i % 2 == 0 ? MAKE_INSTR(OP_PUSH, 0, 1, 0)
+                           : MAKE_INSTR(OP_POP, 1, 0, 0));
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+// Setup, then KERNEL_REPEAT measured instructions per iteration of a
+// DEC/JNZ loop counted from BENCH_ITERATIONS, then HALT
+static std::vector<byte_t> build_kernel(KernelKind kind) {
+  ProgramBuilder code;
+  code.emit(MAKE_INSTR(OP_LOAD_DIR, 7, 0, 0), BENCH_ITERATIONS);
+  code.emit(MAKE_INSTR(OP_LOAD_DIR, 2, 0, 0), BENCH_POINTER);
+  code.emit(MAKE_INSTR_IMM7(OP_MOVI, 1, 5));
+  code.emit(MAKE_INSTR_IMM7(OP_MOVI, 3, 3));
+  code.emit(MAKE_INSTR(OP_ADDI, 6, 6, 1)); // Clears Z for the branches
+
+  addr_t loop = code.address();
+  std::vector<addr_t> call_sites;
+  emit_body(code, kind, call_sites);
+  code.emit(MAKE_INSTR(OP_DEC, 7, 0, 0));
+  code.emit(MAKE_INSTR(OP_JNZ, 0, 0, 0), loop);
+  code.emit(MAKE_INSTR(OP_HALT, 0, 0, 0));
+
+  if (!call_sites.empty()) {
+    addr_t function = code.address();
+    code.emit(MAKE_INSTR(OP_RET, 0, 0, 0));
+    for (size_t i = 0; i < call_sites.size(); i++) {
+      code.patch(call_sites[i], function);
+    }
+  }
+  return code.get_image();
+}
+
+static double percentile(std::vector<double> values, double p) {
+  std::sort(values.begin(), values.end());
+  size_t rank = (size_t)std::ceil(p * values.size());
+  return values[rank > 0 ? rank - 1 : 0];
+}
+
+// Time runs of cpu from start to halt. Each repetition repeats the run
+// until it has executed at least min_instructions.
+static Result measure(CPU &cpu, const MachineSnapshot &start,
+                      const Options &options, uint64_t min_instructions) {
+  std::vector<double> ns_per_instruction;
+  uint64_t executed = 0;
+  for (int rep = -options.warmup; rep < options.reps; rep++) {
+    executed = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    do {
+      cpu.restore(start);
+      cpu.run();
+      executed += cpu.get_instruction_count() - start.cpu.instruction_count;
+    } while (executed < min_instructions);
+    double ns = std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - t0)
+                    .count();
+    if (rep >= 0) {
+      ns_per_instruction.push_back(ns / executed);
+    }
+  }
+
+  Result result;
+  result.instructions = executed;
+  result.reps = options.reps;
+  result.median_ns = percentile(ns_per_instruction, 0.5);
+  result.p99_ns = percentile(ns_per_instruction, 0.99);
+  result.mips = 1000.0 / result.median_ns;
+  return result;
+}
+
+// Load image, or a kernel image with its iteration count, and measure it
+static Result run_image(const std::string &name,
+                        const std::vector<byte_t> &image, uint16_t iterations,
+                        ExecEngine engine, const Options &options) {
+  Memory memory;
+  CPU cpu(memory);
+  memory.set_console_enabled(false);
+  cpu.set_engine(engine);
+  memory.load_image(image.data(), image.size());
+  if (iterations != 0) {
+    memory.write_word(BENCH_ITERATIONS, iterations);
+    memory.write_word(BENCH_POINTER, BENCH_DATA);
+  }
+  MachineSnapshot start = cpu.snapshot();
+
+  Result result = measure(cpu, start, options,
+                          iterations != 0 ? 0 : options.instructions);
+  result.name = name;
+  result.engine = ENGINE_NAMES[engine];
+  return result;
+}
+
+static std::string program_name(const std::string &path) {
+  size_t slash = path.find_last_of('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  size_t dot = name.find_last_of('.');
+  return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+static void print_result(const Result &r) {
+  std::cout << std::left << std::setw(20) << r.name << std::setw(12)
+            << r.engine << std::right << std::setw(10) << r.instructions
+            << std::fixed << std::setprecision(3) << std::setw(11)
+            << r.median_ns << std::setw(11) << r.p99_ns << std::setprecision(1)
+            << std::setw(10) << r.mips << std::endl;
+}
+
+static bool write_json(const std::string &path,
+                       const std::vector<Result> &results) {
+  std::ofstream out(path.c_str());
+  out << "{\"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    out << "  {\"name\": \"" << r.name << "\", \"engine\": \"" << r.engine
+        << "\", \"instructions\": " << r.instructions
+        << ", \"reps\": " << r.reps << std::fixed << std::setprecision(4)
+        << ", \"median_ns\": " << r.median_ns << ", \"p99_ns\": " << r.p99_ns
+        << std::setprecision(2) << ", \"mips\": " << r.mips << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "]}\n";
+  out.close();
+  if (!out) {
+    std::cerr << "Error: Could not write '" << path << "'\n";
+    return false;
+  }
+  return true;
+}
+
+// The value of "key": in a line written by write_json
+static std::string json_field(const std::string &line, const std::string &key) {
+  size_t pos = line.find("\"" + key + "\": ");
+  if (pos == std::string::npos) {
+    return "";
+  }
+  pos += key.size() + 4;
+  if (line[pos] == '"') {
+    return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+  }
+  return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+// Median ns/instruction by "name engine" from a file written by --json
+static bool read_json(const std::string &path,
+                      std::map<std::string, double> &medians) {
+  std::ifstream in(path.c_str());
+  if (!in) {
+    std::cerr << "Error: Could not open '" << path << "'\n";
+    return false;
+  }
+  std::string line;
+  for (int number = 1; std::getline(in, line); number++) {
+    std::string name = json_field(line, "name");
+    std::string median = json_field(line, "median_ns");
+    if (name.empty() || median.empty()) {
+      continue;
+    }
+    char *end = nullptr;
+    errno = 0;
+    double value = std::strtod(median.c_str(), &end);
+    if (errno != 0 || end == median.c_str() || *end != '\0') {
+      std::cerr << "Error: Invalid median_ns '" << median << "' on line "
+                << number << " of '" << path << "'\n";
+      return false;
+    }
+    medians[name + " " + json_field(line, "engine")] = value;
+  }
+  return true;
+}
+
+static void print_comparison(const std::vector<Result> &results,
+                             const std::map<std::string, double> &base) {
+  std::cout << "\n"
+            << std::left << std::setw(20) << "Benchmark" << std::setw(12)
+            << "Engine" << std::right << std::setw(11) << "Base ns"
+            << std::setw(11) << "ns" << std::setw(10) << "Speedup"
+            << std::endl;
+  for (size_t i = 0; i < results.size(); i++) {
+    const Result &r = results[i];
+    std::map<std::string, double>::const_iterator it =
+        base.find(r.name + " " + r.engine);
+    std::cout << std::left << std::setw(20) << r.name << std::setw(12)
+              << r.engine << std::right << std::fixed << std::setprecision(3);
+    if (it == base.end()) {
+      std::cout << std::setw(11) << "-" << std::setw(11) << r.median_ns
+                << std::endl;
+      continue;
+    }
+    // Positive when faster than base
+    double change = (it->second / r.median_ns - 1.0) * 100.0;
+    std::cout << std::setw(11) << it->second << std::setw(11) << r.median_ns
+              << std::setprecision(1) << std::setw(9) << std::showpos
+              << change << "%" << std::noshowpos << std::endl;
+  }
+}
+
+void print_usage(const char *program_name) {
+  std::cout << "Usage: " << program_name
+            << " [options] [program.bin|program.asm ...]\n";
+  std::cout << "Measures emulator speed on instruction-class kernels and "
+               "on the given\nprograms\n";
+  std::cout << "Options:\n";
+  std::cout << "  -e, --engine <switch|predecoded|threaded|block|jit>\n"
+            << "                     Measure this engine (repeatable; "
+               "default: all)\n";
+  std::cout << "  --reps <n>         Timed repetitions (default: 11)\n";
+  std::cout << "  --warmup <n>       Untimed repetitions first (default: "
+               "2)\n";
+  std::cout << "  --instructions <n> Instructions per repetition (default: "
+               "2000000)\n";
+  std::cout << "  --json <file>      Also write the results as JSON\n";
+  std::cout << "  --compare <file>   Compare with results written by "
+               "--json\n";
+  std::cout << "  -h, --help         Show this help message\n";
+}
+
+// Parse a whole number in min..max; anything else is a usage error
+static bool parse_count(const char *text, unsigned long long min,
+                        unsigned long long max, unsigned long long &value) {
+  if (!isdigit((unsigned char)text[0])) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long parsed = std::strtoull(text, &end, 10);
+  if (errno != 0 || *end != '\0' || parsed < min || parsed > max) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if ((arg == "-e" || arg == "--engine") && i + 1 < argc) {
+      std::string name = argv[++i];
+      size_t e = 0;
+      while (e <= ENGINE_JIT && name != ENGINE_NAMES[e]) {
+        e++;
+      }
+      if (e > ENGINE_JIT) {
+        std::cerr << "Error: Unknown engine '" << name << "'\n";
+        return 1;
+      }
+      options.engines.push_back((ExecEngine)e);
+    } else if ((arg == "--reps" || arg == "--warmup" ||
+                arg == "--instructions") &&
+               i + 1 < argc) {
+      // The median and p99 need at least one timed repetition
+      unsigned long long min = arg == "--warmup" ? 0 : 1;
+      unsigned long long max = arg == "--instructions" ? ULLONG_MAX : INT_MAX;
+      unsigned long long value = 0;
+      if (!parse_count(argv[++i], min, max, value)) {
+        std::cerr << "Error: Invalid " << arg << " value '" << argv[i]
+                  << "'\n";
+        print_usage(argv[0]);
+        return 1;
+      }
+      if (arg == "--reps") {
+        options.reps = (int)value;
+      } else if (arg == "--warmup") {
+        options.warmup = (int)value;
+      } else {
+        options.instructions = value;
+      }
+    } else if (arg == "--json" && i + 1 < argc) {
+      options.json_file = argv[++i];
+    } else if (arg == "--compare" && i + 1 < argc) {
+      options.compare_file = argv[++i];
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage(argv[0]);
+      return 0;
+    } else {
+      options.programs.push_back(arg);
+    }
+  }
+  if (options.engines.empty()) {
+    for (int e = ENGINE_SWITCH; e <= ENGINE_JIT; e++) {
+      options.engines.push_back((ExecEngine)e);
+    }
+  }
+
+  std::map<std::string, double> base;
+  if (!options.compare_file.empty() &&
+      !read_json(options.compare_file, base)) {
+    return 1;
+  }
+  std::vector<std::vector<byte_t>> images(options.programs.size());
+  for (size_t i = 0; i < options.programs.size(); i++) {
+    if (!read_program_image(options.programs[i], images[i])) {
+      return 1;
+    }
+  }
+
+  std::cout << std::left << std::setw(20) << "Benchmark" << std::setw(12)
+            << "Engine" << std::right << std::setw(10) << "Instrs"
+            << std::setw(11) << "Median ns" << std::setw(11) << "p99 ns"
+            << std::setw(10) << "MIPS" << std::endl;
+  uint64_t per_iteration = KERNEL_REPEAT + 2;
+  uint16_t iterations = (uint16_t)std::min<uint64_t>(
+      0xFFFF, std::max<uint64_t>(1, options.instructions / per_iteration));
+  std::vector<Result> results;
+  for (size_t e = 0; e < options.engines.size(); e++) {
+    for (int k = 0; k < NUM_KERNELS; k++) {
+      results.push_back(run_image(KERNEL_NAMES[k],
+                                  build_kernel((KernelKind)k), iterations,
+                                  options.engines[e], options));
+      print_result(results.back());
+    }
+    for (size_t p = 0; p < images.size(); p++) {
+      results.push_back(run_image(program_name(options.programs[p]),
+                                  images[p], 0, options.engines[e], options));
+      print_result(results.back());
+    }
+  }
+
+  if (!options.json_file.empty() && !write_json(options.json_file, results)) {
+    return 1;
+  }
+  if (!options.compare_file.empty()) {
+    print_comparison(results, base);
+  }
+  return 0;
+}
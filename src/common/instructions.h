@@ -54,7 +54,11 @@ enum Opcode {
   OP_PUSH = 0x28,
   OP_POP = 0x29,
 
-  // System (0x3F)
+  // System (0x3B-0x3F)
+  OP_EI = 0x3B,   // Enable interrupts
+  OP_DI = 0x3C,   // Disable interrupts
+  OP_RETI = 0x3D, // Return from interrupt (pop FLAGS, pop PC)
+  OP_WAIT = 0x3E, // Idle until the next event or interrupt
   OP_HALT = 0x3F
 };
 
@@ -74,8 +78,8 @@ const char *const OPCODE_NAMES[] = {
     "???",   "???",   "???",  "???", // 0x28-0x2F
     "???",   "???",   "???",  "???",
     "???",   "???",   "???",  "???", // 0x30-0x37
-    "???",   "???",   "???",  "???",
-    "???",   "???",   "???",  "HALT" // 0x38-0x3F
+    "???",   "???",   "???",  "EI",
+    "DI",    "RETI",  "WAIT", "HALT" // 0x38-0x3F
 };
 
 // Helper function to get opcode name
@@ -86,4 +90,9 @@ inline const char *get_opcode_name(byte_t opcode) {
   return "???";
 }
 
+// Helper function to check whether an opcode is defined by the ISA
+inline bool is_valid_opcode(byte_t opcode) {
+  return opcode < 64 && OPCODE_NAMES[opcode][0] != '?';
+}
+
 #endif // INSTRUCTIONS_H
@@ -0,0 +1,23 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <string>
+
+// Symbol files map labels to addresses. The assembler writes one next to
+// each binary; tools that report guest addresses read it back. One label
+// per line, sorted by address:
+//
+//   <address as 4 hex digits> <label>
+
+// Path of the symbol file for a binary: its extension replaced by .sym
+inline std::string symbol_file_path(const std::string &binary) {
+  size_t dot = binary.find_last_of('.');
+  size_t slash = binary.find_last_of('/');
+  if (dot == std::string::npos ||
+      (slash != std::string::npos && dot < slash)) {
+    return binary + ".sym";
+  }
+  return binary.substr(0, dot) + ".sym";
+}
+
+#endif // SYMBOLS_H
@@ -21,10 +21,14 @@ const addr_t STACK_START = 0xF100;   // Stack start
 const addr_t STACK_END = 0xFFFF;     // Stack end (top)
 
 // Memory-mapped I/O addresses
-const addr_t IO_CONSOLE_OUT = 0xF000; // Console output
-const addr_t IO_CONSOLE_IN = 0xF001;  // Console input
-const addr_t IO_TIMER_CTRL = 0xF002;  // Timer control
-const addr_t IO_TIMER_VAL = 0xF003;   // Timer value
+const addr_t IO_CONSOLE_OUT = 0xF000;    // Console output
+const addr_t IO_CONSOLE_IN = 0xF001;     // Console input
+const addr_t IO_TIMER_CTRL = 0xF002;     // Timer control
+const addr_t IO_TIMER_VAL = 0xF003;      // Timer value (16-bit)
+const addr_t IO_INT_MASK = 0xF005;       // Unmasked interrupt lines
+const addr_t IO_INT_STATUS = 0xF006;     // Pending interrupt lines
+const addr_t IO_CONSOLE_STATUS = 0xF007; // Console input status
+const addr_t IO_INT_VECTORS = 0xF010;    // Handler addresses, one word per line
 
 // Register count
 const int NUM_REGISTERS = 8; // R0-R7
@@ -34,6 +38,8 @@ const word_t FLAG_ZERO = 0x0001;     // Bit 0: Zero flag
 const word_t FLAG_CARRY = 0x0002;    // Bit 1: Carry flag
 const word_t FLAG_NEGATIVE = 0x0004; // Bit 2: Negative flag
 const word_t FLAG_OVERFLOW = 0x0008; // Bit 3: Overflow flag
+const word_t FLAG_INTERRUPT = 0x0010; // Bit 4: Interrupts enabled (only in
+                                      // the FLAGS word saved on entry)
 
 // Instruction format bit manipulation macros
 #define GET_OPCODE(instr) (((instr) >> 10) & 0x3F)
@@ -214,3 +214,10 @@ word_t ALU::compare(word_t a, word_t b, word_t &flags) {
   sub(a, b, flags); // Perform subtraction to set flags
   return 0;         // Don't return result for comparison
 }
+
+// Materialize the flags of a deferred operation
+word_t ALU::compute_flags(FlagOp op, word_t a, word_t b) {
+  word_t flags = 0;
+  apply(op, a, b, flags);
+  return flags;
+}
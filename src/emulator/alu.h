@@ -5,6 +5,21 @@
 
 class ALU {
 public:
+  // Flag-producing operation kinds, for callers that defer flag
+  // computation (compare uses FLAGS_SUB)
+  enum FlagOp {
+    FLAGS_ADD,
+    FLAGS_SUB,
+    FLAGS_MUL,
+    FLAGS_DIV,
+    FLAGS_AND,
+    FLAGS_OR,
+    FLAGS_XOR,
+    FLAGS_NOT,
+    FLAGS_SHL,
+    FLAGS_SHR
+  };
+
   // Arithmetic operations
   static word_t add(word_t a, word_t b, word_t &flags);
   static word_t sub(word_t a, word_t b, word_t &flags);
@@ -24,6 +39,63 @@ public:
   // Comparison (sets flags only, returns 0)
   static word_t compare(word_t a, word_t b, word_t &flags);
 
+  // Run op with full flag computation
+  static inline word_t apply(FlagOp op, word_t a, word_t b, word_t &flags) {
+    switch (op) {
+    case FLAGS_ADD:
+      return add(a, b, flags);
+    case FLAGS_SUB:
+      return sub(a, b, flags);
+    case FLAGS_MUL:
+      return mul(a, b, flags);
+    case FLAGS_DIV:
+      return div(a, b, flags);
+    case FLAGS_AND:
+      return and_op(a, b, flags);
+    case FLAGS_OR:
+      return or_op(a, b, flags);
+    case FLAGS_XOR:
+      return xor_op(a, b, flags);
+    case FLAGS_NOT:
+      return not_op(a, flags);
+    case FLAGS_SHL:
+      return shl(a, b, flags);
+    case FLAGS_SHR:
+      return shr(a, b, flags);
+    }
+    return 0;
+  }
+
+  // Result of op without touching any flags
+  static inline word_t result(FlagOp op, word_t a, word_t b) {
+    switch (op) {
+    case FLAGS_ADD:
+      return (word_t)(a + b);
+    case FLAGS_SUB:
+      return (word_t)(a - b);
+    case FLAGS_MUL:
+      return (word_t)((uint32_t)a * (uint32_t)b);
+    case FLAGS_DIV:
+      return b == 0 ? 0xFFFF : (word_t)(a / b);
+    case FLAGS_AND:
+      return a & b;
+    case FLAGS_OR:
+      return a | b;
+    case FLAGS_XOR:
+      return a ^ b;
+    case FLAGS_NOT:
+      return (word_t)~a;
+    case FLAGS_SHL:
+      return b >= 16 ? 0 : (word_t)(a << b);
+    case FLAGS_SHR:
+      return b >= 16 ? 0 : (word_t)(a >> b);
+    }
+    return 0;
+  }
+
+  // Flags op would produce for these operands
+  static word_t compute_flags(FlagOp op, word_t a, word_t b);
+
 private:
   // Helper functions for flag computation
   static void set_zero_flag(word_t result, word_t &flags);
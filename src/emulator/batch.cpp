@@ -0,0 +1,199 @@
+/*
+ * batch.cpp
+ *
+ * Batch execution of many guest instances. Jobs are split into contiguous
+ * runs, one per worker queue; a worker that drains its own queue steals
+ * from the front of the others, so uneven run times still keep every core
+ * busy. Instances share nothing but the read-only program image.
+ * Lockstep groups are scheduled as one unit.
+ */
+
+#include "batch.h"
+#include "lockstep.h"
+#include "memory.h"
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+BatchEngine::BatchEngine(ExecEngine engine, unsigned threads)
+    : engine(engine), num_threads(threads), lockstep_width(1), elapsed(0) {
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+  }
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+}
+
+bool BatchEngine::next_unit(unsigned worker, size_t &unit) {
+  WorkQueue &own = *queues[worker];
+  {
+    std::lock_guard<std::mutex> guard(own.lock);
+    if (!own.units.empty()) {
+      unit = own.units.back();
+      own.units.pop_back();
+      return true;
+    }
+  }
+
+  // Steal from the other queues, starting with the next worker
+  for (unsigned i = 1; i < queues.size(); i++) {
+    WorkQueue &victim = *queues[(worker + i) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if (!victim.units.empty()) {
+      unit = victim.units.front();
+      victim.units.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void BatchEngine::worker_loop(unsigned worker) {
+  // Jobs are never added during run(), so empty queues mean we are done
+  size_t unit;
+  while (next_unit(worker, unit)) {
+    size_t begin = unit_starts[unit];
+    size_t end = unit_starts[unit + 1];
+    if (end - begin == 1) {
+      run_job(begin);
+    } else {
+      run_lockstep(begin, end);
+    }
+  }
+}
+
+void BatchEngine::run_job(size_t index) {
+  const BatchJob &job = jobs[index];
+  BatchResult &result = results[index];
+
+  // Declared in this order so the CPU unregisters from Memory first
+  std::unique_ptr<Memory> memory(new Memory());
+  std::unique_ptr<CPU> cpu(new CPU(*memory));
+
+  memory->set_console_capture(&result.console);
+  cpu->set_engine(engine);
+  if (job.start) {
+    cpu->restore(*job.start);
+  } else if (job.image &&
+      !memory->load_image(job.image->data(), job.image->size())) {
+    result.halted = false;
+    result.load_failed = true;
+    result.instructions = 0;
+    return;
+  }
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    cpu->set_register(r, job.registers[r]);
+  }
+  uint64_t start_count = cpu->get_instruction_count();
+  cpu->set_instruction_limit(job.budget ? start_count + job.budget : 0);
+
+  cpu->run();
+
+  result.halted = cpu->is_halted();
+  result.load_failed = false;
+  result.instructions = cpu->get_instruction_count() - start_count;
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    result.registers[r] = cpu->get_register(r);
+  }
+  result.flags = cpu->get_flags();
+}
+
+void BatchEngine::run_lockstep(size_t begin, size_t end) {
+  LockstepEngine group((int)(end - begin), *jobs[begin].image);
+  for (size_t i = begin; i < end; i++) {
+    int lane = (int)(i - begin);
+    group.lane_memory(lane).set_console_capture(&results[i].console);
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+      group.set_register(lane, r, jobs[i].registers[r]);
+    }
+    group.set_budget(lane, jobs[i].budget);
+  }
+
+  group.run();
+
+  for (size_t i = begin; i < end; i++) {
+    int lane = (int)(i - begin);
+    BatchResult &result = results[i];
+    result.halted = group.is_halted(lane);
+    result.load_failed = !group.is_loaded();
+    result.instructions = group.get_instruction_count(lane);
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+      result.registers[r] = group.get_register(lane, r);
+    }
+    result.flags = group.get_flags(lane);
+  }
+}
+
+void BatchEngine::run() {
+  results.assign(jobs.size(), BatchResult());
+
+  // Split jobs into units: consecutive jobs sharing an image form lockstep
+  // groups of up to lockstep_width lanes
+  int width = lockstep_width;
+  if (width > LockstepEngine::MAX_LANES) {
+    width = LockstepEngine::MAX_LANES;
+  }
+  unit_starts.clear();
+  for (size_t i = 0; i < jobs.size(); i++) {
+    size_t first = unit_starts.empty() ? 0 : unit_starts.back();
+    if (unit_starts.empty() || width <= 1 || jobs[i].start ||
+        jobs[i].image == nullptr ||
+        jobs[i].image != jobs[first].image ||
+        i - first >= (size_t)width) {
+      unit_starts.push_back(i);
+    }
+  }
+  size_t units = unit_starts.size();
+  unit_starts.push_back(jobs.size());
+
+  unsigned workers = num_threads;
+  if (workers > units) {
+    workers = units > 0 ? (unsigned)units : 1;
+  }
+
+  queues.clear();
+  for (unsigned w = 0; w < workers; w++) {
+    queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+  }
+  for (size_t u = 0; u < units; u++) {
+    queues[u * workers / units]->units.push_back(u);
+  }
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+
+  std::vector<std::thread> threads;
+  for (unsigned w = 1; w < workers; w++) {
+    threads.push_back(std::thread(&BatchEngine::worker_loop, this, w));
+  }
+  worker_loop(0);
+  for (size_t i = 0; i < threads.size(); i++) {
+    threads[i].join();
+  }
+
+  elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                          start)
+                .count();
+}
+
+BatchSummary BatchEngine::summary() const {
+  BatchSummary s;
+  s.instances = results.size();
+  s.halted = 0;
+  s.budget_exhausted = 0;
+  s.load_errors = 0;
+  s.instructions = 0;
+  s.seconds = elapsed;
+  for (size_t i = 0; i < results.size(); i++) {
+    if (results[i].halted) {
+      s.halted++;
+    } else if (results[i].load_failed) {
+      s.load_errors++;
+    } else {
+      s.budget_exhausted++;
+    }
+    s.instructions += results[i].instructions;
+  }
+  return s;
+}
@@ -0,0 +1,85 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "../common/types.h"
+#include "cpu.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// One guest run: a program image or checkpoint (shared between jobs) and
+// the initial register values that act as the instance's input
+struct BatchJob {
+  std::shared_ptr<const std::vector<byte_t>> image; // Loaded at PROGRAM_START
+  std::shared_ptr<const MachineSnapshot> start;     // Forked instead, if set
+  word_t registers[NUM_REGISTERS];
+  uint64_t budget; // Maximum instructions, 0 = unlimited
+};
+
+// Final state of one guest run
+struct BatchResult {
+  bool halted; // False if the budget ran out first
+  bool load_failed; // The image could not be loaded; nothing ran
+  uint64_t instructions; // Executed by this run, after the checkpoint if any
+  word_t registers[NUM_REGISTERS];
+  word_t flags;
+  std::string console; // Everything the guest wrote to IO_CONSOLE_OUT
+};
+
+struct BatchSummary {
+  size_t instances;
+  size_t halted;
+  size_t budget_exhausted;
+  size_t load_errors;
+  uint64_t instructions;
+  double seconds;
+};
+
+// Runs many independent CPU+Memory instances on a work-stealing thread
+// pool. Instances are built on the worker that runs them and destroyed as
+// soon as their result is recorded, so only threads x one machine is live
+// at a time. With a lockstep width above 1, consecutive jobs sharing an
+// image run together on a LockstepEngine.
+class BatchEngine {
+private:
+  // Per-worker queue of work units (a job, or a lockstep group of jobs).
+  // The owner pops from the back; idle workers steal from the front.
+  struct WorkQueue {
+    std::mutex lock;
+    std::deque<size_t> units;
+  };
+
+  ExecEngine engine;
+  unsigned num_threads;
+  int lockstep_width;
+  std::vector<BatchJob> jobs;
+  std::vector<size_t> unit_starts; // First job of each unit, plus the end
+  std::vector<BatchResult> results;
+  std::vector<std::unique_ptr<WorkQueue>> queues;
+  double elapsed;
+
+  bool next_unit(unsigned worker, size_t &unit);
+  void worker_loop(unsigned worker);
+  void run_job(size_t job);
+  void run_lockstep(size_t begin, size_t end);
+
+public:
+  // threads = 0 uses one worker per hardware thread
+  BatchEngine(ExecEngine engine, unsigned threads = 0);
+
+  void add(const BatchJob &job) { jobs.push_back(job); }
+  void set_lockstep_width(int lanes) { lockstep_width = lanes; }
+  size_t size() const { return jobs.size(); }
+  unsigned get_num_threads() const { return num_threads; }
+
+  // Run every added job; results are indexed like the jobs
+  void run();
+
+  const std::vector<BatchResult> &get_results() const { return results; }
+  BatchSummary summary() const;
+};
+
+#endif // BATCH_H
@@ -0,0 +1,75 @@
+#include "block_cache.h"
+#include <algorithm>
+
+BlockCache::BlockCache() : epoch(0) {}
+
+Block *BlockCache::insert(std::unique_ptr<Block> block) {
+  if (index.empty()) {
+    index.assign((PROGRAM_END + 1) / 2, nullptr);
+  }
+
+  Block *b = block.get();
+  index[b->start / 2] = b;
+  for (size_t page = b->start / PAGE_SIZE; page <= b->end / PAGE_SIZE;
+       page++) {
+    page_blocks[page].push_back(b);
+  }
+  live.push_back(std::move(block));
+  return b;
+}
+
+void BlockCache::retire(Block *block) {
+  block->valid = false;
+  if (index[block->start / 2] == block) {
+    index[block->start / 2] = nullptr;
+  }
+
+  for (size_t page = block->start / PAGE_SIZE; page <= block->end / PAGE_SIZE;
+       page++) {
+    std::vector<Block *> &list = page_blocks[page];
+    list.erase(std::remove(list.begin(), list.end(), block), list.end());
+  }
+
+  for (size_t i = 0; i < live.size(); i++) {
+    if (live[i].get() == block) {
+      retired.push_back(std::move(live[i]));
+      live[i] = std::move(live.back());
+      live.pop_back();
+      break;
+    }
+  }
+}
+
+void BlockCache::invalidate_code(addr_t start, addr_t end) {
+  if (live.empty() || start > PROGRAM_END)
+    return;
+  if (end > PROGRAM_END)
+    end = PROGRAM_END;
+
+  bool hit = false;
+  for (size_t page = start / PAGE_SIZE; page <= end / PAGE_SIZE; page++) {
+    // Copy: retire() edits the page list we are walking
+    std::vector<Block *> overlapping = page_blocks[page];
+    for (size_t i = 0; i < overlapping.size(); i++) {
+      Block *b = overlapping[i];
+      if (b->valid && b->start <= end && b->end >= start) {
+        retire(b);
+        hit = true;
+      }
+    }
+  }
+
+  // Links may point at a retired block; drop them all
+  if (hit) {
+    epoch++;
+  }
+}
+
+void BlockCache::release_retired() { retired.clear(); }
+
+void BlockCache::flush() {
+  while (!live.empty()) {
+    retire(live.back().get());
+  }
+  epoch++;
+}
@@ -0,0 +1,83 @@
+#ifndef BLOCK_CACHE_H
+#define BLOCK_CACHE_H
+
+#include "../common/types.h"
+#include "decode_cache.h"
+#include "memory.h"
+#include <memory>
+#include <vector>
+
+struct Block;
+
+// Static successor of a block. The cached target is only trusted while
+// its epoch matches the cache epoch, which every invalidation bumps.
+struct BlockLink {
+  bool used;
+  addr_t pc;
+  Block *block;
+  uint32_t epoch;
+};
+
+// Decoded straight-line run of guest code ending in a terminator
+// (JMP/Jcc/CALL/RET/HALT, a direct store to the I/O page, an invalid
+// opcode, or the length cap)
+struct Block {
+  addr_t start;
+  addr_t end; // Last byte the block was decoded from
+  bool valid;
+  std::vector<DecodedInstr> instrs;
+  BlockLink links[2]; // Taken target, fall-through
+
+  // JIT state: executions so far and compiled native code, if any
+  uint32_t exec_count;
+  void *native;
+  bool jit_failed;
+};
+
+// Translation cache of basic blocks keyed by start PC. Covers the program
+// region only. Blocks whose bytes are written are unlinked immediately and
+// freed at the next release_retired() call, so a block may safely
+// invalidate itself while it is executing.
+class BlockCache : public CodeWriteListener {
+public:
+  static const size_t MAX_BLOCK_INSTRS = 64;
+
+private:
+  static const size_t PAGE_SIZE = 256;
+  static const size_t NUM_PAGES = (PROGRAM_END + 1) / PAGE_SIZE;
+
+  std::vector<Block *> index;                  // Start PC / 2 -> block
+  std::vector<Block *> page_blocks[NUM_PAGES]; // Blocks overlapping a page
+  std::vector<std::unique_ptr<Block>> live;
+  std::vector<std::unique_ptr<Block>> retired;
+  uint32_t epoch;
+
+  void retire(Block *block);
+
+public:
+  BlockCache();
+
+  uint32_t get_epoch() const { return epoch; }
+
+  // Cached block starting at pc, or nullptr
+  Block *lookup(addr_t pc) const {
+    if ((pc & 1) || pc > PROGRAM_END || index.empty())
+      return nullptr;
+    return index[pc / 2];
+  }
+
+  // Take ownership of a freshly translated block
+  Block *insert(std::unique_ptr<Block> block);
+
+  // Unlink every block decoded from bytes in [start, end]
+  void invalidate_code(addr_t start, addr_t end) override;
+
+  // Free blocks invalidated since the last call. Only safe when no block
+  // is executing.
+  void release_retired();
+  bool has_retired() const { return !retired.empty(); }
+
+  void flush();
+};
+
+#endif // BLOCK_CACHE_H
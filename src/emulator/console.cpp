@@ -0,0 +1,326 @@
+/*
+ * console.cpp
+ *
+ * Buffered console output and input. The writer thread sleeps on a
+ * condition variable; put() only wakes it for a newline (line policy) or
+ * once the ring is half full, so a burst of guest output costs one wake-up
+ * and a few large writes instead of one syscall per byte. The reader
+ * thread does the mirror image for input that cannot be mapped.
+ */
+
+#include "console.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// How long the line policy lets a partial line sit in the ring
+static const std::chrono::milliseconds PARTIAL_LINE_DELAY(10);
+
+ConsoleWriter::ConsoleWriter(FILE *sink, ConsoleFlush policy,
+                             size_t capacity)
+    : head(0), tail(0), overflow_pos(0), sink(sink), policy(policy),
+      sleeping(false), wake_pending(false), flush_requests(0),
+      flushes_done(0), stopping(false) {
+  size_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  ring.resize(size);
+  mask = size - 1;
+  writer = std::thread(&ConsoleWriter::writer_loop, this);
+}
+
+ConsoleWriter::~ConsoleWriter() {
+  flush();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  writer.join();
+}
+
+void ConsoleWriter::notify() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    wake_pending = true;
+  }
+  wake.notify_one();
+}
+
+// Move as much of the overflow buffer into the ring as fits
+void ConsoleWriter::spill() {
+  size_t h = head.load(std::memory_order_relaxed);
+  size_t room = ring.size() - (h - tail.load(std::memory_order_acquire));
+  size_t n = std::min(room, overflow.size() - overflow_pos);
+  for (size_t i = 0; i < n; i++) {
+    ring[(h + i) & mask] = overflow[overflow_pos + i];
+  }
+  head.store(h + n, std::memory_order_seq_cst);
+  overflow_pos += n;
+  if (overflow_pos == overflow.size()) {
+    overflow.clear();
+    overflow_pos = 0;
+  } else if (sleeping.load(std::memory_order_seq_cst)) {
+    notify(); // Ring is full
+  }
+}
+
+size_t ConsoleWriter::drain(bool &newline) {
+  newline = false;
+  size_t t = tail.load(std::memory_order_relaxed);
+  size_t h = head.load(std::memory_order_acquire);
+  size_t written = h - t;
+  while (t != h) {
+    size_t start = t & mask;
+    size_t len = std::min(h - t, ring.size() - start);
+    fwrite(&ring[start], 1, len, sink);
+    if (memchr(&ring[start], '\n', len) != nullptr) {
+      newline = true;
+    }
+    t += len;
+    tail.store(t, std::memory_order_release);
+  }
+  return written;
+}
+
+void ConsoleWriter::writer_loop() {
+  std::unique_lock<std::mutex> guard(lock);
+  bool unflushed = false; // Bytes in the sink's buffer
+  bool timed_out = false; // The partial line delay ran out
+  for (;;) {
+    wake_pending = false;
+    uint64_t requested = flush_requests;
+    guard.unlock();
+    bool newline;
+    if (drain(newline) != 0) {
+      unflushed = true;
+    }
+    // The line policy also pushes out a partial line once it has waited
+    // out the delay
+    if (requested != flushes_done ||
+        (policy == CONSOLE_FLUSH_LINE && unflushed &&
+         (newline || timed_out))) {
+      fflush(sink);
+      unflushed = false;
+    }
+    guard.lock();
+
+    if (requested != flushes_done) {
+      // flush() queued everything before requesting, so it is all out
+      flushes_done = requested;
+      drained.notify_all();
+    }
+    if (stopping) {
+      break;
+    }
+    if (wake_pending || flush_requests != flushes_done) {
+      continue;
+    }
+
+    // Announce the sleep before re-checking the ring, so a put() that
+    // raced with the check above sees the flag and wakes us
+    sleeping.store(true, std::memory_order_seq_cst);
+    size_t pending = head.load(std::memory_order_seq_cst) -
+                     tail.load(std::memory_order_relaxed);
+    timed_out = false;
+    if (pending < ring.size() / 2) {
+      if (policy == CONSOLE_FLUSH_LINE) {
+        timed_out = wake.wait_for(guard, PARTIAL_LINE_DELAY) ==
+                    std::cv_status::timeout;
+      } else {
+        wake.wait(guard, [this] {
+          return wake_pending || stopping || flush_requests != flushes_done;
+        });
+      }
+    }
+    sleeping.store(false, std::memory_order_relaxed);
+  }
+}
+
+void ConsoleWriter::flush() {
+  // Get the overflow into the ring first; the writer makes room for it
+  while (!overflow.empty()) {
+    spill();
+    if (!overflow.empty()) {
+      notify();
+      std::this_thread::yield();
+    }
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  uint64_t ticket = ++flush_requests;
+  wake.notify_one();
+  drained.wait(guard, [this, ticket] { return flushes_done >= ticket; });
+}
+
+ConsoleReader::ConsoleReader(int fd, size_t capacity)
+    : data(nullptr), mask(~(size_t)0), pos(0), limit(0), mapping(nullptr),
+      mapping_size(0), fd(fd), stream_capacity(0), head(0), tail(0),
+      done(false),
+      reader_sleeping(false), consumer_sleeping(false), stopping(false) {
+  stop_pipe[0] = stop_pipe[1] = -1;
+
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    if (info.st_size == 0) {
+      done = true;
+      return;
+    }
+    void *map = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, (size_t)info.st_size, MADV_SEQUENTIAL);
+      mapping = map;
+      mapping_size = (size_t)info.st_size;
+      data = (const char *)map;
+      limit = mapping_size;
+      done = true;
+      return;
+    }
+  }
+  stream_capacity = capacity; // Started by refill()
+}
+
+ConsoleReader::ConsoleReader(const char *data, size_t size)
+    : data(data), mask(~(size_t)0), pos(0), limit(size), mapping(nullptr),
+      mapping_size(0), fd(-1), stream_capacity(0), head(0), tail(0),
+      done(true),
+      reader_sleeping(false), consumer_sleeping(false), stopping(false) {
+  stop_pipe[0] = stop_pipe[1] = -1;
+}
+
+ConsoleReader::~ConsoleReader() {
+  if (reader.joinable()) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stopping = true;
+    }
+    wake.notify_all();
+    char c = 0;
+    while (write(stop_pipe[1], &c, 1) < 0 && errno == EINTR) {
+    }
+    reader.join();
+  }
+  if (stop_pipe[0] >= 0) {
+    close(stop_pipe[0]);
+    close(stop_pipe[1]);
+  }
+  if (mapping != nullptr) {
+    munmap(mapping, mapping_size);
+  }
+}
+
+void ConsoleReader::start_stream(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity) {
+    size *= 2;
+  }
+  ring.resize(size);
+  data = ring.data();
+  mask = size - 1;
+  if (pipe(stop_pipe) != 0) {
+    done = true; // Treat the input as empty
+    return;
+  }
+  reader = std::thread(&ConsoleReader::reader_loop, this);
+}
+
+// Hand the consumed bytes back to the reader thread and pick up whatever
+// it has added since. Every consumer call that finds no bytes ends up
+// here, so this is where a stream's thread is started.
+bool ConsoleReader::refill() {
+  if (ring.empty()) {
+    if (stream_capacity == 0) {
+      return false;
+    }
+    start_stream(stream_capacity);
+    stream_capacity = 0;
+  }
+  tail.store(pos, std::memory_order_seq_cst);
+  if (reader_sleeping.load(std::memory_order_seq_cst)) {
+    std::lock_guard<std::mutex> guard(lock);
+    wake.notify_all();
+  }
+  limit = head.load(std::memory_order_acquire);
+  return pos != limit;
+}
+
+bool ConsoleReader::at_end() {
+  // Check done first: bytes read before it was set are then visible
+  bool finished = done.load(std::memory_order_acquire);
+  return finished && !ready();
+}
+
+void ConsoleReader::wait() {
+  if (ready() || done.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::unique_lock<std::mutex> guard(lock);
+  consumer_sleeping.store(true, std::memory_order_seq_cst);
+  wake.wait(guard, [this] {
+    return head.load(std::memory_order_seq_cst) != pos ||
+           done.load(std::memory_order_seq_cst);
+  });
+  consumer_sleeping.store(false, std::memory_order_relaxed);
+}
+
+void ConsoleReader::reader_loop() {
+  for (;;) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t room = ring.size() - (h - tail.load(std::memory_order_acquire));
+    if (room == 0) {
+      // Announce the sleep before re-checking, so a refill() that raced
+      // with the check above sees the flag and wakes us
+      std::unique_lock<std::mutex> guard(lock);
+      reader_sleeping.store(true, std::memory_order_seq_cst);
+      wake.wait(guard, [this, h] {
+        return stopping ||
+               tail.load(std::memory_order_seq_cst) + ring.size() != h;
+      });
+      reader_sleeping.store(false, std::memory_order_relaxed);
+      if (stopping) {
+        return;
+      }
+      continue;
+    }
+
+    struct pollfd fds[2];
+    fds[0].fd = fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_pipe[0];
+    fds[1].events = POLLIN;
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents != 0) {
+      return; // Destructor
+    }
+
+    size_t start = h & mask;
+    ssize_t n = read(fd, &ring[start], std::min(room, ring.size() - start));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    }
+    if (n <= 0) {
+      break; // End of input or error
+    }
+    head.store(h + (size_t)n, std::memory_order_seq_cst);
+    if (consumer_sleeping.load(std::memory_order_seq_cst)) {
+      std::lock_guard<std::mutex> guard(lock);
+      wake.notify_all();
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  done.store(true, std::memory_order_seq_cst);
+  wake.notify_all();
+}
@@ -0,0 +1,145 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// When buffered console output is pushed out to the sink
+enum ConsoleFlush {
+  CONSOLE_FLUSH_LINE, // After every newline, and for partial lines within
+                      // a few milliseconds
+  CONSOLE_FLUSH_HALT, // Only when the buffer fills up or on flush()
+};
+
+// Asynchronous console output. The emulation thread appends bytes to a
+// lock-free single-producer/single-consumer ring; a writer thread drains
+// the ring to a stdio stream. put() never waits for the sink: if the ring
+// is full, bytes go to an overflow buffer that is moved into the ring as
+// space frees up.
+class ConsoleWriter {
+private:
+  std::vector<char> ring;
+  size_t mask;
+  std::atomic<size_t> head; // Next slot to fill; written by put() only
+  std::atomic<size_t> tail; // Next slot to drain; written by the writer
+  std::string overflow;     // Producer-side spill when the ring is full
+  size_t overflow_pos;      // First byte of overflow not yet in the ring
+
+  FILE *sink;
+  ConsoleFlush policy;
+
+  // Writer wake-up. The producer only takes the lock when the writer is
+  // asleep and there is a reason to wake it.
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable drained;
+  std::atomic<bool> sleeping;
+  bool wake_pending;
+  uint64_t flush_requests;
+  uint64_t flushes_done;
+  bool stopping;
+  std::thread writer;
+
+  void writer_loop();
+  size_t drain(bool &newline); // Bytes written; newline if one was
+  void spill();
+  void notify();
+
+public:
+  // capacity is rounded up to a power of two
+  ConsoleWriter(FILE *sink, ConsoleFlush policy, size_t capacity = 65536);
+  ~ConsoleWriter(); // Flushes and joins the writer thread
+
+  ConsoleWriter(const ConsoleWriter &) = delete;
+  ConsoleWriter &operator=(const ConsoleWriter &) = delete;
+
+  // Producer side; must always be called from the same thread
+  void put(char c) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (!overflow.empty() ||
+        h - tail.load(std::memory_order_acquire) == ring.size()) {
+      overflow.push_back(c);
+      spill();
+      return;
+    }
+    ring[h & mask] = c;
+    head.store(h + 1, std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_seq_cst) &&
+        ((c == '\n' && policy == CONSOLE_FLUSH_LINE) ||
+         h + 1 - tail.load(std::memory_order_relaxed) >= ring.size() / 2)) {
+      notify();
+    }
+  }
+
+  // Block until everything put so far has been written and the sink
+  // flushed. Producer side.
+  void flush();
+};
+
+// Console input with readahead. A regular file is mapped into memory; any
+// other source (pipe, terminal) is read by a background thread in large
+// chunks into a single-producer/single-consumer ring. The thread is only
+// started by the first consumer call, so unused input costs nothing. The
+// consumer side never blocks, except in wait(), and touches the shared
+// ring indices only when its current window of buffered bytes runs out.
+class ConsoleReader {
+private:
+  // Consumer window: bytes pos..limit-1 are ready. Positions are absolute;
+  // data[pos & mask] is the byte at pos.
+  const char *data;
+  size_t mask;
+  size_t pos;
+  size_t limit;
+
+  void *mapping; // Mapped file, if any
+  size_t mapping_size;
+
+  // Streaming source
+  int fd;
+  size_t stream_capacity; // Ring size for a stream not yet started, or 0
+  std::vector<char> ring;
+  std::atomic<size_t> head; // Written by the reader thread
+  std::atomic<size_t> tail; // Consumed so far; written by the consumer
+  std::atomic<bool> done;   // Source exhausted or failed
+  std::mutex lock;
+  std::condition_variable wake;
+  std::atomic<bool> reader_sleeping;   // Ring full, waiting for space
+  std::atomic<bool> consumer_sleeping; // In wait()
+  bool stopping;
+  int stop_pipe[2]; // Interrupts a reader blocked on fd
+  std::thread reader;
+
+  void reader_loop();
+  bool refill();
+  void start_stream(size_t capacity);
+
+public:
+  // Read from fd, which must stay open until the reader is destroyed. The
+  // ring capacity is rounded up to a power of two.
+  explicit ConsoleReader(int fd, size_t capacity = 1 << 20);
+  // Serve size bytes from data, which must outlive the reader
+  ConsoleReader(const char *data, size_t size);
+  ~ConsoleReader();
+
+  ConsoleReader(const ConsoleReader &) = delete;
+  ConsoleReader &operator=(const ConsoleReader &) = delete;
+
+  // Consumer side; must always be called from the same thread
+  bool ready() { return pos != limit || refill(); }
+  int get() { // Next byte, or -1 if none is ready
+    if (pos == limit && !refill()) {
+      return -1;
+    }
+    return (unsigned char)data[pos++ & mask];
+  }
+  bool at_end(); // Source exhausted and every byte consumed
+  void wait();   // Block until a byte is ready or the source is exhausted
+};
+
+#endif // CONSOLE_H
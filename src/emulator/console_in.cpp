@@ -0,0 +1,130 @@
+/*
+ * console_in.cpp
+ *
+ * Console input device on IO_CONSOLE_IN/IO_CONSOLE_STATUS. Guest reads
+ * are served from the reader's buffer without a system call; the periodic
+ * check that raises IRQ_CONSOLE_IN only runs while input is still open.
+ * Every answer from the reader can be logged, and a log can stand in for
+ * the reader to replay a run exactly.
+ */
+
+#include "console_in.h"
+#include <iostream>
+
+ConsoleInDevice::ConsoleInDevice(const uint64_t &clock,
+                                 EventScheduler &scheduler,
+                                 InterruptController &irq)
+    : clock(clock), scheduler(scheduler), irq(irq), reader(nullptr),
+      next_poll(UINT64_MAX), used(false), record_log(nullptr),
+      replay_log(nullptr), replay_pos(0), replay_diverged(false) {}
+
+void ConsoleInDevice::attach(ConsoleReader *input) {
+  reader = input;
+  reset();
+}
+
+void ConsoleInDevice::set_replay(const InputLog *log) {
+  replay_log = log;
+  replay_pos = log != nullptr ? log->seek(clock) : 0;
+  replay_diverged = false;
+}
+
+// Polls fall on multiples of POLL_INTERVAL, so a restored snapshot keeps
+// the phase of the run it was taken from
+void ConsoleInDevice::reset() {
+  scheduler.cancel(this);
+  next_poll = (clock + POLL_INTERVAL - 1) / POLL_INTERVAL * POLL_INTERVAL;
+  scheduler.schedule(next_poll, this);
+}
+
+ConsoleInState ConsoleInDevice::save() const {
+  ConsoleInState state;
+  state.next_poll = next_poll;
+  return state;
+}
+
+void ConsoleInDevice::load(const ConsoleInState &saved) {
+  scheduler.cancel(this);
+  next_poll = saved.next_poll;
+  if (next_poll != UINT64_MAX) {
+    scheduler.schedule(next_poll, this);
+  }
+  set_replay(replay_log);
+}
+
+// The recorded answer to this query. A guest that asks at another
+// instruction than the recording did gets end-of-input from then on.
+byte_t ConsoleInDevice::replay(byte_t kind) {
+  if (!replay_diverged && replay_pos < replay_log->size()) {
+    const InputEvent &event = (*replay_log)[replay_pos];
+    if (event.count == clock && event.kind == kind) {
+      replay_pos++;
+      return event.value;
+    }
+  }
+  if (!replay_diverged) {
+    std::cerr << "Replay: console input diverged from the recording at "
+                 "instruction "
+              << clock << std::endl;
+    replay_diverged = true;
+  }
+  switch (kind) {
+  case INPUT_DATA:
+    return 0;
+  case INPUT_STATUS:
+    return CONSOLE_IN_EOF;
+  default:
+    return INPUT_POLL_RAISE | INPUT_POLL_ENDED;
+  }
+}
+
+byte_t ConsoleInDevice::read(addr_t address) {
+  byte_t kind = address == IO_CONSOLE_IN ? INPUT_DATA : INPUT_STATUS;
+  if (replay_log != nullptr) {
+    return replay(kind);
+  }
+
+  byte_t value;
+  used = true;
+  if (kind == INPUT_DATA) {
+    int c = reader != nullptr ? reader->get() : -1;
+    value = c < 0 ? 0 : (byte_t)c;
+  } else if (reader == nullptr || reader->at_end()) {
+    value = CONSOLE_IN_EOF;
+  } else {
+    value = reader->ready() ? CONSOLE_IN_READY : 0;
+  }
+  if (record_log != nullptr) {
+    record_log->add(clock, kind, value);
+  }
+  return value;
+}
+
+void ConsoleInDevice::on_event(uint64_t when) {
+  next_poll = UINT64_MAX;
+  byte_t poll;
+  if (replay_log != nullptr) {
+    poll = replay(INPUT_POLL);
+  } else {
+    used = used || irq.is_unmasked(IRQ_CONSOLE_IN);
+    bool ended = reader == nullptr || (used && reader->at_end());
+    poll = ended ? INPUT_POLL_RAISE | INPUT_POLL_ENDED
+                 : used && reader->ready() ? INPUT_POLL_RAISE : 0;
+    if (record_log != nullptr) {
+      record_log->add(clock, INPUT_POLL, poll);
+    }
+  }
+  if ((poll & INPUT_POLL_RAISE) && !irq.is_pending(IRQ_CONSOLE_IN)) {
+    irq.raise(IRQ_CONSOLE_IN);
+  }
+  if (!(poll & INPUT_POLL_ENDED)) {
+    next_poll = when + POLL_INTERVAL;
+    scheduler.schedule(next_poll, this);
+  }
+}
+
+void ConsoleInDevice::wait_for_input() {
+  if (reader != nullptr && replay_log == nullptr) {
+    reader->wait();
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef CONSOLE_IN_H
+#define CONSOLE_IN_H
+
+#include "../common/types.h"
+#include "console.h"
+#include "input_log.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "scheduler.h"
+#include <cstdint>
+
+// Bits of the console input status register at IO_CONSOLE_STATUS
+const byte_t CONSOLE_IN_READY = 0x01; // IO_CONSOLE_IN has a byte to read
+const byte_t CONSOLE_IN_EOF = 0x02;   // Input has ended and been consumed
+
+// Console input device state that is part of a snapshot
+struct ConsoleInState {
+  uint64_t next_poll; // UINT64_MAX once input has ended
+};
+
+// Console input device. Registers:
+//   IO_CONSOLE_IN      reading consumes and returns the next input byte, or
+//                      0 if none is ready; never blocks
+//   IO_CONSOLE_STATUS  status bits above
+// Bytes come from a ConsoleReader, which buffers ahead of the guest; no
+// reader acts as empty input. While input is open the device checks the
+// reader every POLL_INTERVAL instructions and raises IRQ_CONSOLE_IN when
+// a byte is ready, and once more when the input ends. Until the guest
+// reads a register or unmasks IRQ_CONSOLE_IN the checks leave the reader
+// alone, so a stream reader's thread is never started for a program that
+// takes no input. Input is a stream:
+// it is not part of CPU state and snapshots do not rewind it, except when
+// replaying an InputLog, which answers by instruction count instead.
+class ConsoleInDevice : public MemoryDevice, public EventHandler {
+private:
+  static const uint64_t POLL_INTERVAL = 4096;
+
+  const uint64_t &clock; // Instructions executed so far
+  EventScheduler &scheduler;
+  InterruptController &irq;
+  ConsoleReader *reader;
+  uint64_t next_poll; // UINT64_MAX once input has ended
+  bool used;          // The guest has asked for input
+
+  InputLog *record_log;       // Receives every answer from reader
+  const InputLog *replay_log; // Answers instead of reader
+  size_t replay_pos;
+  bool replay_diverged;
+
+  byte_t replay(byte_t kind);
+
+public:
+  ConsoleInDevice(const uint64_t &clock, EventScheduler &scheduler,
+                  InterruptController &irq);
+
+  // Take input from reader (nullptr: no input, status reads EOF). The
+  // reader must outlive its use by this device.
+  void attach(ConsoleReader *reader);
+
+  byte_t read(addr_t address) override;
+  void write(addr_t, byte_t) override {} // Read-only
+  void on_event(uint64_t when) override;
+
+  // Log what reader answers to record_log (nullptr: stop), or answer
+  // from replay_log instead of any reader (nullptr: use the reader). Logs
+  // must outlive their use by this device.
+  void set_recording(InputLog *log) { record_log = log; }
+  void set_replay(const InputLog *log);
+
+  // Restart polling from the current instruction, e.g. after the
+  // scheduler was cleared
+  void reset();
+
+  ConsoleInState save() const;
+  void load(const ConsoleInState &saved); // Also repositions a replay
+
+  // True if the device's next check is the event due at when
+  bool polls_at(uint64_t when) const { return next_poll == when; }
+
+  // Block until the reader has a byte or the input ends
+  void wait_for_input();
+};
+
+#endif // CONSOLE_IN_H
@@ -1,8 +1,57 @@
 #include "cpu.h"
+#include "cpu_ops.h"
+#include "disasm.h"
+#include "jit_x86_64.h"
 #include <iomanip>
 #include <iostream>
 
-CPU::CPU(Memory &mem) : memory(mem) { reset(); }
+// One predecoded handler per 6-bit opcode and flag mode; unused opcodes
+// report an error
+#define HANDLER_ROW(base, lazy)                                                \
+  &CPU::exec<(base) + 0, lazy>, &CPU::exec<(base) + 1, lazy>,                  \
+      &CPU::exec<(base) + 2, lazy>, &CPU::exec<(base) + 3, lazy>,              \
+      &CPU::exec<(base) + 4, lazy>, &CPU::exec<(base) + 5, lazy>,              \
+      &CPU::exec<(base) + 6, lazy>, &CPU::exec<(base) + 7, lazy>
+
+#define HANDLER_TABLE(lazy)                                                    \
+  {                                                                            \
+    HANDLER_ROW(0x00, lazy), HANDLER_ROW(0x08, lazy), HANDLER_ROW(0x10, lazy), \
+        HANDLER_ROW(0x18, lazy), HANDLER_ROW(0x20, lazy),                      \
+        HANDLER_ROW(0x28, lazy), HANDLER_ROW(0x30, lazy),                      \
+        HANDLER_ROW(0x38, lazy)                                                \
+  }
+
+const InstrHandler CPU::HANDLERS[2][64] = {HANDLER_TABLE(false),
+                                           HANDLER_TABLE(true)};
+
+#undef HANDLER_TABLE
+
+#undef HANDLER_ROW
+
+CPU::CPU(Memory &mem)
+    : memory(mem), instruction_limit(0), stats_enabled(false),
+      profiler(nullptr), trace_writer(nullptr), trace_record(nullptr),
+      lazy_flags(false), engine(ENGINE_PREDECODED),
+      chained_block(nullptr), chained_epoch(0), jit_threshold(32),
+      irq(instruction_count, scheduler),
+      timer(instruction_count, scheduler, irq),
+      console_in(instruction_count, scheduler, irq) {
+  reset();
+  memory.add_code_listener(&decode_cache);
+  memory.add_code_listener(&block_cache);
+  memory.map_device(IO_TIMER_CTRL, IO_TIMER_VAL + 1, &timer);
+  memory.map_device(IO_INT_MASK, IO_INT_STATUS, &irq);
+  memory.map_device(IO_CONSOLE_IN, IO_CONSOLE_IN, &console_in);
+  memory.map_device(IO_CONSOLE_STATUS, IO_CONSOLE_STATUS, &console_in);
+}
+
+CPU::~CPU() {
+  memory.unmap_device(&console_in);
+  memory.unmap_device(&irq);
+  memory.unmap_device(&timer);
+  memory.remove_code_listener(&block_cache);
+  memory.remove_code_listener(&decode_cache);
+}
 
 void CPU::reset() {
   // Clear all registers
@@ -13,9 +62,19 @@ void CPU::reset() {
   pc = PROGRAM_START;
   sp = STACK_END; // Stack grows downward
   flags = 0;
+  deferred.pending = false;
   halted = false;
   debug_mode = false;
   instruction_count = 0;
+  idle_count = 0;
+  interrupt_count = 0;
+  stop_reason = STOP_NONE;
+  stats.clear();
+  chained_block = nullptr;
+  scheduler.clear();
+  irq.reset();
+  timer.reset();
+  console_in.reset();
 }
 
 word_t CPU::get_register(int reg) const {
@@ -25,6 +84,58 @@ word_t CPU::get_register(int reg) const {
   return 0;
 }
 
+void CPU::set_register(int reg, word_t value) {
+  if (reg >= 0 && reg < NUM_REGISTERS) {
+    registers[reg] = value;
+  }
+}
+
+CPUState CPU::save_state() const {
+  CPUState state;
+  for (int i = 0; i < NUM_REGISTERS; i++) {
+    state.registers[i] = registers[i];
+  }
+  state.pc = pc;
+  state.sp = sp;
+  state.flags = get_flags();
+  state.halted = halted;
+  state.instruction_count = instruction_count;
+  state.idle_count = idle_count;
+  state.timer = timer.save();
+  state.interrupts = irq.save();
+  state.console_in = console_in.save();
+  return state;
+}
+
+void CPU::restore_state(const CPUState &state) {
+  for (int i = 0; i < NUM_REGISTERS; i++) {
+    registers[i] = state.registers[i];
+  }
+  pc = state.pc;
+  sp = state.sp;
+  flags = state.flags;
+  deferred.pending = false;
+  halted = state.halted;
+  instruction_count = state.instruction_count;
+  idle_count = state.idle_count;
+  timer.load(state.timer);
+  irq.load(state.interrupts);
+  console_in.load(state.console_in);
+  chained_block = nullptr;
+}
+
+MachineSnapshot CPU::snapshot() {
+  MachineSnapshot snap;
+  snap.cpu = save_state();
+  snap.memory = memory.snapshot();
+  return snap;
+}
+
+void CPU::restore(const MachineSnapshot &snap) {
+  memory.restore(snap.memory);
+  restore_state(snap.cpu);
+}
+
 void CPU::push(word_t value) {
   sp -= 2; // Stack grows downward
   memory.write_word(sp, value);
@@ -38,9 +149,65 @@ word_t CPU::pop() {
 
 void CPU::halt() { halted = true; }
 
-void CPU::run() {
-  while (!halted) {
-    step();
+void CPU::service_events(uint64_t now) {
+  scheduler.run_due(now);
+  int line = irq.deliverable_line();
+  if (line >= 0) {
+    enter_interrupt(line);
+  }
+}
+
+// Push PC and FLAGS (with the interrupt-enable state in FLAG_INTERRUPT),
+// disable interrupts and jump through the line's vector
+void CPU::enter_interrupt(int line) {
+  irq.acknowledge(line);
+  word_t saved = sync_flags();
+  if (irq.is_enabled()) {
+    saved |= FLAG_INTERRUPT;
+  }
+  irq.set_enabled(false);
+  interrupt_count++;
+  if (stats_enabled) {
+    stats.interrupts++;
+    stats.count_write((addr_t)(sp - 2));
+    stats.count_write((addr_t)(sp - 4));
+    stats.count_read((addr_t)(IO_INT_VECTORS + 2 * line));
+  }
+  push(pc);
+  push(saved);
+  pc = memory.read_word((addr_t)(IO_INT_VECTORS + 2 * line));
+  chained_block = nullptr;
+}
+
+void CPU::return_from_interrupt() {
+  word_t saved = pop();
+  pc = pop();
+  flags = saved & (FLAG_ZERO | FLAG_CARRY | FLAG_NEGATIVE | FLAG_OVERFLOW);
+  deferred.pending = false;
+  irq.set_enabled((saved & FLAG_INTERRUPT) != 0);
+}
+
+// Skip the instructions a spin loop would burn until the next event. The
+// event itself is delivered by the event check that follows WAIT.
+void CPU::wait_for_event() {
+  if (irq.deliverable_line() >= 0) {
+    return;
+  }
+  uint64_t next = scheduler.next_deadline();
+  if (next == UINT64_MAX) {
+    std::cerr << "WAIT with no pending event at PC=0x" << std::hex
+              << (pc - 2) << std::dec << std::endl;
+    halt();
+    return;
+  }
+  // Only console input can end the wait: sleep until some arrives
+  if (console_in.polls_at(next)) {
+    console_in.wait_for_input();
+  }
+  // The check after this instruction runs at instruction_count + 1
+  if (next > instruction_count + 1) {
+    idle_count += next - (instruction_count + 1);
+    instruction_count = next - 1;
   }
 }
 
@@ -48,7 +215,12 @@ void CPU::step() {
   if (halted)
     return;
 
-  fetch_decode_execute();
+  if (engine == ENGINE_SWITCH) {
+    sync_flags();
+    fetch_decode_execute();
+  } else {
+    fetch_execute_decoded();
+  }
   instruction_count++;
 }
 
@@ -73,6 +245,55 @@ void CPU::fetch_decode_execute() {
   }
 }
 
+// Extract all fields of the instruction at address, including the trailing
+// address word for instructions that have one
+void CPU::decode(addr_t address, DecodedInstr &instr) const {
+  word_t instruction = memory.read_word(address);
+  byte_t opcode = GET_OPCODE(instruction);
+
+  instr.opcode = opcode;
+  instr.rd = GET_RD(instruction);
+  instr.rs = GET_RS(instruction);
+  instr.rt = GET_RT(instruction);
+
+  switch (opcode) {
+  case OP_MOVI:
+    instr.imm = sign_extend_7bit(GET_IMM7(instruction));
+    break;
+  case OP_ADDI:
+  case OP_SUBI:
+  case OP_CMPI:
+    instr.imm = sign_extend_4bit(GET_IMM4(instruction));
+    break;
+  default:
+    instr.imm = GET_IMM4(instruction);
+    break;
+  }
+
+  instr.target = has_address_word(opcode) ? memory.read_word(address + 2) : 0;
+  instr.handler = HANDLERS[lazy_flags ? 1 : 0][opcode];
+}
+
+void CPU::fetch_execute_decoded() {
+  addr_t current_pc = pc;
+  DecodedInstr scratch;
+  const DecodedInstr &instr = fetch_decoded(current_pc, scratch);
+  pc += 2;
+
+  if (debug_mode) {
+    std::cout << "\n[" << instruction_count << "] ";
+    disassemble_instruction(memory.read_word(current_pc), current_pc);
+    std::cout << std::endl;
+  }
+
+  instr.handler(*this, instr);
+
+  if (debug_mode) {
+    print_registers();
+    print_flags();
+  }
+}
+
 void CPU::execute_instruction(word_t instruction) {
   byte_t opcode = GET_OPCODE(instruction);
   byte_t rd = GET_RD(instruction);
@@ -279,6 +500,22 @@ void CPU::execute_instruction(word_t instruction) {
     break;
 
   // System
+  case OP_EI:
+    irq.set_enabled(true);
+    break;
+
+  case OP_DI:
+    irq.set_enabled(false);
+    break;
+
+  case OP_RETI:
+    return_from_interrupt();
+    break;
+
+  case OP_WAIT:
+    wait_for_event();
+    break;
+
   case OP_HALT:
     halt();
     if (debug_mode) {
@@ -292,6 +529,10 @@ void CPU::execute_instruction(word_t instruction) {
     halt();
     break;
   }
+
+  if (is_control_transfer(opcode)) {
+    poll_events(instruction_count + 1); // Count once this one completes
+  }
 }
 
 void CPU::print_registers() const {
@@ -304,7 +545,18 @@ void CPU::print_registers() const {
             << std::setw(4) << std::setfill('0') << sp << std::dec << std::endl;
 }
 
+void CPU::set_lazy_flags(bool enable) {
+  sync_flags();
+  lazy_flags = enable;
+
+  // Cached decodes hold handlers for the previous mode
+  decode_cache.flush();
+  block_cache.flush();
+  chained_block = nullptr;
+}
+
 void CPU::print_flags() const {
+  word_t flags = get_flags();
   std::cout << "Flags: ";
   std::cout << "Z=" << ((flags & FLAG_ZERO) ? 1 : 0) << " ";
   std::cout << "C=" << ((flags & FLAG_CARRY) ? 1 : 0) << " ";
@@ -314,74 +566,6 @@ void CPU::print_flags() const {
 
 void CPU::disassemble_instruction(word_t instruction, addr_t address) const {
   byte_t opcode = GET_OPCODE(instruction);
-  byte_t rd = GET_RD(instruction);
-  byte_t rs = GET_RS(instruction);
-  byte_t rt = GET_RT(instruction);
-  byte_t imm4 = GET_IMM4(instruction);
-  byte_t imm7 = GET_IMM7(instruction);
-
-  std::cout << "0x" << std::hex << std::setw(4) << std::setfill('0') << address
-            << ": " << std::setw(4) << std::setfill('0') << instruction << "  "
-            << get_opcode_name(opcode) << " ";
-
-  // Format operands based on instruction type
-  switch (opcode) {
-  case OP_NOP:
-    if (rd != rs) {
-      std::cout << "R" << (int)rd << ", R" << (int)rs;
-    }
-    break;
-  case OP_MOVI:
-    std::cout << "R" << (int)rd << ", " << std::dec << sign_extend_7bit(imm7);
-    break;
-  case OP_LOAD_IND:
-    std::cout << "R" << (int)rd << ", [R" << (int)rs << "]";
-    break;
-  case OP_STORE_IND:
-    std::cout << "R" << (int)rs << ", [R" << (int)rd << "]";
-    break;
-  case OP_LOAD_DIR:
-  case OP_STORE_DIR:
-  case OP_JMP:
-  case OP_JZ:
-  case OP_JNZ:
-  case OP_JC:
-  case OP_JNC:
-  case OP_JN:
-  case OP_CALL:
-    std::cout << "0x" << std::hex << std::setw(4) << std::setfill('0')
-              << memory.read_word(pc);
-    break;
-  case OP_ADDI:
-  case OP_SUBI:
-  case OP_ANDI:
-  case OP_ORI:
-  case OP_SHLI:
-  case OP_SHRI:
-    std::cout << "R" << (int)rd << ", R" << (int)rs << ", " << std::dec
-              << sign_extend_4bit(imm4);
-    break;
-  case OP_CMPI:
-    std::cout << "R" << (int)rs << ", " << std::dec << sign_extend_4bit(imm4);
-    break;
-  case OP_INC:
-  case OP_DEC:
-  case OP_PUSH:
-  case OP_POP:
-    std::cout << "R" << (int)rd;
-    break;
-  case OP_NOT:
-  case OP_CMP:
-    std::cout << "R" << (int)rd << ", R" << (int)rs;
-    break;
-  case OP_RET:
-  case OP_HALT:
-    // No operands
-    break;
-  default:
-    // Three-operand format
-    std::cout << "R" << (int)rd << ", R" << (int)rs << ", R" << (int)rt;
-    break;
-  }
-  std::cout << std::dec;
+  word_t operand = has_address_word(opcode) ? memory.read_word(pc) : 0;
+  disassemble(std::cout, address, instruction, operand);
 }
@@ -4,10 +4,77 @@
 #include "../common/instructions.h"
 #include "../common/types.h"
 #include "alu.h"
+#include "block_cache.h"
+#include "console_in.h"
+#include "decode_cache.h"
+#include "interrupt.h"
 #include "memory.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
+#include <memory>
 #include <string>
+#include <vector>
+
+class JitCompiler;
+
+// Execution engines. ENGINE_SWITCH decodes every instruction word as it is
+// fetched and is the reference; the others must match it exactly.
+enum ExecEngine {
+  ENGINE_SWITCH,     // Fetch, decode and switch on each instruction word
+  ENGINE_PREDECODED, // Dispatch through the predecoded instruction cache
+  ENGINE_THREADED,   // Threaded dispatch over predecoded instructions
+  ENGINE_BLOCK,      // Chained basic blocks from the block cache
+  ENGINE_JIT,        // Block engine with hot blocks compiled to x86-64
+};
+
+// Optional instrumentation of the run loop. Each combination is a separate
+// instantiation of CPU::run_loop, so features that are off cost nothing.
+enum RunFeature {
+  RUN_TRACE = 1 << 0,       // Print (-d) or record (binary trace) each
+                            // instruction and the state after it
+  RUN_BREAKPOINTS = 1 << 1, // Stop before executing a breakpoint address
+  RUN_LIMIT = 1 << 2,       // Stop after a maximum instruction count
+  RUN_STATS = 1 << 3,       // Gather ExecStats (see stats.h)
+  RUN_PROFILE = 1 << 4,     // Feed each PC to the sampling profiler
+  RUN_FEATURE_COMBINATIONS = 1 << 5
+};
+
+// Why the last call to CPU::run() returned
+enum StopReason {
+  STOP_NONE,       // run() has not returned yet
+  STOP_HALTED,     // HALT or an invalid instruction
+  STOP_BREAKPOINT, // PC reached a breakpoint
+  STOP_LIMIT,      // Instruction limit reached
+};
+
+// Architectural state of a CPU
+struct CPUState {
+  word_t registers[NUM_REGISTERS];
+  word_t pc;
+  word_t sp;
+  word_t flags;
+  bool halted;
+  uint64_t instruction_count;
+  uint64_t idle_count;
+  TimerState timer;
+  InterruptState interrupts;
+  ConsoleInState console_in;
+};
+
+// Checkpoint of a whole machine: CPU state plus a copy-on-write image of
+// its memory. Restoring it into any CPU+Memory pair forks the machine.
+struct MachineSnapshot {
+  CPUState cpu;
+  MemorySnapshot memory;
+};
 
 class CPU {
+  friend class JitCompiler;    // Generated code works on CPU state in place
+  friend class LockstepEngine; // Lanes swap their state in for scalar steps
+
 private:
   // Registers
   word_t registers[NUM_REGISTERS]; // R0-R7
@@ -21,35 +88,173 @@ private:
   // CPU state
   bool halted;
   bool debug_mode;
-  uint64_t instruction_count;
+  uint64_t instruction_count; // Includes instructions skipped by WAIT
+  uint64_t idle_count;        // Instructions skipped by WAIT
+  uint64_t interrupt_count;   // Interrupts entered
+  StopReason stop_reason;
+
+  // Run loop instrumentation (see cpu_run.cpp)
+  std::vector<bool> breakpoints; // Indexed by address; empty if none set
+  uint64_t instruction_limit;    // 0 = unlimited
+  bool stats_enabled;
+  ExecStats stats;
+  Profiler *profiler; // nullptr if not profiling
+  TraceWriter *trace_writer; // nullptr if not writing a binary trace
+  TraceFilter trace_filter;
+  TraceRecord *trace_record; // Slot for the instruction being traced
+  word_t trace_registers[NUM_REGISTERS]; // Before that instruction
+  uint64_t trace_interrupts;             // interrupt_count before it
+
+  // Lazy flag evaluation: the last flag-producing operation and its
+  // operands, turned into FLAGS only when something reads them
+  struct DeferredFlags {
+    ALU::FlagOp op;
+    word_t a;
+    word_t b;
+    bool pending;
+  };
+  bool lazy_flags;
+  DeferredFlags deferred;
+
+  // Execution engine and its decoded-code caches
+  ExecEngine engine;
+  DecodeCache decode_cache;
+  BlockCache block_cache;
+  Block *chained_block; // Successor picked by the last block, if any
+  uint32_t chained_epoch;
+  std::unique_ptr<JitCompiler> jit;
+  uint32_t jit_threshold;
+
+  // Devices clocked by instruction_count. Due events and interrupts are
+  // delivered after each control transfer (see is_control_transfer), so
+  // every engine delivers them at the same instruction.
+  EventScheduler scheduler;
+  InterruptController irq;
+  TimerDevice timer;
+  ConsoleInDevice console_in;
+  void poll_events(uint64_t now) {
+    if (now >= scheduler.next_deadline()) {
+      service_events(now);
+    }
+  }
+  void service_events(uint64_t now);
+  void enter_interrupt(int line);
+  void return_from_interrupt();
+  void wait_for_event();
 
   // Instruction execution helpers
   void execute_instruction(word_t instruction);
   void fetch_decode_execute();
 
+  // Predecoded execution (handlers are defined in cpu_ops.h)
+  static const InstrHandler HANDLERS[2][64]; // [lazy flags][opcode]
+  template <int OP, bool LAZY>
+  static void exec(CPU &cpu, const DecodedInstr &instr);
+  template <ALU::FlagOp FOP, bool LAZY> word_t alu(word_t a, word_t b);
+  word_t sync_flags(); // Materialize deferred flags
+  void decode(addr_t address, DecodedInstr &instr) const;
+  const DecodedInstr &fetch_decoded(addr_t address, DecodedInstr &scratch);
+  void fetch_execute_decoded();
+  void run_threaded(); // See cpu_threaded.cpp
+  template <bool LAZY> void run_threaded_impl();
+
+  // Basic-block execution (see cpu_blocks.cpp)
+  Block *translate_block(addr_t start);
+  void execute_block(Block *block);
+  Block *linked_successor(Block *block);
+  void run_blocks();
+  void compile_block(Block *block);
+
+  // Run loop specialized on a RunFeature set (see cpu_run.cpp)
+  typedef void (CPU::*RunLoop)();
+  static const RunLoop RUN_LOOPS[2][RUN_FEATURE_COMBINATIONS]; // [decoded]
+  template <unsigned FEATURES, bool DECODED> void run_loop();
+  unsigned active_features() const;
+  void count_stats(byte_t opcode, byte_t rd, byte_t rs, word_t target);
+  void trace_before(addr_t address, word_t instruction, word_t operand);
+  void trace_after();
+
   // Stack operations
   void push(word_t value);
   word_t pop();
 
 public:
   CPU(Memory &mem);
+  ~CPU();
 
   // CPU control
   void reset();
   void run();
-  void step(); // Execute single instruction
+  void step();       // Execute single instruction
+  // Execute a basic block, then the blocks it links to until
+  // instruction_count reaches limit (block/JIT engines). The default runs
+  // exactly one block.
+  void step_block(uint64_t limit = 0);
+  // Run with the selected engine until halted or at least count
+  // instructions have executed. The block and JIT engines stop at the
+  // first block boundary at or after count; the others (threaded through
+  // the predecoded handlers) stop exactly at count unless WAIT skips past.
+  void run_until(uint64_t count);
   void halt();
 
   // State inspection
   bool is_halted() const { return halted; }
   word_t get_pc() const { return pc; }
   word_t get_sp() const { return sp; }
-  word_t get_flags() const { return flags; }
+  word_t get_flags() const {
+    return deferred.pending
+               ? ALU::compute_flags(deferred.op, deferred.a, deferred.b)
+               : flags;
+  }
   word_t get_register(int reg) const;
+  void set_register(int reg, word_t value);
   uint64_t get_instruction_count() const { return instruction_count; }
+  uint64_t get_idle_count() const { return idle_count; }
+  bool interrupts_enabled() const { return irq.is_enabled(); }
+  StopReason get_stop_reason() const { return stop_reason; }
+
+  // Checkpoints. snapshot() is O(pages); restore() copies nothing and
+  // only invalidates decoded code on pages that differ.
+  CPUState save_state() const;
+  void restore_state(const CPUState &state);
+  MachineSnapshot snapshot();
+  void restore(const MachineSnapshot &snap);
+
+  // Engine selection
+  void set_engine(ExecEngine e) { engine = e; }
+  ExecEngine get_engine() const { return engine; }
+  void set_jit_threshold(uint32_t executions) { jit_threshold = executions; }
+  void set_lazy_flags(bool enable);
+
+  // Console input at IO_CONSOLE_IN (nullptr: none). The reader must
+  // outlive its use by this CPU.
+  void set_console_input(ConsoleReader *reader) { console_in.attach(reader); }
+
+  // Log every console input value the guest receives (nullptr: stop), or
+  // take them from a log instead of the reader (nullptr: use the reader).
+  // See input_log.h. Logs must outlive their use by this CPU.
+  void set_input_recording(InputLog *log) { console_in.set_recording(log); }
+  void set_input_replay(const InputLog *log) { console_in.set_replay(log); }
 
   // Debug features
   void set_debug_mode(bool enable) { debug_mode = enable; }
+  void add_breakpoint(addr_t address);
+  void clear_breakpoints() { breakpoints.clear(); }
+  void set_instruction_limit(uint64_t limit) { instruction_limit = limit; }
+  void set_stats_enabled(bool enable) { stats_enabled = enable; }
+  uint64_t get_opcode_count(byte_t opcode) const {
+    return stats.opcode_counts[opcode & 0x3F];
+  }
+  const ExecStats &get_stats() const { return stats; }
+  // Sample PCs into profiler while running (nullptr: off). The profiler
+  // must outlive its use by this CPU.
+  void set_profiler(Profiler *p) { profiler = p; }
+  // Record the instructions filter accepts to writer while running
+  // (nullptr: off). The writer must outlive its use by this CPU.
+  void set_trace(TraceWriter *writer, const TraceFilter &filter) {
+    trace_writer = writer;
+    trace_filter = filter;
+  }
   void print_registers() const;
   void print_flags() const;
   void disassemble_instruction(word_t instruction, addr_t address) const;
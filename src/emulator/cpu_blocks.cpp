@@ -0,0 +1,257 @@
+/*
+ * cpu_blocks.cpp
+ *
+ * Basic-block execution engine. Guest code is translated into decoded
+ * straight-line blocks, and each block records its static successors so
+ * that hot loops run from block to block inside step_block without going
+ * back to the dispatcher or the cache lookup. Addresses the block cache
+ * does not cover (odd PCs, code outside the program region) are
+ * single-stepped.
+ */
+
+#include "block_cache.h"
+#include "cpu.h"
+#include "cpu_ops.h"
+#include "jit_x86_64.h"
+
+// Instructions that may write memory, and so may invalidate their own block
+static inline bool writes_memory(byte_t opcode) {
+  return opcode == OP_STORE_IND || opcode == OP_STORE_DIR ||
+         opcode == OP_PUSH || opcode == OP_CALL;
+}
+
+// Does the instruction end a basic block?
+static inline bool is_block_terminator(const DecodedInstr &instr) {
+  switch (instr.opcode) {
+  case OP_JMP:
+  case OP_JZ:
+  case OP_JNZ:
+  case OP_JC:
+  case OP_JNC:
+  case OP_JN:
+  case OP_CALL:
+  case OP_RET:
+  case OP_EI:
+  case OP_DI:
+  case OP_RETI:
+  case OP_WAIT:
+  case OP_HALT:
+    return true;
+  case OP_STORE_DIR:
+    return instr.target >= IO_START && instr.target <= IO_END;
+  default:
+    // Invalid opcodes halt the CPU
+    return !is_valid_opcode(instr.opcode);
+  }
+}
+
+static void set_link(BlockLink &link, addr_t pc) {
+  link.used = true;
+  link.pc = pc;
+  link.block = nullptr;
+  link.epoch = 0;
+}
+
+// Decode the block starting at start, or return nullptr if start is not
+// covered by the block cache
+Block *CPU::translate_block(addr_t start) {
+  if ((start & 1) || start > PROGRAM_END - 3)
+    return nullptr;
+
+  std::unique_ptr<Block> block(new Block());
+  block->start = start;
+  block->valid = true;
+  block->links[0].used = false;
+  block->links[1].used = false;
+  block->exec_count = 0;
+  block->native = nullptr;
+  block->jit_failed = false;
+
+  addr_t addr = start;
+  while (true) {
+    DecodedInstr instr;
+    decode(addr, instr);
+    block->instrs.push_back(instr);
+
+    addr_t next = addr + (has_address_word(instr.opcode) ? 4 : 2);
+    block->end = next - 1;
+
+    if (is_block_terminator(instr)) {
+      switch (instr.opcode) {
+      case OP_JMP:
+      case OP_CALL:
+        set_link(block->links[0], instr.target);
+        break;
+      case OP_JZ:
+      case OP_JNZ:
+      case OP_JC:
+      case OP_JNC:
+      case OP_JN:
+        set_link(block->links[0], instr.target);
+        set_link(block->links[1], next);
+        break;
+      case OP_STORE_DIR:
+      case OP_EI:
+      case OP_DI:
+      case OP_WAIT:
+        set_link(block->links[1], next);
+        break;
+      default:
+        // RET and RETI have dynamic targets; HALT and invalid opcodes stop
+        // the CPU
+        break;
+      }
+      break;
+    }
+
+    // Stop at the length cap or where the next decode would leave the
+    // cached region
+    if (block->instrs.size() >= BlockCache::MAX_BLOCK_INSTRS ||
+        next > PROGRAM_END - 3) {
+      set_link(block->links[1], next);
+      break;
+    }
+    addr = next;
+  }
+
+  return block_cache.insert(std::move(block));
+}
+
+void CPU::compile_block(Block *block) {
+  if (!jit) {
+    jit.reset(new JitCompiler(*this));
+  }
+  block->native = (void *)jit->compile(*block);
+  block->jit_failed = block->native == nullptr;
+}
+
+// Blocks after which control goes back to the dispatcher even when a
+// successor is linked: I/O stores and instructions that change the
+// interrupt state, so devices and interrupts are looked at promptly
+static inline bool ends_chain(const Block &block) {
+  const DecodedInstr &instr = block.instrs.back();
+  switch (instr.opcode) {
+  case OP_EI:
+  case OP_DI:
+  case OP_RETI:
+  case OP_WAIT:
+    return true;
+  case OP_STORE_DIR:
+    return instr.target >= IO_START && instr.target <= IO_END;
+  default:
+    return false;
+  }
+}
+
+void CPU::execute_block(Block *block) {
+  if (engine == ENGINE_JIT && block->native == nullptr && !block->jit_failed &&
+      ++block->exec_count >= jit_threshold && JitCompiler::available()) {
+    compile_block(block);
+  }
+
+  if (block->native != nullptr) {
+    // Native code reads and writes the flags register directly
+    sync_flags();
+    ((JitCode)block->native)(this, memory.read_pages(), &memory);
+    // The handlers deliver events after control transfers; native code
+    // leaves that to its exit. Handlers run before the transfer is
+    // counted, and device writes made while entering an interrupt see
+    // that clock, so step it back for the delivery.
+    if (block->valid && is_control_transfer(block->instrs.back().opcode)) {
+      instruction_count--;
+      poll_events(instruction_count + 1);
+      instruction_count++;
+    }
+  } else {
+    // Interpret the block; pc is kept exact after every instruction
+    const DecodedInstr *instr = block->instrs.data();
+    const DecodedInstr *last = instr + block->instrs.size();
+    for (; instr != last; instr++) {
+      pc += 2;
+      instr->handler(*this, *instr);
+      instruction_count++;
+      if (writes_memory(instr->opcode) && !block->valid) {
+        break; // Rest of the block was overwritten
+      }
+    }
+  }
+}
+
+// The successor the block links to for the current pc, translated if
+// need be, or nullptr
+Block *CPU::linked_successor(Block *block) {
+  uint32_t epoch = block_cache.get_epoch();
+  for (int i = 0; i < 2; i++) {
+    BlockLink &link = block->links[i];
+    if (!link.used || link.pc != pc)
+      continue;
+    if (link.block == nullptr || link.epoch != epoch) {
+      link.block = block_cache.lookup(pc);
+      if (link.block == nullptr) {
+        link.block = translate_block(pc);
+      }
+      link.epoch = block_cache.get_epoch();
+    }
+    return link.block;
+  }
+  return nullptr;
+}
+
+void CPU::step_block(uint64_t limit) {
+  if (halted)
+    return;
+
+  // Drop the chained successor if anything was invalidated since it was
+  // chosen, then free retired blocks (none can be running here)
+  Block *block = chained_block;
+  chained_block = nullptr;
+  if (chained_epoch != block_cache.get_epoch()) {
+    block = nullptr;
+  }
+  if (block_cache.has_retired()) {
+    block_cache.release_retired();
+  }
+
+  if (block == nullptr) {
+    block = block_cache.lookup(pc);
+    if (block == nullptr) {
+      block = translate_block(pc);
+    }
+    if (block == nullptr) {
+      step();
+      return;
+    }
+  }
+
+  // Run from block to linked block without coming back here until one
+  // has no successor for this pc, needs the dispatcher, takes an
+  // interrupt or reaches the limit
+  for (;;) {
+    uint64_t interrupts = interrupt_count;
+    execute_block(block);
+    if (halted || !block->valid)
+      return;
+
+    Block *next = linked_successor(block);
+    if (next == nullptr)
+      return;
+    if (ends_chain(*block) || interrupt_count != interrupts ||
+        instruction_count >= limit) {
+      chained_block = next;
+      chained_epoch = block_cache.get_epoch();
+      return;
+    }
+
+    // next was checked against the current epoch, so it is not retired
+    block = next;
+    if (block_cache.has_retired()) {
+      block_cache.release_retired();
+    }
+  }
+}
+
+void CPU::run_blocks() {
+  while (!halted) {
+    step_block(UINT64_MAX);
+  }
+}
@@ -0,0 +1,272 @@
+#ifndef CPU_OPS_H
+#define CPU_OPS_H
+
+// Per-opcode semantics for the predecoded engines. Each instantiation of
+// CPU::exec<OP, LAZY> is the handler for one opcode; the switch on the
+// template argument folds away at compile time. LAZY selects deferred flag
+// evaluation. Behaviour must match the reference CPU::execute_instruction
+// exactly.
+
+#include "cpu.h"
+#include <iostream>
+
+// Look up (decoding on a miss) the instruction at address. Addresses the
+// cache does not cover are decoded into scratch.
+inline const DecodedInstr &CPU::fetch_decoded(addr_t address,
+                                              DecodedInstr &scratch) {
+  DecodedInstr *entry = decode_cache.lookup(address);
+  if (entry == nullptr) {
+    decode(address, scratch);
+    return scratch;
+  }
+  if (entry->handler == nullptr) {
+    decode(address, *entry);
+  }
+  return *entry;
+}
+
+inline word_t CPU::sync_flags() {
+  if (deferred.pending) {
+    flags = ALU::compute_flags(deferred.op, deferred.a, deferred.b);
+    deferred.pending = false;
+  }
+  return flags;
+}
+
+// Flag-producing ALU operation: either compute flags now, or record the
+// operation and compute only the result
+template <ALU::FlagOp FOP, bool LAZY>
+inline word_t CPU::alu(word_t a, word_t b) {
+  if (LAZY) {
+    deferred.op = FOP;
+    deferred.a = a;
+    deferred.b = b;
+    deferred.pending = true;
+    return ALU::result(FOP, a, b);
+  }
+  return ALU::apply(FOP, a, b, flags);
+}
+
+template <int OP, bool LAZY>
+inline void CPU::exec(CPU &cpu, const DecodedInstr &instr) {
+  word_t *regs = cpu.registers;
+
+  switch (OP) {
+  // Data Movement
+  case OP_NOP:
+    if (instr.rd != instr.rs) {
+      regs[instr.rd] = regs[instr.rs];
+    }
+    break;
+
+  case OP_MOVI:
+    regs[instr.rd] = instr.imm;
+    break;
+
+  case OP_LOAD_IND:
+    regs[instr.rd] = cpu.memory.read_word(regs[instr.rs]);
+    break;
+
+  case OP_LOAD_DIR:
+    cpu.pc += 2;
+    regs[instr.rd] = cpu.memory.read_word(instr.target);
+    break;
+
+  case OP_STORE_IND:
+    cpu.memory.write_word(regs[instr.rd], regs[instr.rs]);
+    break;
+
+  case OP_STORE_DIR:
+    cpu.pc += 2;
+    cpu.memory.write_word(instr.target, regs[instr.rs]);
+    break;
+
+  // Arithmetic
+  case OP_ADD:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_ADD, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_ADDI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_ADD, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  case OP_SUB:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_SUB, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_SUBI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_SUB, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  case OP_MUL:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_MUL, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_DIV:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_DIV, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_INC:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_ADD, LAZY>(regs[instr.rd], 1);
+    break;
+
+  case OP_DEC:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_SUB, LAZY>(regs[instr.rd], 1);
+    break;
+
+  // Logical
+  case OP_AND:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_AND, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_ANDI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_AND, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  case OP_OR:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_OR, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_ORI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_OR, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  case OP_XOR:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_XOR, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_NOT:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_NOT, LAZY>(regs[instr.rs], 0);
+    break;
+
+  // Shift
+  case OP_SHL:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_SHL, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_SHLI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_SHL, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  case OP_SHR:
+    regs[instr.rd] =
+        cpu.alu<ALU::FLAGS_SHR, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_SHRI:
+    regs[instr.rd] = cpu.alu<ALU::FLAGS_SHR, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  // Comparison
+  case OP_CMP:
+    cpu.alu<ALU::FLAGS_SUB, LAZY>(regs[instr.rs], regs[instr.rt]);
+    break;
+
+  case OP_CMPI:
+    cpu.alu<ALU::FLAGS_SUB, LAZY>(regs[instr.rs], instr.imm);
+    break;
+
+  // Branch/Jump
+  case OP_JMP:
+    cpu.pc = instr.target;
+    break;
+
+  case OP_JZ:
+    cpu.pc += 2;
+    if (cpu.sync_flags() & FLAG_ZERO) {
+      cpu.pc = instr.target;
+    }
+    break;
+
+  case OP_JNZ:
+    cpu.pc += 2;
+    if (!(cpu.sync_flags() & FLAG_ZERO)) {
+      cpu.pc = instr.target;
+    }
+    break;
+
+  case OP_JC:
+    cpu.pc += 2;
+    if (cpu.sync_flags() & FLAG_CARRY) {
+      cpu.pc = instr.target;
+    }
+    break;
+
+  case OP_JNC:
+    cpu.pc += 2;
+    if (!(cpu.sync_flags() & FLAG_CARRY)) {
+      cpu.pc = instr.target;
+    }
+    break;
+
+  case OP_JN:
+    cpu.pc += 2;
+    if (cpu.sync_flags() & FLAG_NEGATIVE) {
+      cpu.pc = instr.target;
+    }
+    break;
+
+  case OP_CALL:
+    cpu.pc += 2;
+    cpu.push(cpu.pc); // Save return address
+    cpu.pc = instr.target;
+    break;
+
+  case OP_RET:
+    cpu.pc = cpu.pop(); // Restore return address
+    break;
+
+  // Stack
+  case OP_PUSH:
+    cpu.push(regs[instr.rs]);
+    break;
+
+  case OP_POP:
+    regs[instr.rd] = cpu.pop();
+    break;
+
+  // System
+  case OP_EI:
+    cpu.irq.set_enabled(true);
+    break;
+
+  case OP_DI:
+    cpu.irq.set_enabled(false);
+    break;
+
+  case OP_RETI:
+    cpu.return_from_interrupt();
+    break;
+
+  case OP_WAIT:
+    cpu.wait_for_event();
+    break;
+
+  case OP_HALT:
+    cpu.halt();
+    if (cpu.debug_mode) {
+      std::cout << "CPU HALTED" << std::endl;
+    }
+    break;
+
+  default:
+    std::cerr << "Unknown opcode: 0x" << std::hex << (int)instr.opcode
+              << std::dec << std::endl;
+    cpu.halt();
+    break;
+  }
+
+  if (is_control_transfer(OP)) {
+    cpu.poll_events(cpu.instruction_count + 1); // Count once OP completes
+  }
+}
+
+#endif // CPU_OPS_H
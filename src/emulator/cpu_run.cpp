@@ -0,0 +1,347 @@
+/*
+ * cpu_run.cpp
+ *
+ * Run loop for the switch and predecoded engines, and for any engine when
+ * instrumentation is on. The loop is instantiated once per RunFeature
+ * combination, so tracing, breakpoints, the instruction limit, the
+ * ExecStats counters and profiling are only tested by the loops that use
+ * them. The threaded, block and JIT engines have no per-instruction hooks
+ * and only run when every feature is off.
+ */
+
+#include "cpu.h"
+#include "cpu_ops.h"
+#include "disasm.h"
+#include <chrono>
+#include <iostream>
+
+#define RUN_LOOP_ROW(decoded)                                                  \
+  {                                                                            \
+    &CPU::run_loop<0, decoded>, &CPU::run_loop<1, decoded>,                    \
+        &CPU::run_loop<2, decoded>, &CPU::run_loop<3, decoded>,                \
+        &CPU::run_loop<4, decoded>, &CPU::run_loop<5, decoded>,                \
+        &CPU::run_loop<6, decoded>, &CPU::run_loop<7, decoded>,                \
+        &CPU::run_loop<8, decoded>, &CPU::run_loop<9, decoded>,                \
+        &CPU::run_loop<10, decoded>, &CPU::run_loop<11, decoded>,              \
+        &CPU::run_loop<12, decoded>, &CPU::run_loop<13, decoded>,              \
+        &CPU::run_loop<14, decoded>, &CPU::run_loop<15, decoded>,              \
+        &CPU::run_loop<16, decoded>, &CPU::run_loop<17, decoded>,              \
+        &CPU::run_loop<18, decoded>, &CPU::run_loop<19, decoded>,              \
+        &CPU::run_loop<20, decoded>, &CPU::run_loop<21, decoded>,              \
+        &CPU::run_loop<22, decoded>, &CPU::run_loop<23, decoded>,              \
+        &CPU::run_loop<24, decoded>, &CPU::run_loop<25, decoded>,              \
+        &CPU::run_loop<26, decoded>, &CPU::run_loop<27, decoded>,              \
+        &CPU::run_loop<28, decoded>, &CPU::run_loop<29, decoded>,              \
+        &CPU::run_loop<30, decoded>, &CPU::run_loop<31, decoded>               \
+  }
+
+const CPU::RunLoop CPU::RUN_LOOPS[2][RUN_FEATURE_COMBINATIONS] = {
+    RUN_LOOP_ROW(false), RUN_LOOP_ROW(true)};
+
+#undef RUN_LOOP_ROW
+
+unsigned CPU::active_features() const {
+  unsigned features = 0;
+  if (debug_mode || trace_writer != nullptr)
+    features |= RUN_TRACE;
+  if (!breakpoints.empty())
+    features |= RUN_BREAKPOINTS;
+  if (instruction_limit != 0)
+    features |= RUN_LIMIT;
+  if (stats_enabled)
+    features |= RUN_STATS;
+  if (profiler != nullptr)
+    features |= RUN_PROFILE;
+  return features;
+}
+
+void CPU::add_breakpoint(addr_t address) {
+  if (breakpoints.empty()) {
+    breakpoints.assign(MEMORY_SIZE, false);
+  }
+  breakpoints[address] = true;
+}
+
+void CPU::run() {
+  stop_reason = STOP_NONE;
+  unsigned features = active_features();
+  std::chrono::steady_clock::time_point start;
+  if (features & RUN_STATS) {
+    start = std::chrono::steady_clock::now();
+  }
+
+  if (features == 0 && engine == ENGINE_THREADED) {
+    run_threaded();
+    stop_reason = STOP_HALTED;
+  } else if (features == 0 &&
+             (engine == ENGINE_BLOCK || engine == ENGINE_JIT)) {
+    run_blocks();
+    stop_reason = STOP_HALTED;
+  } else {
+    // Engines without a plain loop of their own fall back to the
+    // predecoded handlers when instrumented
+    (this->*RUN_LOOPS[engine == ENGINE_SWITCH ? 0 : 1][features])();
+  }
+  if (features & RUN_STATS) {
+    stats.seconds += std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+  }
+
+  // Console output may still be buffered; show it before returning
+  memory.flush_console();
+}
+
+void CPU::run_until(uint64_t count) {
+  if (engine == ENGINE_BLOCK || engine == ENGINE_JIT) {
+    while (!halted && instruction_count < count) {
+      step_block(count);
+    }
+    memory.flush_console();
+    return;
+  }
+  uint64_t saved_limit = instruction_limit;
+  if (instruction_limit == 0 || instruction_limit > count) {
+    instruction_limit = count;
+  }
+  run();
+  instruction_limit = saved_limit;
+}
+
+// A code word for the instrumentation, read from the backing pages so that
+// code in the I/O page does not reach a device twice
+static word_t peek_word(const Memory &memory, addr_t address) {
+  addr_t next = (addr_t)(address + 1);
+  return (word_t)(memory.page_data(address / MEMORY_PAGE_SIZE)
+                      [address % MEMORY_PAGE_SIZE] |
+                  memory.page_data(next / MEMORY_PAGE_SIZE)
+                          [next % MEMORY_PAGE_SIZE]
+                      << 8);
+}
+
+// Count an instruction about to execute. Memory accesses are classified by
+// the addresses it will use, which only the registers and SP before
+// executing it determine.
+void CPU::count_stats(byte_t opcode, byte_t rd, byte_t rs, word_t target) {
+  stats.opcode_counts[opcode]++;
+  switch (opcode) {
+  case OP_LOAD_IND:
+    stats.count_read(registers[rs]);
+    break;
+  case OP_LOAD_DIR:
+    stats.count_read(target);
+    break;
+  case OP_STORE_IND:
+    stats.count_write(registers[rd]);
+    break;
+  case OP_STORE_DIR:
+    stats.count_write(target);
+    break;
+  case OP_JZ:
+  case OP_JNZ:
+  case OP_JC:
+  case OP_JNC:
+  case OP_JN: {
+    word_t f = sync_flags();
+    bool taken;
+    switch (opcode) {
+    case OP_JZ:
+      taken = (f & FLAG_ZERO) != 0;
+      break;
+    case OP_JNZ:
+      taken = (f & FLAG_ZERO) == 0;
+      break;
+    case OP_JC:
+      taken = (f & FLAG_CARRY) != 0;
+      break;
+    case OP_JNC:
+      taken = (f & FLAG_CARRY) == 0;
+      break;
+    default:
+      taken = (f & FLAG_NEGATIVE) != 0;
+      break;
+    }
+    if (taken) {
+      stats.branches_taken++;
+    } else {
+      stats.branches_not_taken++;
+    }
+    break;
+  }
+  case OP_CALL:
+    stats.count_write((addr_t)(sp - 2));
+    if (++stats.call_depth > stats.max_call_depth) {
+      stats.max_call_depth = stats.call_depth;
+    }
+    break;
+  case OP_RET:
+    stats.count_read(sp);
+    if (stats.call_depth > 0) {
+      stats.call_depth--;
+    }
+    break;
+  case OP_PUSH:
+    stats.count_write((addr_t)(sp - 2));
+    break;
+  case OP_POP:
+    stats.count_read(sp);
+    break;
+  case OP_RETI:
+    stats.count_read(sp);
+    stats.count_read((addr_t)(sp + 2));
+    break;
+  }
+}
+
+// Print the instruction about to execute (-d), and start its trace record
+// if the filter accepts it. PC has already been advanced past the first
+// instruction word.
+void CPU::trace_before(addr_t address, word_t instruction, word_t operand) {
+  if (debug_mode) {
+    std::cout << "\n[" << instruction_count << "] ";
+    disassemble(std::cout, address, instruction, operand);
+    std::cout << std::endl;
+  }
+
+  trace_record = nullptr;
+  if (trace_writer == nullptr ||
+      !trace_filter.accepts(address, instruction_count)) {
+    return;
+  }
+  TraceRecord &record = trace_writer->next();
+  record.count = instruction_count;
+  record.pc = address;
+  record.instruction = instruction;
+  record.operand = operand;
+  record.info = 0;
+
+  // The word stored, if any, from the state before the instruction runs
+  byte_t opcode = GET_OPCODE(instruction);
+  byte_t rs = GET_RS(instruction);
+  switch (opcode) {
+  case OP_STORE_IND:
+    record.mem_addr = registers[GET_RD(instruction)];
+    record.mem_value = registers[rs];
+    record.info |= TRACE_MEM_WRITE;
+    break;
+  case OP_STORE_DIR:
+    record.mem_addr = operand;
+    record.mem_value = registers[rs];
+    record.info |= TRACE_MEM_WRITE;
+    break;
+  case OP_PUSH:
+    record.mem_addr = (addr_t)(sp - 2);
+    record.mem_value = registers[rs];
+    record.info |= TRACE_MEM_WRITE;
+    break;
+  case OP_CALL:
+    record.mem_addr = (addr_t)(sp - 2);
+    record.mem_value = (word_t)(address + 4);
+    record.info |= TRACE_MEM_WRITE;
+    break;
+  default:
+    record.mem_addr = 0;
+    record.mem_value = 0;
+    break;
+  }
+
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    trace_registers[r] = registers[r];
+  }
+  trace_interrupts = interrupt_count;
+  trace_record = &record;
+}
+
+// Print the state after the instruction (-d) and finish its record
+void CPU::trace_after() {
+  if (debug_mode) {
+    print_registers();
+    print_flags();
+  }
+  if (trace_record == nullptr) {
+    return;
+  }
+
+  TraceRecord &record = *trace_record;
+  record.reg_value = 0;
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    if (registers[r] != trace_registers[r]) {
+      record.info |= TRACE_REG | (byte_t)r;
+      record.reg_value = registers[r];
+      break; // Instructions write at most one register
+    }
+  }
+  record.sp = sp;
+  record.flags = (byte_t)get_flags();
+  if (interrupt_count != trace_interrupts) {
+    record.info |= TRACE_INTERRUPT;
+  }
+  trace_record = nullptr;
+}
+
+template <unsigned FEATURES, bool DECODED> void CPU::run_loop() {
+  const bool TRACE = (FEATURES & RUN_TRACE) != 0;
+  DecodedInstr scratch;
+
+  if (!DECODED) {
+    sync_flags(); // The switch interpreter updates FLAGS directly
+  }
+
+  // A breakpoint at the resume address must not stop the CPU again
+  bool resumed = true;
+
+  while (!halted) {
+    if (FEATURES & RUN_BREAKPOINTS) {
+      if (breakpoints[pc] && !resumed) {
+        stop_reason = STOP_BREAKPOINT;
+        return;
+      }
+      resumed = false;
+    }
+    if (FEATURES & RUN_LIMIT) {
+      if (instruction_count >= instruction_limit) {
+        stop_reason = STOP_LIMIT;
+        return;
+      }
+    }
+
+    addr_t current_pc = pc;
+    if (FEATURES & RUN_PROFILE) {
+      profiler->tick(current_pc);
+    }
+    if (DECODED) {
+      const DecodedInstr &instr = fetch_decoded(current_pc, scratch);
+      if (FEATURES & RUN_STATS) {
+        count_stats(instr.opcode, instr.rd, instr.rs, instr.target);
+      }
+      pc += 2;
+      if (TRACE) {
+        trace_before(current_pc, peek_word(memory, current_pc), instr.target);
+      }
+      instr.handler(*this, instr);
+    } else {
+      word_t instruction = memory.read_word(current_pc);
+      byte_t opcode = GET_OPCODE(instruction);
+      word_t target = 0;
+      if ((FEATURES & (RUN_STATS | RUN_TRACE)) && has_address_word(opcode)) {
+        target = peek_word(memory, (addr_t)(current_pc + 2));
+      }
+      if (FEATURES & RUN_STATS) {
+        count_stats(opcode, GET_RD(instruction), GET_RS(instruction), target);
+      }
+      pc += 2;
+      if (TRACE) {
+        trace_before(current_pc, instruction, target);
+      }
+      execute_instruction(instruction);
+    }
+
+    instruction_count++;
+
+    if (TRACE) {
+      trace_after();
+    }
+  }
+
+  stop_reason = STOP_HALTED;
+}
@@ -0,0 +1,186 @@
+/*
+ * cpu_threaded.cpp
+ *
+ * Threaded-code execution engine. Instead of returning to a central switch
+ * after every instruction, each opcode body ends with its own indirect jump
+ * to the next handler, so the host branch predictor sees one dispatch site
+ * per opcode. Uses computed goto on GCC/Clang and a handler-table loop
+ * elsewhere. Only HALT, WAIT and invalid opcodes can stop the CPU, so only
+ * their bodies test the halted flag.
+ */
+
+#include "cpu.h"
+#include "cpu_ops.h"
+
+#if defined(__GNUC__)
+#define CPU_COMPUTED_GOTO 1
+#endif
+
+template <bool LAZY> void CPU::run_threaded_impl() {
+  DecodedInstr scratch;
+  const DecodedInstr *instr;
+
+#ifdef CPU_COMPUTED_GOTO
+  static void *const DISPATCH_TABLE[64] = {
+      &&L_NOP,         // 0x00
+      &&L_MOVI,        // 0x01
+      &&L_LOAD_IND,    // 0x02
+      &&L_LOAD_DIR,    // 0x03
+      &&L_STORE_IND,   // 0x04
+      &&L_STORE_DIR,   // 0x05
+      &&L_INVALID,     // 0x06
+      &&L_INVALID,     // 0x07
+      &&L_ADD,         // 0x08
+      &&L_ADDI,        // 0x09
+      &&L_SUB,         // 0x0A
+      &&L_SUBI,        // 0x0B
+      &&L_MUL,         // 0x0C
+      &&L_DIV,         // 0x0D
+      &&L_INC,         // 0x0E
+      &&L_DEC,         // 0x0F
+      &&L_AND,         // 0x10
+      &&L_ANDI,        // 0x11
+      &&L_OR,          // 0x12
+      &&L_ORI,         // 0x13
+      &&L_XOR,         // 0x14
+      &&L_NOT,         // 0x15
+      &&L_INVALID,     // 0x16
+      &&L_INVALID,     // 0x17
+      &&L_SHL,         // 0x18
+      &&L_SHLI,        // 0x19
+      &&L_SHR,         // 0x1A
+      &&L_SHRI,        // 0x1B
+      &&L_CMP,         // 0x1C
+      &&L_CMPI,        // 0x1D
+      &&L_INVALID,     // 0x1E
+      &&L_INVALID,     // 0x1F
+      &&L_JMP,         // 0x20
+      &&L_JZ,          // 0x21
+      &&L_JNZ,         // 0x22
+      &&L_JC,          // 0x23
+      &&L_JNC,         // 0x24
+      &&L_JN,          // 0x25
+      &&L_CALL,        // 0x26
+      &&L_RET,         // 0x27
+      &&L_PUSH,        // 0x28
+      &&L_POP,         // 0x29
+      &&L_INVALID,     // 0x2A
+      &&L_INVALID,     // 0x2B
+      &&L_INVALID,     // 0x2C
+      &&L_INVALID,     // 0x2D
+      &&L_INVALID,     // 0x2E
+      &&L_INVALID,     // 0x2F
+      &&L_INVALID,     // 0x30
+      &&L_INVALID,     // 0x31
+      &&L_INVALID,     // 0x32
+      &&L_INVALID,     // 0x33
+      &&L_INVALID,     // 0x34
+      &&L_INVALID,     // 0x35
+      &&L_INVALID,     // 0x36
+      &&L_INVALID,     // 0x37
+      &&L_INVALID,     // 0x38
+      &&L_INVALID,     // 0x39
+      &&L_INVALID,     // 0x3A
+      &&L_EI,          // 0x3B
+      &&L_DI,          // 0x3C
+      &&L_RETI,        // 0x3D
+      &&L_WAIT,        // 0x3E
+      &&L_HALT         // 0x3F
+  };
+
+// Fetch the next predecoded instruction and jump straight to its body
+#define DISPATCH()                                                             \
+  do {                                                                         \
+    instr = &fetch_decoded(pc, scratch);                                       \
+    pc += 2;                                                                   \
+    goto *DISPATCH_TABLE[instr->opcode];                                       \
+  } while (0)
+
+#define THREADED_OP(name)                                                      \
+  L_##name : exec<OP_##name, LAZY>(*this, *instr);                             \
+  instruction_count++;                                                         \
+  DISPATCH();
+
+  if (halted)
+    return;
+  DISPATCH();
+
+  THREADED_OP(NOP)
+  THREADED_OP(MOVI)
+  THREADED_OP(LOAD_IND)
+  THREADED_OP(LOAD_DIR)
+  THREADED_OP(STORE_IND)
+  THREADED_OP(STORE_DIR)
+  THREADED_OP(ADD)
+  THREADED_OP(ADDI)
+  THREADED_OP(SUB)
+  THREADED_OP(SUBI)
+  THREADED_OP(MUL)
+  THREADED_OP(DIV)
+  THREADED_OP(INC)
+  THREADED_OP(DEC)
+  THREADED_OP(AND)
+  THREADED_OP(ANDI)
+  THREADED_OP(OR)
+  THREADED_OP(ORI)
+  THREADED_OP(XOR)
+  THREADED_OP(NOT)
+  THREADED_OP(SHL)
+  THREADED_OP(SHLI)
+  THREADED_OP(SHR)
+  THREADED_OP(SHRI)
+  THREADED_OP(CMP)
+  THREADED_OP(CMPI)
+  THREADED_OP(JMP)
+  THREADED_OP(JZ)
+  THREADED_OP(JNZ)
+  THREADED_OP(JC)
+  THREADED_OP(JNC)
+  THREADED_OP(JN)
+  THREADED_OP(CALL)
+  THREADED_OP(RET)
+  THREADED_OP(PUSH)
+  THREADED_OP(POP)
+  THREADED_OP(EI)
+  THREADED_OP(DI)
+  THREADED_OP(RETI)
+
+L_WAIT:
+  // Halts if no event can ever end the wait
+  exec<OP_WAIT, LAZY>(*this, *instr);
+  instruction_count++;
+  if (halted)
+    return;
+  DISPATCH();
+
+L_HALT:
+  exec<OP_HALT, LAZY>(*this, *instr);
+  instruction_count++;
+  return;
+
+L_INVALID:
+  // Reports the opcode and halts
+  instr->handler(*this, *instr);
+  instruction_count++;
+  return;
+
+#undef THREADED_OP
+#undef DISPATCH
+#else
+  // Portable fallback: call through the handler stored in each entry
+  while (!halted) {
+    instr = &fetch_decoded(pc, scratch);
+    pc += 2;
+    instr->handler(*this, *instr);
+    instruction_count++;
+  }
+#endif
+}
+
+void CPU::run_threaded() {
+  if (lazy_flags) {
+    run_threaded_impl<true>();
+  } else {
+    run_threaded_impl<false>();
+  }
+}
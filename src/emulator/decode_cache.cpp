@@ -0,0 +1,25 @@
+#include "decode_cache.h"
+
+void DecodeCache::invalidate_code(addr_t start, addr_t end) {
+  // The entry two bytes before a written byte may hold it as its address word
+  int first = (int)(start & ~1) - 2;
+  if (first < 0)
+    first = 0;
+  int last = end > PROGRAM_END ? PROGRAM_END : end;
+
+  for (int addr = first; addr <= last; addr += 2) {
+    std::unique_ptr<DecodedInstr[]> &page = pages[addr / PAGE_SIZE];
+    if (!page) {
+      // Nothing decoded on this page; skip to the next one
+      addr = (addr / PAGE_SIZE + 1) * PAGE_SIZE - 2;
+      continue;
+    }
+    page[(addr % PAGE_SIZE) / 2].handler = nullptr;
+  }
+}
+
+void DecodeCache::flush() {
+  for (size_t i = 0; i < NUM_PAGES; i++) {
+    pages[i].reset();
+  }
+}
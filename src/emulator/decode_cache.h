@@ -0,0 +1,72 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include "../common/instructions.h"
+#include "../common/types.h"
+#include "memory.h"
+#include <memory>
+
+class CPU;
+struct DecodedInstr;
+
+// Handler that executes one predecoded instruction
+typedef void (*InstrHandler)(CPU &cpu, const DecodedInstr &instr);
+
+// One instruction word with its fields already extracted
+struct DecodedInstr {
+  InstrHandler handler; // nullptr while the entry is not decoded
+  byte_t opcode;
+  byte_t rd;
+  byte_t rs;
+  byte_t rt;
+  word_t imm;    // Immediate, sign-extended where the ISA requires it
+  word_t target; // Trailing address word (LOAD_DIR/STORE_DIR/JMP/Jcc/CALL)
+};
+
+// True for instructions followed by a 16-bit address word
+inline bool has_address_word(byte_t opcode) {
+  return opcode == OP_LOAD_DIR || opcode == OP_STORE_DIR ||
+         (opcode >= OP_JMP && opcode <= OP_CALL);
+}
+
+// True for jumps, calls, returns, RETI and WAIT: the points where the CPU
+// delivers scheduled events and interrupts
+inline bool is_control_transfer(byte_t opcode) {
+  const uint64_t transfers = (0xFFull << OP_JMP) | (1ull << OP_RETI) |
+                             (1ull << OP_WAIT); // JMP..RET are contiguous
+  return (transfers >> (opcode & 0x3F)) & 1;
+}
+
+// Predecoded instruction cache covering the program region. Entries are
+// allocated lazily one 256-byte page at a time and invalidated whenever
+// the bytes they were decoded from are written.
+class DecodeCache : public CodeWriteListener {
+private:
+  static const size_t PAGE_SIZE = 256;
+  static const size_t ENTRIES_PER_PAGE = PAGE_SIZE / 2;
+  static const size_t NUM_PAGES = (PROGRAM_END + 1) / PAGE_SIZE;
+
+  std::unique_ptr<DecodedInstr[]> pages[NUM_PAGES];
+
+public:
+  // Entry slot for an instruction at the given address, or nullptr if the
+  // address cannot be cached (odd, or decoding would read past PROGRAM_END)
+  DecodedInstr *lookup(addr_t address) {
+    if ((address & 1) || address > PROGRAM_END - 3) {
+      return nullptr;
+    }
+    std::unique_ptr<DecodedInstr[]> &page = pages[address / PAGE_SIZE];
+    if (!page) {
+      page.reset(new DecodedInstr[ENTRIES_PER_PAGE]());
+    }
+    return &page[(address % PAGE_SIZE) / 2];
+  }
+
+  // Drop every entry decoded from bytes in [start, end]
+  void invalidate_code(addr_t start, addr_t end) override;
+
+  // Drop all entries
+  void flush();
+};
+
+#endif // DECODE_CACHE_H
@@ -0,0 +1,112 @@
+#include "difftest.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Device state that is not visible in memory until the guest reads it
+static bool same_devices(const CPUState &a, const CPUState &b,
+                         std::ostringstream &out) {
+  const TimerState &ta = a.timer, &tb = b.timer;
+  const InterruptState &ia = a.interrupts, &ib = b.interrupts;
+  if (ta.ctrl != tb.ctrl || ta.period != tb.period || ta.latch != tb.latch ||
+      ta.deadline != tb.deadline) {
+    out << "timer: ctrl 0x" << std::setw(2) << (int)ta.ctrl << " period 0x"
+        << std::setw(4) << ta.period << " deadline " << std::dec
+        << ta.deadline << std::hex << " != ctrl 0x" << std::setw(2)
+        << (int)tb.ctrl << " period 0x" << std::setw(4) << tb.period
+        << " deadline " << std::dec << tb.deadline;
+    return false;
+  }
+  if (ia.pending != ib.pending || ia.mask != ib.mask ||
+      ia.enabled != ib.enabled) {
+    out << "interrupts: pending 0x" << std::setw(2) << (int)ia.pending
+        << " mask 0x" << std::setw(2) << (int)ia.mask << " enabled "
+        << ia.enabled << " != pending 0x" << std::setw(2) << (int)ib.pending
+        << " mask 0x" << std::setw(2) << (int)ib.mask << " enabled "
+        << ib.enabled;
+    return false;
+  }
+  return true;
+}
+
+bool compare_state(const CPU &a, const Memory &mem_a, const CPU &b,
+                   const Memory &mem_b, std::string &diff) {
+  std::ostringstream out;
+  out << std::hex << std::setfill('0');
+
+  for (int i = 0; i < NUM_REGISTERS; i++) {
+    if (a.get_register(i) != b.get_register(i)) {
+      out << "R" << i << ": 0x" << std::setw(4) << a.get_register(i)
+          << " != 0x" << std::setw(4) << b.get_register(i);
+      diff = out.str();
+      return false;
+    }
+  }
+  if (a.get_pc() != b.get_pc()) {
+    out << "PC: 0x" << std::setw(4) << a.get_pc() << " != 0x" << std::setw(4)
+        << b.get_pc();
+  } else if (a.get_sp() != b.get_sp()) {
+    out << "SP: 0x" << std::setw(4) << a.get_sp() << " != 0x" << std::setw(4)
+        << b.get_sp();
+  } else if (a.get_flags() != b.get_flags()) {
+    out << "FLAGS: 0x" << std::setw(4) << a.get_flags() << " != 0x"
+        << std::setw(4) << b.get_flags();
+  } else if (a.is_halted() != b.is_halted()) {
+    out << "halted: " << a.is_halted() << " != " << b.is_halted();
+  } else if (a.get_instruction_count() != b.get_instruction_count()) {
+    out << std::dec << "instruction count: " << a.get_instruction_count()
+        << " != " << b.get_instruction_count();
+  } else if (!same_devices(a.save_state(), b.save_state(), out)) {
+    // Reported by same_devices
+  } else {
+    for (size_t addr = 0; addr < MEMORY_SIZE; addr += MEMORY_PAGE_SIZE) {
+      const byte_t *da = mem_a.page_data(addr / MEMORY_PAGE_SIZE);
+      const byte_t *db = mem_b.page_data(addr / MEMORY_PAGE_SIZE);
+      if (da == db)
+        continue; // Same copy-on-write page
+      size_t i = 0;
+      while (i < MEMORY_PAGE_SIZE && da[i] == db[i]) {
+        i++;
+      }
+      if (i < MEMORY_PAGE_SIZE) {
+        out << "memory[0x" << std::setw(4) << addr + i << "]: 0x"
+            << std::setw(2) << (int)da[i] << " != 0x" << std::setw(2)
+            << (int)db[i];
+        break;
+      }
+    }
+  }
+
+  diff = out.str();
+  return diff.empty();
+}
+
+bool run_differential(CPU &cpu, Memory &mem, CPU &ref, Memory &ref_mem) {
+  bool by_block =
+      cpu.get_engine() == ENGINE_BLOCK || cpu.get_engine() == ENGINE_JIT;
+
+  while (!cpu.is_halted()) {
+    word_t start_pc = cpu.get_pc();
+    if (by_block) {
+      cpu.step_block();
+    } else {
+      cpu.step();
+    }
+
+    // Bring the reference to the same instruction count
+    while (!ref.is_halted() &&
+           ref.get_instruction_count() < cpu.get_instruction_count()) {
+      ref.step();
+    }
+
+    std::string diff;
+    if (!compare_state(cpu, mem, ref, ref_mem, diff)) {
+      std::cerr << "Divergence from reference in step starting at PC=0x"
+                << std::hex << std::setw(4) << std::setfill('0') << start_pc
+                << std::dec << " (instruction " << cpu.get_instruction_count()
+                << "): " << diff << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,18 @@
+#ifndef DIFFTEST_H
+#define DIFFTEST_H
+
+#include "cpu.h"
+#include "memory.h"
+#include <string>
+
+// Compare the architectural state of two machines. Returns true if they
+// match; otherwise describes the first difference in diff.
+bool compare_state(const CPU &a, const Memory &mem_a, const CPU &b,
+                   const Memory &mem_b, std::string &diff);
+
+// Run cpu (any engine) in lockstep with ref (normally ENGINE_SWITCH),
+// comparing full state after every block or instruction of cpu. Stops at
+// HALT or the first divergence, which is reported on stderr.
+bool run_differential(CPU &cpu, Memory &mem, CPU &ref, Memory &ref_mem);
+
+#endif // DIFFTEST_H
@@ -0,0 +1,92 @@
+/*
+ * disasm.cpp
+ *
+ * Instruction disassembler shared by the -d trace and the offline trace
+ * decoder.
+ */
+
+#include "disasm.h"
+#include "../common/instructions.h"
+#include <iomanip>
+
+void disassemble(std::ostream &out, addr_t address, word_t instruction,
+                 word_t operand) {
+  byte_t opcode = GET_OPCODE(instruction);
+  byte_t rd = GET_RD(instruction);
+  byte_t rs = GET_RS(instruction);
+  byte_t rt = GET_RT(instruction);
+  byte_t imm4 = GET_IMM4(instruction);
+  byte_t imm7 = GET_IMM7(instruction);
+
+  out << "0x" << std::hex << std::setw(4) << std::setfill('0') << address
+      << ": " << std::setw(4) << std::setfill('0') << instruction << "  "
+      << get_opcode_name(opcode) << " ";
+
+  // Format operands based on instruction type
+  switch (opcode) {
+  case OP_NOP:
+    if (rd != rs) {
+      out << "R" << (int)rd << ", R" << (int)rs;
+    }
+    break;
+  case OP_MOVI:
+    out << "R" << (int)rd << ", " << std::dec << sign_extend_7bit(imm7);
+    break;
+  case OP_LOAD_IND:
+    out << "R" << (int)rd << ", [R" << (int)rs << "]";
+    break;
+  case OP_STORE_IND:
+    out << "R" << (int)rs << ", [R" << (int)rd << "]";
+    break;
+  case OP_LOAD_DIR:
+  case OP_STORE_DIR:
+  case OP_JMP:
+  case OP_JZ:
+  case OP_JNZ:
+  case OP_JC:
+  case OP_JNC:
+  case OP_JN:
+  case OP_CALL:
+    out << "0x" << std::hex << std::setw(4) << std::setfill('0') << operand;
+    break;
+  case OP_ADDI:
+  case OP_SUBI:
+  case OP_ANDI:
+  case OP_ORI:
+  case OP_SHLI:
+  case OP_SHRI:
+    out << "R" << (int)rd << ", R" << (int)rs << ", " << std::dec
+        << sign_extend_4bit(imm4);
+    break;
+  case OP_CMPI:
+    out << "R" << (int)rs << ", " << std::dec << sign_extend_4bit(imm4);
+    break;
+  case OP_INC:
+  case OP_DEC:
+  case OP_POP:
+    out << "R" << (int)rd;
+    break;
+  case OP_PUSH:
+    out << "R" << (int)rs;
+    break;
+  case OP_NOT:
+    out << "R" << (int)rd << ", R" << (int)rs;
+    break;
+  case OP_CMP:
+    out << "R" << (int)rs << ", R" << (int)rt;
+    break;
+  case OP_RET:
+  case OP_EI:
+  case OP_DI:
+  case OP_RETI:
+  case OP_WAIT:
+  case OP_HALT:
+    // No operands
+    break;
+  default:
+    // Three-operand format
+    out << "R" << (int)rd << ", R" << (int)rs << ", R" << (int)rt;
+    break;
+  }
+  out << std::dec;
+}
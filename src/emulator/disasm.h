@@ -0,0 +1,13 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "../common/types.h"
+#include <ostream>
+
+// Write "0xADDR: WORD  MNEMONIC operands" for one instruction. operand is
+// the trailing address word of LOAD/STORE direct, jumps and CALL, and is
+// ignored for other instructions.
+void disassemble(std::ostream &out, addr_t address, word_t instruction,
+                 word_t operand);
+
+#endif // DISASM_H
@@ -0,0 +1,60 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include "../common/types.h"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// What a logged input value answered
+enum InputKind : byte_t {
+  INPUT_DATA,   // Guest read of IO_CONSOLE_IN
+  INPUT_STATUS, // Guest read of IO_CONSOLE_STATUS
+  INPUT_POLL,   // The device's periodic check (INPUT_POLL_* bits)
+};
+
+// Value bits of an INPUT_POLL event
+const byte_t INPUT_POLL_RAISE = 0x01; // Input ready or ended: raise the IRQ
+const byte_t INPUT_POLL_ENDED = 0x02; // Input ended: stop polling
+
+// One answer from the host side of console input. count is the device
+// clock (the instruction count) when it was given; an instruction's reads
+// and the checks after it carry that instruction's count.
+struct InputEvent {
+  uint64_t count;
+  byte_t kind;
+  byte_t value;
+};
+
+// Every nondeterministic value the guest received, in order. Timer and
+// interrupt timing are functions of the instruction count and need no
+// log; console input arrives whenever the host delivers it.
+class InputLog {
+private:
+  std::vector<InputEvent> events; // Ordered by count
+
+public:
+  void add(uint64_t count, byte_t kind, byte_t value) {
+    InputEvent event;
+    event.count = count;
+    event.kind = kind;
+    event.value = value;
+    events.push_back(event);
+  }
+  void clear() { events.clear(); }
+
+  size_t size() const { return events.size(); }
+  const InputEvent &operator[](size_t i) const { return events[i]; }
+  std::vector<InputEvent> &data() { return events; }
+
+  // Index of the first event at or after count
+  size_t seek(uint64_t count) const {
+    return std::lower_bound(events.begin(), events.end(), count,
+                            [](const InputEvent &e, uint64_t c) {
+                              return e.count < c;
+                            }) -
+           events.begin();
+  }
+};
+
+#endif // INPUT_LOG_H
@@ -0,0 +1,72 @@
+/*
+ * interrupt.cpp
+ *
+ * Interrupt controller registers and delivery requests. Entering the
+ * handler is done by the CPU (CPU::enter_interrupt), which owns the stack
+ * and PC.
+ */
+
+#include "interrupt.h"
+
+InterruptController::InterruptController(const uint64_t &clock,
+                                         EventScheduler &scheduler)
+    : clock(clock), scheduler(scheduler) {
+  reset();
+}
+
+void InterruptController::reset() {
+  scheduler.cancel(this);
+  state.pending = 0;
+  state.mask = 0;
+  state.enabled = false;
+}
+
+void InterruptController::load(const InterruptState &saved) {
+  scheduler.cancel(this);
+  state = saved;
+  request_delivery();
+}
+
+// Make the CPU check for interrupts at its next event point
+void InterruptController::request_delivery() {
+  if (deliverable_line() >= 0) {
+    scheduler.cancel(this);
+    scheduler.schedule(clock, this);
+  }
+}
+
+void InterruptController::raise(int line) {
+  state.pending |= 1u << line;
+  request_delivery();
+}
+
+void InterruptController::set_enabled(bool enable) {
+  state.enabled = enable;
+  request_delivery();
+}
+
+int InterruptController::deliverable_line() const {
+  if (!state.enabled) {
+    return -1;
+  }
+  byte_t ready = state.pending & state.mask;
+  for (int line = 0; line < NUM_IRQ_LINES; line++) {
+    if (ready & (1u << line)) {
+      return line;
+    }
+  }
+  return -1;
+}
+
+byte_t InterruptController::read(addr_t address) {
+  return address == IO_INT_STATUS ? state.pending : state.mask;
+}
+
+void InterruptController::write(addr_t address, byte_t value) {
+  if (address == IO_INT_STATUS) {
+    state.pending &= ~value;
+  } else {
+    state.mask = value;
+    request_delivery();
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+#include "../common/types.h"
+#include "memory.h"
+#include "scheduler.h"
+#include <cstdint>
+
+// Interrupt lines, in priority order (lowest number first)
+const int IRQ_TIMER = 0;
+const int IRQ_CONSOLE_IN = 1;
+const int NUM_IRQ_LINES = 8;
+
+struct InterruptState {
+  byte_t pending; // One bit per line, set by raise()
+  byte_t mask;    // Lines allowed to interrupt
+  bool enabled;   // CPU interrupt-enable flag (EI/DI)
+};
+
+// Interrupt controller. Devices raise lines; a line that is pending and
+// unmasked while interrupts are enabled makes the CPU enter the handler
+// whose address is at IO_INT_VECTORS + 2 * line. Registers:
+//   IO_INT_MASK     unmasked lines
+//   IO_INT_STATUS   pending lines; writing 1 to a bit clears it
+// MASK comes first so that a word write to it leaves STATUS alone.
+// Whenever an interrupt becomes deliverable the controller schedules an
+// event for the current instruction count, so the CPU notices it at its
+// next event check without testing the controller on every branch.
+class InterruptController : public MemoryDevice, public EventHandler {
+private:
+  const uint64_t &clock;
+  EventScheduler &scheduler;
+  InterruptState state;
+
+  void request_delivery();
+
+public:
+  InterruptController(const uint64_t &clock, EventScheduler &scheduler);
+
+  void raise(int line);
+  void acknowledge(int line) { state.pending &= ~(1u << line); }
+  bool is_pending(int line) const { return (state.pending >> line) & 1; }
+  bool is_unmasked(int line) const { return (state.mask >> line) & 1; }
+  void set_enabled(bool enable);
+  bool is_enabled() const { return state.enabled; }
+
+  // Highest-priority line that can be delivered now, or -1
+  int deliverable_line() const;
+
+  byte_t read(addr_t address) override;
+  void write(addr_t address, byte_t value) override;
+  void on_event(uint64_t) override {} // Only wakes the CPU's event check
+
+  void reset();
+  InterruptState save() const { return state; }
+  void load(const InterruptState &saved);
+};
+
+#endif // INTERRUPT_H
@@ -0,0 +1,566 @@
+/*
+ * jit_x86_64.cpp
+ *
+ * x86-64 backend for hot basic blocks. Generated code keeps the CPU object
+ * in rbx, Memory's read page table in r12 and the Memory object in r13, and
+ * works on the guest registers, PC, SP and FLAGS in place. Guest flags are
+ * taken from the host flags of the matching 16-bit x86 operation, and are
+ * only materialized when a later instruction or a block exit can see them.
+ *
+ * Before every memory access the generated code stores the exact PC and
+ * instruction count the interpreter would have at that point, so Memory
+ * callbacks observe the same machine state.
+ */
+
+#include "jit_x86_64.h"
+#include "alu.h"
+#include "cpu.h"
+#include "memory.h"
+#include <cstring>
+
+#ifdef JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Host register numbers
+enum { EAX = 0, ECX = 1, EDX = 2, EBX = 3, ESI = 6, EDI = 7 };
+
+// x86 condition codes for jcc
+enum { CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5 };
+
+// Slow-path callbacks used by generated code
+static uint32_t jit_read_word(Memory *memory, uint32_t address) {
+  return memory->read_word((addr_t)address);
+}
+
+static void jit_write_word(Memory *memory, uint32_t address, uint32_t value) {
+  memory->write_word((addr_t)address, (word_t)value);
+}
+
+JitCompiler::JitCompiler(CPU &cpu) : code(nullptr), code_used(0) {
+  const char *base = (const char *)&cpu;
+  off_regs = (int32_t)((const char *)&cpu.registers[0] - base);
+  off_pc = (int32_t)((const char *)&cpu.pc - base);
+  off_sp = (int32_t)((const char *)&cpu.sp - base);
+  off_flags = (int32_t)((const char *)&cpu.flags - base);
+  off_halted = (int32_t)((const char *)&cpu.halted - base);
+  off_count = (int32_t)((const char *)&cpu.instruction_count - base);
+  off_write_pages = (int32_t)((const char *)cpu.memory.write_pages() -
+                              (const char *)&cpu.memory);
+
+#ifdef JIT_SUPPORTED
+  void *mem = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem != MAP_FAILED) {
+    code = (byte_t *)mem;
+  }
+#endif
+}
+
+JitCompiler::~JitCompiler() {
+#ifdef JIT_SUPPORTED
+  if (code != nullptr) {
+    munmap(code, CODE_SIZE);
+  }
+#endif
+}
+
+bool JitCompiler::available() {
+#ifdef JIT_SUPPORTED
+  return true;
+#else
+  return false;
+#endif
+}
+
+void JitCompiler::emit16(uint16_t v) {
+  emit8((uint8_t)v);
+  emit8((uint8_t)(v >> 8));
+}
+
+void JitCompiler::emit32(uint32_t v) {
+  emit16((uint16_t)v);
+  emit16((uint16_t)(v >> 16));
+}
+
+void JitCompiler::emit64(uint64_t v) {
+  emit32((uint32_t)v);
+  emit32((uint32_t)(v >> 32));
+}
+
+size_t JitCompiler::emit_jcc(uint8_t cc) {
+  emit8(0x0F);
+  emit8(0x80 | cc);
+  size_t slot = buf.size();
+  emit32(0);
+  return slot;
+}
+
+size_t JitCompiler::emit_jmp() {
+  emit8(0xE9);
+  size_t slot = buf.size();
+  emit32(0);
+  return slot;
+}
+
+void JitCompiler::patch(size_t slot) {
+  uint32_t rel = (uint32_t)(buf.size() - (slot + 4));
+  memcpy(&buf[slot], &rel, 4);
+}
+
+// movzx host32, word [rbx + reg]
+void JitCompiler::emit_load_reg(int host_reg, int guest_reg) {
+  emit8(0x0F);
+  emit8(0xB7);
+  emit8(0x80 | (host_reg << 3) | EBX);
+  emit32(off_regs + 2 * guest_reg);
+}
+
+// mov word [rbx + reg], ax
+void JitCompiler::emit_store_ax(int guest_reg) {
+  emit8(0x66);
+  emit8(0x89);
+  emit8(0x83);
+  emit32(off_regs + 2 * guest_reg);
+}
+
+// mov word [rbx + offset], imm16
+void JitCompiler::emit_store_imm(int32_t offset, word_t value) {
+  emit8(0x66);
+  emit8(0xC7);
+  emit8(0x83);
+  emit32(offset);
+  emit16(value);
+}
+
+// mov rax, fn; call rax
+void JitCompiler::emit_call(const void *fn) {
+  emit8(0x48);
+  emit8(0xB8);
+  emit64((uint64_t)(uintptr_t)fn);
+  emit8(0xFF);
+  emit8(0xD0);
+}
+
+// Pop the host flags saved by pushfq and store them as guest flags:
+// ZF(6) -> Z(0), CF(0) -> C(1), SF(7) -> N(2), OF(11) -> O(3)
+void JitCompiler::emit_capture_flags() {
+  static const uint8_t seq[] = {
+      0x5A,             // pop rdx
+      0x89, 0xD1,       // mov ecx, edx
+      0x83, 0xE1, 0x01, // and ecx, 1
+      0x01, 0xC9,       // add ecx, ecx
+      0x89, 0xD6,       // mov esi, edx
+      0xC1, 0xEE, 0x06, // shr esi, 6
+      0x83, 0xE6, 0x01, // and esi, 1
+      0x09, 0xF1,       // or ecx, esi
+      0x89, 0xD6,       // mov esi, edx
+      0xC1, 0xEE, 0x05, // shr esi, 5
+      0x83, 0xE6, 0x04, // and esi, 4
+      0x09, 0xF1,       // or ecx, esi
+      0xC1, 0xEA, 0x08, // shr edx, 8
+      0x83, 0xE2, 0x08, // and edx, 8
+      0x09, 0xD1,       // or ecx, edx
+  };
+  buf.insert(buf.end(), seq, seq + sizeof(seq));
+  // mov word [rbx + flags], cx
+  emit8(0x66);
+  emit8(0x89);
+  emit8(0x8B);
+  emit32(off_flags);
+}
+
+// add qword [rbx + instruction_count], n
+void JitCompiler::emit_add_count(uint32_t n) {
+  if (n == 0)
+    return;
+  emit8(0x48);
+  emit8(0x81);
+  emit8(0x83);
+  emit32(off_count);
+  emit32(n);
+}
+
+void JitCompiler::emit_epilogue() {
+  emit8(0x41); // pop r13
+  emit8(0x5D);
+  emit8(0x41); // pop r12
+  emit8(0x5C);
+  emit8(0x5B); // pop rbx
+  emit8(0xC3); // ret
+}
+
+// Jump to a slow path if the word at ecx crosses a page; otherwise leave
+// the page number in edx. Returns the rel32 slot to patch.
+size_t JitCompiler::emit_page_check() {
+  static const uint8_t seq[] = {
+      0x80, 0xF9, 0xFF, // cmp cl, 0xFF
+  };
+  buf.insert(buf.end(), seq, seq + sizeof(seq));
+  size_t slot = emit_jcc(CC_E);
+  static const uint8_t page[] = {
+      0x89, 0xCA,       // mov edx, ecx
+      0xC1, 0xEA, 0x08, // shr edx, 8
+  };
+  buf.insert(buf.end(), page, page + sizeof(page));
+  return slot;
+}
+
+// eax = read_word(ecx). Pages in Memory's read table are read inline; the
+// I/O page (a null entry) and page-crossing words go through Memory.
+void JitCompiler::emit_read_word() {
+  size_t to_slow1 = emit_page_check();
+
+  static const uint8_t fast[] = {
+      0x49, 0x8B, 0x14, 0xD4, // mov rdx, [r12 + rdx*8]
+      0x48, 0x85, 0xD2,       // test rdx, rdx
+  };
+  buf.insert(buf.end(), fast, fast + sizeof(fast));
+  size_t to_slow2 = emit_jcc(CC_E);
+  static const uint8_t load[] = {
+      0x0F, 0xB6, 0xF1,       // movzx esi, cl
+      0x0F, 0xB7, 0x04, 0x32, // movzx eax, word [rdx + rsi]
+  };
+  buf.insert(buf.end(), load, load + sizeof(load));
+  size_t to_done = emit_jmp();
+
+  patch(to_slow1);
+  patch(to_slow2);
+  static const uint8_t slow[] = {0x4C, 0x89, 0xEF,  // mov rdi, r13
+                                 0x89, 0xCE};       // mov esi, ecx
+  buf.insert(buf.end(), slow, slow + sizeof(slow));
+  emit_call((const void *)&jit_read_word);
+
+  patch(to_done);
+}
+
+// write_word(ecx, ax). Pages in Memory's write table (plain RAM this
+// Memory owns outright) are written inline; the program region, the I/O
+// page, shared copy-on-write pages and page-crossing words go through
+// Memory. With check_valid, leave through the invalidation exit if the
+// store overwrote the running block.
+void JitCompiler::emit_write_word(const Block &block, bool check_valid) {
+  size_t to_slow1 = emit_page_check();
+
+  // mov rdx, [r13 + rdx*8 + write table]
+  static const uint8_t table[] = {0x49, 0x8B, 0x94, 0xD5};
+  buf.insert(buf.end(), table, table + sizeof(table));
+  emit32(off_write_pages);
+  static const uint8_t test[] = {0x48, 0x85, 0xD2}; // test rdx, rdx
+  buf.insert(buf.end(), test, test + sizeof(test));
+  size_t to_slow2 = emit_jcc(CC_E);
+
+  static const uint8_t fast[] = {
+      0x0F, 0xB6, 0xF1,       // movzx esi, cl
+      0x66, 0x89, 0x04, 0x32, // mov word [rdx + rsi], ax
+  };
+  buf.insert(buf.end(), fast, fast + sizeof(fast));
+  size_t to_done = emit_jmp();
+
+  patch(to_slow1);
+  patch(to_slow2);
+  static const uint8_t slow[] = {0x4C, 0x89, 0xEF, // mov rdi, r13
+                                 0x89, 0xCE,       // mov esi, ecx
+                                 0x89, 0xC2};      // mov edx, eax
+  buf.insert(buf.end(), slow, slow + sizeof(slow));
+  emit_call((const void *)&jit_write_word);
+  if (check_valid) {
+    emit8(0x48); // mov rax, &block.valid
+    emit8(0xB8);
+    emit64((uint64_t)(uintptr_t)&block.valid);
+    emit8(0x80); // cmp byte [rax], 0
+    emit8(0x38);
+    emit8(0x00);
+    invalid_exits.push_back(emit_jcc(CC_E));
+  }
+
+  patch(to_done);
+}
+
+// Does instruction i produce flags that something can observe? Flags are
+// live at block exit and at memory accesses (Memory callbacks and
+// invalidation exits can see machine state); Jcc reads them and every ALU
+// instruction overwrites them.
+static std::vector<bool> live_flags(const std::vector<DecodedInstr> &instrs) {
+  std::vector<bool> live(instrs.size(), true);
+  bool needed = true;
+  for (size_t i = instrs.size(); i-- > 0;) {
+    byte_t op = instrs[i].opcode;
+    if ((op >= OP_ADD && op <= OP_NOT) || (op >= OP_SHL && op <= OP_CMPI)) {
+      live[i] = needed;
+      needed = false;
+    } else if (op != OP_NOP && op != OP_MOVI) {
+      needed = true;
+    }
+  }
+  return live;
+}
+
+JitCode JitCompiler::compile(const Block &block) {
+  if (code == nullptr)
+    return nullptr;
+
+  const std::vector<DecodedInstr> &instrs = block.instrs;
+  std::vector<bool> need_flags = live_flags(instrs);
+  size_t n = instrs.size();
+  size_t committed = 0; // Instructions already added to instruction_count
+
+  buf.clear();
+  invalid_exits.clear();
+
+  // Prologue: push rbx, r12, r13 (leaves rsp 16-byte aligned for calls);
+  // rbx = cpu, r12 = read page table, r13 = memory
+  static const uint8_t prologue[] = {0x53, 0x41, 0x54, 0x41, 0x55,
+                                     0x48, 0x89, 0xFB, 0x49, 0x89,
+                                     0xF4, 0x49, 0x89, 0xD5};
+  buf.insert(buf.end(), prologue, prologue + sizeof(prologue));
+
+// Record the interpreter's PC and count ahead of a memory access
+#define SYNC_STATE(pc_value)                                                   \
+  do {                                                                         \
+    emit_add_count((uint32_t)(i - committed));                                 \
+    committed = i;                                                             \
+    emit_store_imm(off_pc, (word_t)(pc_value));                                \
+  } while (0)
+
+  addr_t addr = block.start;
+  bool terminated = false;
+  for (size_t i = 0; i < n; i++) {
+    const DecodedInstr &in = instrs[i];
+    addr_t next = addr + (has_address_word(in.opcode) ? 4 : 2);
+    bool last = (i + 1 == n);
+
+    // Register-form operands beyond R7 are not well defined; leave them
+    // to the interpreter
+    if (in.rt >= NUM_REGISTERS &&
+        (in.opcode == OP_ADD || in.opcode == OP_SUB || in.opcode == OP_MUL ||
+         in.opcode == OP_DIV || in.opcode == OP_AND || in.opcode == OP_OR ||
+         in.opcode == OP_XOR || in.opcode == OP_SHL || in.opcode == OP_SHR ||
+         in.opcode == OP_CMP)) {
+      return nullptr;
+    }
+
+    uint8_t alu_rr = 0;  // 16-bit "op ax, cx" opcode byte
+    uint8_t alu_imm = 0; // 16-bit "op ax, imm16" opcode byte
+    const void *alu_fn = nullptr;
+
+    switch (in.opcode) {
+    case OP_NOP:
+      if (in.rd != in.rs) {
+        emit_load_reg(EAX, in.rs);
+        emit_store_ax(in.rd);
+      }
+      break;
+
+    case OP_MOVI:
+      emit_store_imm(off_regs + 2 * in.rd, in.imm);
+      break;
+
+    case OP_ADD: alu_rr = 0x01; break;
+    case OP_SUB: alu_rr = 0x29; break;
+    case OP_AND: alu_rr = 0x21; break;
+    case OP_OR:  alu_rr = 0x09; break;
+    case OP_XOR: alu_rr = 0x31; break;
+    case OP_CMP: alu_rr = 0x39; break;
+    case OP_ADDI: alu_imm = 0x05; break;
+    case OP_SUBI: alu_imm = 0x2D; break;
+    case OP_ANDI: alu_imm = 0x25; break;
+    case OP_ORI:  alu_imm = 0x0D; break;
+    case OP_CMPI: alu_imm = 0x3D; break;
+    case OP_INC:  alu_imm = 0x05; break;
+    case OP_DEC:  alu_imm = 0x2D; break;
+
+    case OP_NOT:
+      emit_load_reg(EAX, in.rs);
+      emit8(0x66); emit8(0xF7); emit8(0xD0); // not ax
+      emit8(0x66); emit8(0x85); emit8(0xC0); // test ax, ax
+      if (need_flags[i])
+        emit8(0x9C); // pushfq
+      emit_store_ax(in.rd);
+      if (need_flags[i])
+        emit_capture_flags();
+      break;
+
+    case OP_MUL:  alu_fn = (const void *)&ALU::mul; break;
+    case OP_DIV:  alu_fn = (const void *)&ALU::div; break;
+    case OP_SHL:
+    case OP_SHLI: alu_fn = (const void *)&ALU::shl; break;
+    case OP_SHR:
+    case OP_SHRI: alu_fn = (const void *)&ALU::shr; break;
+
+    case OP_LOAD_IND:
+      SYNC_STATE(next);
+      emit_load_reg(ECX, in.rs);
+      emit_read_word();
+      emit_store_ax(in.rd);
+      break;
+
+    case OP_LOAD_DIR:
+      SYNC_STATE(next);
+      emit8(0xB9); // mov ecx, target
+      emit32(in.target);
+      emit_read_word();
+      emit_store_ax(in.rd);
+      break;
+
+    case OP_STORE_IND:
+      SYNC_STATE(next);
+      emit_load_reg(ECX, in.rd);
+      emit_load_reg(EAX, in.rs);
+      emit_write_word(block, !last);
+      break;
+
+    case OP_STORE_DIR:
+      SYNC_STATE(next);
+      emit8(0xB9); // mov ecx, target
+      emit32(in.target);
+      emit_load_reg(EAX, in.rs);
+      emit_write_word(block, !last);
+      break;
+
+    case OP_PUSH:
+    case OP_CALL: {
+      SYNC_STATE(next);
+      // sp -= 2
+      emit8(0x0F); emit8(0xB7); emit8(0x8B); emit32(off_sp); // movzx ecx, [sp]
+      emit8(0x83); emit8(0xE9); emit8(0x02);                 // sub ecx, 2
+      emit8(0x0F); emit8(0xB7); emit8(0xC9);                 // movzx ecx, cx
+      emit8(0x66); emit8(0x89); emit8(0x8B); emit32(off_sp); // mov [sp], cx
+      if (in.opcode == OP_PUSH) {
+        emit_load_reg(EAX, in.rs);
+        emit_write_word(block, !last);
+      } else {
+        emit8(0xB8); // mov eax, return address
+        emit32(next);
+        emit_write_word(block, false);
+        emit_add_count((uint32_t)(n - committed));
+        emit_store_imm(off_pc, in.target);
+        emit_epilogue();
+        terminated = true;
+      }
+      break;
+    }
+
+    case OP_POP:
+    case OP_RET:
+      SYNC_STATE(next);
+      emit8(0x0F); emit8(0xB7); emit8(0x8B); emit32(off_sp); // movzx ecx, [sp]
+      emit_read_word();
+      if (in.opcode == OP_POP) {
+        emit_store_ax(in.rd);
+      } else {
+        emit8(0x66); emit8(0x89); emit8(0x83); emit32(off_pc); // mov [pc], ax
+      }
+      // sp += 2
+      emit8(0x0F); emit8(0xB7); emit8(0x8B); emit32(off_sp); // movzx ecx, [sp]
+      emit8(0x83); emit8(0xC1); emit8(0x02);                 // add ecx, 2
+      emit8(0x66); emit8(0x89); emit8(0x8B); emit32(off_sp); // mov [sp], cx
+      if (in.opcode == OP_RET) {
+        emit_add_count((uint32_t)(n - committed));
+        emit_epilogue();
+        terminated = true;
+      }
+      break;
+
+    case OP_JMP:
+      emit_add_count((uint32_t)(n - committed));
+      emit_store_imm(off_pc, in.target);
+      emit_epilogue();
+      terminated = true;
+      break;
+
+    case OP_JZ:
+    case OP_JNZ:
+    case OP_JC:
+    case OP_JNC:
+    case OP_JN: {
+      word_t mask = (in.opcode == OP_JZ || in.opcode == OP_JNZ) ? FLAG_ZERO
+                    : (in.opcode == OP_JN)                      ? FLAG_NEGATIVE
+                                                                : FLAG_CARRY;
+      bool when_set = in.opcode == OP_JZ || in.opcode == OP_JC ||
+                      in.opcode == OP_JN;
+      emit_add_count((uint32_t)(n - committed));
+      emit8(0x66); emit8(0xF7); emit8(0x83); emit32(off_flags); // test [flags]
+      emit16(mask);
+      size_t not_taken = emit_jcc(when_set ? CC_E : CC_NE);
+      emit_store_imm(off_pc, in.target);
+      emit_epilogue();
+      patch(not_taken);
+      emit_store_imm(off_pc, next);
+      emit_epilogue();
+      terminated = true;
+      break;
+    }
+
+    case OP_HALT:
+      emit_add_count((uint32_t)(n - committed));
+      emit8(0xC6); emit8(0x83); emit32(off_halted); emit8(0x01); // halted = 1
+      emit_store_imm(off_pc, next);
+      emit_epilogue();
+      terminated = true;
+      break;
+
+    default:
+      // Opcodes the JIT does not compile (invalid, EI/DI/RETI/WAIT) end
+      // the block and fall back to the interpreter
+      return nullptr;
+    }
+
+    if (alu_rr != 0 || alu_imm != 0) {
+      bool unary = in.opcode == OP_INC || in.opcode == OP_DEC;
+      emit_load_reg(EAX, unary ? in.rd : in.rs);
+      if (alu_rr != 0) {
+        emit_load_reg(ECX, in.rt);
+        emit8(0x66); emit8(alu_rr); emit8(0xC8); // op ax, cx
+      } else {
+        emit8(0x66); emit8(alu_imm); // op ax, imm16
+        emit16(unary ? 1 : in.imm);
+      }
+      if (need_flags[i])
+        emit8(0x9C); // pushfq
+      if (in.opcode != OP_CMP && in.opcode != OP_CMPI)
+        emit_store_ax(in.rd);
+      if (need_flags[i])
+        emit_capture_flags();
+    }
+
+    if (alu_fn != nullptr) {
+      // word_t fn(word_t a, word_t b, word_t &flags)
+      emit_load_reg(EDI, in.rs);
+      if (in.opcode == OP_SHLI || in.opcode == OP_SHRI) {
+        emit8(0xBE); // mov esi, imm
+        emit32(in.imm);
+      } else {
+        emit_load_reg(ESI, in.rt);
+      }
+      emit8(0x48); emit8(0x8D); emit8(0x93); emit32(off_flags); // lea rdx
+      emit_call(alu_fn);
+      emit_store_ax(in.rd);
+    }
+
+    addr = next;
+  }
+#undef SYNC_STATE
+
+  if (!terminated) {
+    // Fell off the end (length cap or I/O store): continue after the block
+    emit_add_count((uint32_t)(n - committed));
+    emit_store_imm(off_pc, addr);
+    emit_epilogue();
+  }
+
+  // A store invalidated the running block; PC is already past the store
+  if (!invalid_exits.empty()) {
+    for (size_t i = 0; i < invalid_exits.size(); i++)
+      patch(invalid_exits[i]);
+    emit_add_count(1);
+    emit_epilogue();
+  }
+
+  if (code_used + buf.size() > CODE_SIZE)
+    return nullptr;
+  byte_t *entry = code + code_used;
+  memcpy(entry, buf.data(), buf.size());
+  code_used += (buf.size() + 15) & ~(size_t)15;
+  return (JitCode)(void *)entry;
+}
@@ -0,0 +1,76 @@
+#ifndef JIT_X86_64_H
+#define JIT_X86_64_H
+
+#include "../common/types.h"
+#include "block_cache.h"
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#endif
+
+class CPU;
+class Memory;
+
+// Native entry point of a compiled block. Guest state lives in the CPU
+// object, which the generated code addresses through a pinned base
+// register; pages is Memory's read page table for the inline load path.
+typedef void (*JitCode)(CPU *cpu, const byte_t *const *pages,
+                        Memory *memory);
+
+// Dynamic recompiler from guest basic blocks to x86-64. Register, flag and
+// RAM operations are emitted inline; MUL/DIV/shifts call the ALU, and
+// accesses that may touch the I/O page or program region call back into
+// Memory. Blocks containing anything it cannot translate exactly are left
+// to the interpreter.
+class JitCompiler {
+private:
+  static const size_t CODE_SIZE = 4 * 1024 * 1024;
+
+  byte_t *code;    // Executable region (bump allocated, never reused)
+  size_t code_used;
+
+  // Byte offsets of CPU fields from the CPU object
+  int32_t off_regs;
+  int32_t off_pc;
+  int32_t off_sp;
+  int32_t off_flags;
+  int32_t off_halted;
+  int32_t off_count;
+  int32_t off_write_pages; // Memory's write page table from the Memory
+
+  // Code generation state for the block being compiled
+  std::vector<uint8_t> buf;
+  std::vector<size_t> invalid_exits; // rel32 slots jumping to the exit stub
+
+  void emit8(uint8_t b) { buf.push_back(b); }
+  void emit16(uint16_t v);
+  void emit32(uint32_t v);
+  void emit64(uint64_t v);
+  size_t emit_jcc(uint8_t cc);  // Returns the rel32 slot to patch
+  size_t emit_jmp();
+  void patch(size_t slot);      // Point a rel32 slot at the current end
+
+  void emit_load_reg(int host_reg, int guest_reg);
+  void emit_store_ax(int guest_reg);
+  void emit_store_imm(int32_t offset, word_t value);
+  void emit_call(const void *fn);
+  void emit_capture_flags();
+  void emit_add_count(uint32_t n);
+  void emit_epilogue();
+  size_t emit_page_check();
+  void emit_read_word();  // eax = read_word(ecx)
+  void emit_write_word(const Block &block, bool check_valid); // ecx <- ax
+
+public:
+  JitCompiler(CPU &cpu);
+  ~JitCompiler();
+
+  static bool available();
+
+  // Compile a block; returns nullptr if the block cannot be translated
+  JitCode compile(const Block &block);
+};
+
+#endif // JIT_X86_64_H
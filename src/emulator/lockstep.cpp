@@ -0,0 +1,558 @@
+/*
+ * lockstep.cpp
+ *
+ * SIMD lockstep execution. MOV/MOVI and the add, subtract, logic, compare
+ * and immediate-shift opcodes are computed for all lanes at once on 16-bit
+ * vector lanes, with flags derived the same way ALU does. Lanes that are
+ * not at the group's PC keep their old values through a blend. Uses AVX2
+ * when the compiler targets it (e.g. -mavx2), otherwise SSE2, otherwise
+ * plain scalar code.
+ */
+
+#include "lockstep.h"
+#include "alu.h"
+#include "decode_cache.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+#if defined(__AVX2__)
+typedef __m256i Vec;
+const int VEC_WORDS = 16;
+
+inline Vec vload(const word_t *p) {
+  return _mm256_loadu_si256((const __m256i *)p);
+}
+inline void vstore(word_t *p, Vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+inline Vec vset(word_t x) { return _mm256_set1_epi16((short)x); }
+inline Vec vadd(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+inline Vec vsub(Vec a, Vec b) { return _mm256_sub_epi16(a, b); }
+inline Vec vand(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline Vec vor(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline Vec vxor(Vec a, Vec b) { return _mm256_xor_si256(a, b); }
+inline Vec vandnot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+inline Vec vcmpeq(Vec a, Vec b) { return _mm256_cmpeq_epi16(a, b); }
+inline Vec vadds_u(Vec a, Vec b) { return _mm256_adds_epu16(a, b); }
+inline Vec vsubs_u(Vec a, Vec b) { return _mm256_subs_epu16(a, b); }
+inline Vec vsign(Vec a) { return _mm256_srai_epi16(a, 15); }
+inline Vec vshl(Vec a, int n) {
+  return _mm256_sll_epi16(a, _mm_cvtsi32_si128(n));
+}
+inline Vec vshr(Vec a, int n) {
+  return _mm256_srl_epi16(a, _mm_cvtsi32_si128(n));
+}
+#elif defined(__SSE2__)
+typedef __m128i Vec;
+const int VEC_WORDS = 8;
+
+inline Vec vload(const word_t *p) {
+  return _mm_loadu_si128((const __m128i *)p);
+}
+inline void vstore(word_t *p, Vec v) { _mm_storeu_si128((__m128i *)p, v); }
+inline Vec vset(word_t x) { return _mm_set1_epi16((short)x); }
+inline Vec vadd(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+inline Vec vsub(Vec a, Vec b) { return _mm_sub_epi16(a, b); }
+inline Vec vand(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline Vec vor(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec vxor(Vec a, Vec b) { return _mm_xor_si128(a, b); }
+inline Vec vandnot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+inline Vec vcmpeq(Vec a, Vec b) { return _mm_cmpeq_epi16(a, b); }
+inline Vec vadds_u(Vec a, Vec b) { return _mm_adds_epu16(a, b); }
+inline Vec vsubs_u(Vec a, Vec b) { return _mm_subs_epu16(a, b); }
+inline Vec vsign(Vec a) { return _mm_srai_epi16(a, 15); }
+inline Vec vshl(Vec a, int n) {
+  return _mm_sll_epi16(a, _mm_cvtsi32_si128(n));
+}
+inline Vec vshr(Vec a, int n) {
+  return _mm_srl_epi16(a, _mm_cvtsi32_si128(n));
+}
+#else
+// Scalar stand-in with the same semantics as the 16-bit SIMD operations
+typedef word_t Vec;
+const int VEC_WORDS = 1;
+
+inline Vec vload(const word_t *p) { return *p; }
+inline void vstore(word_t *p, Vec v) { *p = v; }
+inline Vec vset(word_t x) { return x; }
+inline Vec vadd(Vec a, Vec b) { return (word_t)(a + b); }
+inline Vec vsub(Vec a, Vec b) { return (word_t)(a - b); }
+inline Vec vand(Vec a, Vec b) { return a & b; }
+inline Vec vor(Vec a, Vec b) { return a | b; }
+inline Vec vxor(Vec a, Vec b) { return a ^ b; }
+inline Vec vandnot(Vec a, Vec b) { return (word_t)(~a & b); }
+inline Vec vcmpeq(Vec a, Vec b) { return a == b ? 0xFFFF : 0; }
+inline Vec vadds_u(Vec a, Vec b) {
+  return a + b > 0xFFFF ? 0xFFFF : (word_t)(a + b);
+}
+inline Vec vsubs_u(Vec a, Vec b) { return a > b ? (word_t)(a - b) : 0; }
+inline Vec vsign(Vec a) { return (a & 0x8000) ? 0xFFFF : 0; }
+inline Vec vshl(Vec a, int n) { return (word_t)(a << n); }
+inline Vec vshr(Vec a, int n) { return (word_t)(a >> n); }
+#endif
+
+// Z and N for a result, as ALU::set_zero_flag/set_negative_flag
+inline Vec zn_flags(Vec r) {
+  return vor(vand(vcmpeq(r, vset(0)), vset(FLAG_ZERO)),
+             vand(vsign(r), vset(FLAG_NEGATIVE)));
+}
+
+// Flags of a + b = r, as ALU::add
+inline Vec add_flags(Vec a, Vec b, Vec r) {
+  Vec carry = vandnot(vcmpeq(vadds_u(a, b), r), vset(FLAG_CARRY));
+  Vec overflow =
+      vand(vsign(vand(vxor(a, r), vxor(b, r))), vset(FLAG_OVERFLOW));
+  return vor(zn_flags(r), vor(carry, overflow));
+}
+
+// Flags of a - b = r, as ALU::sub
+inline Vec sub_flags(Vec a, Vec b, Vec r) {
+  Vec carry = vandnot(vcmpeq(vsubs_u(b, a), vset(0)), vset(FLAG_CARRY));
+  Vec overflow =
+      vand(vsign(vand(vxor(a, b), vxor(a, r))), vset(FLAG_OVERFLOW));
+  return vor(zn_flags(r), vor(carry, overflow));
+}
+
+// Keep old where the lane mask is clear
+inline Vec blend(Vec mask, Vec value, Vec old) {
+  return vor(vand(mask, value), vandnot(mask, old));
+}
+
+} // namespace
+
+LockstepEngine::LockstepEngine(int lanes, const std::vector<byte_t> &image)
+    : num_lanes(lanes), halted_mask(0), loaded(true), vector_steps(0),
+      scalar_steps(0) {
+  if (num_lanes < 1) {
+    num_lanes = 1;
+  }
+  if (num_lanes > MAX_LANES) {
+    num_lanes = MAX_LANES;
+  }
+  live_mask = num_lanes == 32 ? 0xFFFFFFFFu : (1u << num_lanes) - 1;
+
+  for (int lane = 0; lane < MAX_LANES; lane++) {
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+      regs[r][lane] = 0;
+    }
+    flags[lane] = 0;
+    pc[lane] = PROGRAM_START;
+    sp[lane] = STACK_END;
+    count[lane] = 0;
+    budget[lane] = 0;
+  }
+
+  for (int lane = 0; lane < num_lanes; lane++) {
+    memories.push_back(std::unique_ptr<Memory>(new Memory()));
+    cpus.push_back(std::unique_ptr<CPU>(new CPU(*memories[lane])));
+    cpus[lane]->set_engine(ENGINE_SWITCH);
+    if (!memories[lane]->load_image(image.data(), image.size())) {
+      loaded = false;
+    }
+    memories[lane]->add_code_listener(&code_written);
+  }
+  if (!loaded) {
+    live_mask = 0;
+  }
+}
+
+LockstepEngine::~LockstepEngine() {
+  for (int lane = 0; lane < num_lanes; lane++) {
+    memories[lane]->remove_code_listener(&code_written);
+  }
+  // CPUs unregister from their Memory, so they go first
+  cpus.clear();
+}
+
+void LockstepEngine::set_register(int lane, int reg, word_t value) {
+  if (lane >= 0 && lane < num_lanes && reg >= 0 && reg < NUM_REGISTERS) {
+    regs[reg][lane] = value;
+  }
+}
+
+word_t LockstepEngine::get_register(int lane, int reg) const {
+  if (lane >= 0 && lane < num_lanes && reg >= 0 && reg < NUM_REGISTERS) {
+    return regs[reg][lane];
+  }
+  return 0;
+}
+
+// Lanes that execute next: the live lanes at the lowest PC, further
+// narrowed to lanes holding the same instruction once code may differ
+uint32_t LockstepEngine::select_lanes(int &leader) const {
+  leader = -1;
+  uint32_t mask = 0;
+  for (int lane = 0; lane < num_lanes; lane++) {
+    if (!((live_mask >> lane) & 1))
+      continue;
+    if (leader < 0 || pc[lane] < pc[leader]) {
+      leader = lane;
+      mask = 1u << lane;
+    } else if (pc[lane] == pc[leader]) {
+      mask |= 1u << lane;
+    }
+  }
+
+  if (code_written.written) {
+    word_t group_pc = pc[leader];
+    const Memory &lead = *memories[leader];
+    word_t word = lead.read_word(group_pc);
+    bool addr_word = has_address_word(GET_OPCODE(word));
+    word_t target = addr_word ? lead.read_word(group_pc + 2) : 0;
+    for (int lane = 0; lane < num_lanes; lane++) {
+      if (!((mask >> lane) & 1))
+        continue;
+      const Memory &m = *memories[lane];
+      if (m.read_word(group_pc) != word ||
+          (addr_word && m.read_word(group_pc + 2) != target)) {
+        mask &= ~(1u << lane);
+      }
+    }
+  }
+  return mask;
+}
+
+// Run a register-only instruction on every lane in mask with SIMD
+// operations. Returns false if the opcode has no vector form.
+bool LockstepEngine::vector_alu(word_t instruction, uint32_t mask) {
+  byte_t opcode = GET_OPCODE(instruction);
+  byte_t rd = GET_RD(instruction);
+  byte_t rs = GET_RS(instruction);
+  byte_t rt = GET_RT(instruction);
+  byte_t imm4 = GET_IMM4(instruction);
+
+  const word_t *src_b = nullptr; // Register operand, else imm_b
+  word_t imm_b = 0;
+  bool writes_rd = true;
+  bool writes_flags = true;
+
+  switch (opcode) {
+  case OP_NOP:
+    if (rd == rs)
+      return true;
+    writes_flags = false;
+    break;
+  case OP_MOVI:
+    imm_b = (word_t)sign_extend_7bit(GET_IMM7(instruction));
+    writes_flags = false;
+    break;
+  case OP_ADD:
+  case OP_SUB:
+  case OP_AND:
+  case OP_OR:
+  case OP_XOR:
+    if (rt >= NUM_REGISTERS)
+      return false;
+    src_b = regs[rt];
+    break;
+  case OP_CMP:
+    if (rt >= NUM_REGISTERS)
+      return false;
+    src_b = regs[rt];
+    writes_rd = false;
+    break;
+  case OP_ADDI:
+  case OP_SUBI:
+    imm_b = (word_t)sign_extend_4bit(imm4);
+    break;
+  case OP_CMPI:
+    imm_b = (word_t)sign_extend_4bit(imm4);
+    writes_rd = false;
+    break;
+  case OP_ANDI:
+  case OP_ORI:
+  case OP_SHLI:
+  case OP_SHRI:
+    imm_b = imm4;
+    break;
+  case OP_INC:
+  case OP_DEC:
+    rs = rd;
+    imm_b = 1;
+    break;
+  case OP_NOT:
+    break;
+  default:
+    return false;
+  }
+
+  // Lane mask as 16-bit words. Padding lanes are never read, so when every
+  // real lane takes part the blend can be skipped.
+  uint32_t all = num_lanes == 32 ? 0xFFFFFFFFu : (1u << num_lanes) - 1;
+  bool full = mask == all;
+  word_t lane_mask[MAX_LANES];
+  if (!full) {
+    for (int lane = 0; lane < MAX_LANES; lane++) {
+      lane_mask[lane] = ((mask >> lane) & 1) ? 0xFFFF : 0;
+    }
+  }
+
+  for (int base = 0; base < num_lanes; base += VEC_WORDS) {
+    Vec a = vload(regs[rs] + base);
+    Vec b = src_b ? vload(src_b + base) : vset(imm_b);
+    Vec r;
+    Vec f = vset(0);
+
+    switch (opcode) {
+    case OP_NOP:
+      r = a;
+      break;
+    case OP_MOVI:
+      r = b;
+      break;
+    case OP_ADD:
+    case OP_ADDI:
+    case OP_INC:
+      r = vadd(a, b);
+      f = add_flags(a, b, r);
+      break;
+    case OP_SUB:
+    case OP_SUBI:
+    case OP_DEC:
+    case OP_CMP:
+    case OP_CMPI:
+      r = vsub(a, b);
+      f = sub_flags(a, b, r);
+      break;
+    case OP_AND:
+    case OP_ANDI:
+      r = vand(a, b);
+      f = zn_flags(r);
+      break;
+    case OP_OR:
+    case OP_ORI:
+      r = vor(a, b);
+      f = zn_flags(r);
+      break;
+    case OP_XOR:
+      r = vxor(a, b);
+      f = zn_flags(r);
+      break;
+    case OP_NOT:
+      r = vxor(a, vset(0xFFFF));
+      f = zn_flags(r);
+      break;
+    case OP_SHLI:
+      r = vshl(a, imm4);
+      f = zn_flags(r);
+      if (imm4 > 0) {
+        // Last bit shifted out is bit 16 - imm4; move it to FLAG_CARRY
+        f = vor(f, vand(vshr(a, 15 - imm4), vset(FLAG_CARRY)));
+      }
+      break;
+    default: // OP_SHRI
+      r = vshr(a, imm4);
+      f = zn_flags(r);
+      if (imm4 > 0) {
+        // Last bit shifted out is bit imm4 - 1
+        f = vor(f, vshl(vand(vshr(a, imm4 - 1), vset(1)), 1));
+      }
+      break;
+    }
+
+    if (!full) {
+      Vec m = vload(lane_mask + base);
+      r = blend(m, r, vload(regs[rd] + base));
+      f = blend(m, f, vload(flags + base));
+    }
+    if (writes_rd) {
+      vstore(regs[rd] + base, r);
+    }
+    if (writes_flags) {
+      vstore(flags + base, f);
+    }
+  }
+  return true;
+}
+
+// Register-only opcodes without a vector form, computed lane by lane
+void LockstepEngine::lane_alu(word_t instruction, uint32_t mask) {
+  byte_t opcode = GET_OPCODE(instruction);
+  byte_t rd = GET_RD(instruction);
+  byte_t rs = GET_RS(instruction);
+  byte_t rt = GET_RT(instruction);
+
+  ALU::FlagOp op = ALU::FLAGS_MUL;
+  if (opcode == OP_DIV)
+    op = ALU::FLAGS_DIV;
+  else if (opcode == OP_SHL)
+    op = ALU::FLAGS_SHL;
+  else if (opcode == OP_SHR)
+    op = ALU::FLAGS_SHR;
+
+  for (int lane = 0; lane < num_lanes; lane++) {
+    if ((mask >> lane) & 1) {
+      regs[rd][lane] =
+          ALU::apply(op, regs[rs][lane], regs[rt][lane], flags[lane]);
+    }
+  }
+}
+
+void LockstepEngine::load_lane(int lane) {
+  CPU &cpu = *cpus[lane];
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    cpu.registers[r] = regs[r][lane];
+  }
+  cpu.pc = pc[lane];
+  cpu.sp = sp[lane];
+  cpu.flags = flags[lane];
+  cpu.instruction_count = count[lane]; // Clock for the lane's devices
+}
+
+void LockstepEngine::store_lane(int lane) {
+  CPU &cpu = *cpus[lane];
+  for (int r = 0; r < NUM_REGISTERS; r++) {
+    regs[r][lane] = cpu.registers[r];
+  }
+  pc[lane] = cpu.pc;
+  sp[lane] = cpu.sp;
+  flags[lane] = cpu.flags;
+  if (cpu.halted) {
+    halted_mask |= 1u << lane;
+    live_mask &= ~(1u << lane);
+  }
+}
+
+// Run one instruction on the lane's own CPU
+void LockstepEngine::scalar_step(int lane) {
+  load_lane(lane);
+  cpus[lane]->step();
+  store_lane(lane);
+  // step() counted the instruction, and WAIT may have skipped ahead
+  count[lane] = cpus[lane]->instruction_count - 1;
+}
+
+// Loads, stores and jumps, run lane by lane against each lane's Memory.
+// Returns false for opcodes that need the lane's CPU.
+bool LockstepEngine::lane_access(word_t instruction, uint32_t mask) {
+  byte_t opcode = GET_OPCODE(instruction);
+  byte_t rd = GET_RD(instruction);
+  byte_t rs = GET_RS(instruction);
+
+  word_t condition = 0; // Flag tested by a conditional jump
+  bool expected = true; // Value of that flag that takes the jump
+  switch (opcode) {
+  case OP_LOAD_IND:
+  case OP_LOAD_DIR:
+  case OP_STORE_IND:
+  case OP_STORE_DIR:
+  case OP_JMP:
+    break;
+  case OP_JZ:
+  case OP_JNZ:
+    condition = FLAG_ZERO;
+    expected = opcode == OP_JZ;
+    break;
+  case OP_JC:
+  case OP_JNC:
+    condition = FLAG_CARRY;
+    expected = opcode == OP_JC;
+    break;
+  case OP_JN:
+    condition = FLAG_NEGATIVE;
+    break;
+  default:
+    return false;
+  }
+
+  for (int lane = 0; lane < num_lanes; lane++) {
+    if (!((mask >> lane) & 1))
+      continue;
+    Memory &mem = *memories[lane];
+    CPU &cpu = *cpus[lane];
+    cpu.instruction_count = count[lane]; // Clock for the lane's devices
+    word_t next = pc[lane] + 2;
+
+    switch (opcode) {
+    case OP_LOAD_IND:
+      regs[rd][lane] = mem.read_word(regs[rs][lane]);
+      break;
+    case OP_LOAD_DIR:
+      regs[rd][lane] = mem.read_word(mem.read_word(next));
+      next += 2;
+      break;
+    case OP_STORE_IND:
+      mem.write_word(regs[rd][lane], regs[rs][lane]);
+      break;
+    case OP_STORE_DIR:
+      mem.write_word(mem.read_word(next), regs[rs][lane]);
+      next += 2;
+      break;
+    case OP_JMP:
+      next = mem.read_word(next);
+      break;
+    default: {
+      word_t target = mem.read_word(next);
+      next += 2;
+      if (((flags[lane] & condition) != 0) == expected) {
+        next = target;
+      }
+      break;
+    }
+    }
+    pc[lane] = next;
+    // A due event may enter an interrupt handler, which needs the lane's
+    // whole state in its CPU
+    if (is_control_transfer(opcode) &&
+        count[lane] + 1 >= cpu.scheduler.next_deadline()) {
+      load_lane(lane);
+      cpu.service_events(count[lane] + 1);
+      store_lane(lane);
+    }
+  }
+  return true;
+}
+
+bool LockstepEngine::step() {
+  if (live_mask == 0)
+    return false;
+
+  int leader;
+  uint32_t mask = select_lanes(leader);
+  word_t instruction = memories[leader]->read_word(pc[leader]);
+  byte_t opcode = GET_OPCODE(instruction);
+
+  bool lane_op = (opcode == OP_MUL || opcode == OP_DIV ||
+                  opcode == OP_SHL || opcode == OP_SHR) &&
+                 GET_RT(instruction) < NUM_REGISTERS;
+
+  if (lane_op || vector_alu(instruction, mask)) {
+    if (lane_op) {
+      lane_alu(instruction, mask);
+    }
+    for (int lane = 0; lane < num_lanes; lane++) {
+      if ((mask >> lane) & 1) {
+        pc[lane] += 2;
+      }
+    }
+    vector_steps++;
+  } else if (lane_access(instruction, mask)) {
+    scalar_steps++;
+  } else {
+    for (int lane = 0; lane < num_lanes; lane++) {
+      if ((mask >> lane) & 1) {
+        scalar_step(lane);
+      }
+    }
+    scalar_steps++;
+  }
+
+  for (int lane = 0; lane < num_lanes; lane++) {
+    if ((mask >> lane) & 1) {
+      count[lane]++;
+      if (budget[lane] != 0 && count[lane] >= budget[lane]) {
+        live_mask &= ~(1u << lane);
+      }
+    }
+  }
+  return true;
+}
+
+void LockstepEngine::run() {
+  while (step()) {
+  }
+}
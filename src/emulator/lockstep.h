@@ -0,0 +1,97 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "../common/types.h"
+#include "cpu.h"
+#include "memory.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Lockstep interpreter for up to MAX_LANES guest contexts running the same
+// program. Registers and flags are stored structure-of-arrays, one 16-bit
+// lane per context, so the common ALU opcodes run as SIMD operations across
+// every lane at the same PC. Each lane still has its own Memory and a
+// scalar CPU. Loads, stores, jumps and the rarer ALU opcodes run lane by
+// lane; stack, call and interrupt instructions, HALT and invalid opcodes
+// are handed to the lane's CPU. When lanes diverge, the lanes at the lowest
+// PC run first until the others catch up.
+class LockstepEngine {
+public:
+  static const int MAX_LANES = 32;
+
+private:
+  // Records whether any lane has written into its program region; until
+  // one does, every lane is known to hold the same code
+  class CodeWriteFlag : public CodeWriteListener {
+  public:
+    bool written;
+    CodeWriteFlag() : written(false) {}
+    void invalidate_code(addr_t, addr_t) override { written = true; }
+  };
+
+  int num_lanes;
+
+  // Structure-of-arrays guest state; lanes >= num_lanes are padding
+  word_t regs[NUM_REGISTERS][MAX_LANES];
+  word_t flags[MAX_LANES];
+  word_t pc[MAX_LANES];
+  word_t sp[MAX_LANES];
+  uint64_t count[MAX_LANES];
+  uint64_t budget[MAX_LANES]; // 0 = unlimited
+  uint32_t halted_mask;
+  uint32_t live_mask; // Lanes neither halted nor out of budget
+  bool loaded;        // False if the image did not fit; no lane runs
+
+  // Per-lane machines for everything that is not a vector ALU operation
+  std::vector<std::unique_ptr<Memory>> memories;
+  std::vector<std::unique_ptr<CPU>> cpus;
+  CodeWriteFlag code_written;
+
+  // Execution statistics
+  uint64_t vector_steps;
+  uint64_t scalar_steps;
+
+  uint32_t select_lanes(int &leader) const;
+  bool vector_alu(word_t instruction, uint32_t mask);
+  void lane_alu(word_t instruction, uint32_t mask);
+  bool lane_access(word_t instruction, uint32_t mask);
+  void load_lane(int lane);  // Copy the lane's registers into its CPU
+  void store_lane(int lane); // ...and back
+  void scalar_step(int lane);
+
+public:
+  // lanes must be in 1..MAX_LANES; every lane starts with image loaded at
+  // PROGRAM_START and zeroed registers
+  LockstepEngine(int lanes, const std::vector<byte_t> &image);
+  ~LockstepEngine();
+
+  int get_num_lanes() const { return num_lanes; }
+  bool is_loaded() const { return loaded; }
+  Memory &lane_memory(int lane) { return *memories[lane]; }
+
+  void set_register(int lane, int reg, word_t value);
+  void set_budget(int lane, uint64_t instructions) {
+    budget[lane] = instructions;
+  }
+
+  // Execute one instruction on the group of lanes at the lowest PC.
+  // Returns false once no lane can run.
+  bool step();
+  void run();
+
+  // Per-lane state inspection
+  bool is_halted(int lane) const { return (halted_mask >> lane) & 1; }
+  word_t get_register(int lane, int reg) const;
+  word_t get_flags(int lane) const { return flags[lane]; }
+  word_t get_pc(int lane) const { return pc[lane]; }
+  word_t get_sp(int lane) const { return sp[lane]; }
+  uint64_t get_instruction_count(int lane) const { return count[lane]; }
+
+  // Group steps that ran as one SIMD operation vs. lane by lane (lane_alu
+  // steps count as vector steps: they need no per-lane dispatch)
+  uint64_t get_vector_steps() const { return vector_steps; }
+  uint64_t get_scalar_steps() const { return scalar_steps; }
+};
+
+#endif // LOCKSTEP_H
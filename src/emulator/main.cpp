@@ -1,17 +1,251 @@
+#include "batch.h"
+#include "console.h"
 #include "cpu.h"
+#include "difftest.h"
 #include "memory.h"
+#include "profiler.h"
+#include "program.h"
+#include "replay.h"
+#include "stats.h"
+#include "symbol_table.h"
+#include "trace.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <fcntl.h>
+#include <iomanip>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 void print_usage(const char *program_name) {
   std::cout << "Usage: " << program_name << " <binary_file> [options]\n";
+  std::cout << "A binary_file ending in .asm is assembled in memory first\n";
   std::cout << "Options:\n";
   std::cout
       << "  -d, --debug    Enable debug mode (show instruction execution)\n";
   std::cout << "  -m, --memdump  Dump memory after execution\n";
+  std::cout << "  -e, --engine <switch|predecoded|threaded|block|jit>\n"
+            << "                 Select execution engine (default: "
+               "predecoded)\n";
+  std::cout << "  --jit-threshold <n>\n"
+            << "                 Block executions before JIT compilation "
+               "(default: 32)\n";
+  std::cout << "  --lazy-flags   Compute status flags only when they are "
+               "read\n";
+  std::cout << "  -b, --break <addr>\n"
+            << "                 Stop before executing the instruction at "
+               "addr (repeatable)\n";
+  std::cout << "  --limit <n>    Stop after executing n instructions\n";
+  std::cout << "  --stats[=json] Report opcode, branch, memory and call "
+               "counters, wall time\n"
+            << "                 and MIPS (uses the instrumented "
+               "interpreter)\n";
+  std::cout << "  --trace <file> Record a binary execution trace (render it "
+               "with tracedump)\n";
+  std::cout << "  --trace-pc <first:last>\n"
+            << "                 Only trace instructions at these "
+               "addresses\n";
+  std::cout << "  --trace-window <first:last>\n"
+            << "                 Only trace these instruction counts "
+               "(0-based, inclusive)\n";
+  std::cout << "  --profile[=n]  Sample the PC every n instructions "
+               "(default: 997) and report\n"
+            << "                 hot spots (uses the instrumented "
+               "interpreter)\n";
+  std::cout << "  --symbols <file>\n"
+            << "                 Label addresses in reports (default: the "
+               "binary's .sym file,\n"
+            << "                 or the labels of a .asm source)\n";
+  std::cout << "  --batch <n>    Run n instances (R0 = instance number) and "
+               "report totals\n";
+  std::cout << "  --threads <n>  Worker threads for --batch (default: all "
+               "cores)\n";
+  std::cout << "  --lockstep <n> Run batch instances in SIMD lockstep groups "
+               "of n (max 32)\n";
+  std::cout << "  --checkpoint <addr>\n"
+            << "                 Fork batch instances from a snapshot taken "
+               "when PC first\n"
+            << "                 reaches addr\n";
+  std::cout << "  --batch-output Print each batch instance's console "
+               "output\n";
+  std::cout << "  --console-out <file>\n"
+            << "                 Write guest console output to file "
+               "instead of stdout\n";
+  std::cout << "  --console-in <file>\n"
+            << "                 Read guest console input from file "
+               "instead of stdin\n";
+  std::cout << "  --console-flush <line|halt>\n"
+            << "                 Flush console output per line or only at "
+               "halt (default:\n"
+            << "                 line on a terminal, halt otherwise)\n";
+  std::cout << "  --verify       Check the engine against the reference "
+               "interpreter\n";
+  std::cout << "  --record <file>\n"
+            << "                 Record console input and periodic "
+               "checkpoints to file\n";
+  std::cout << "  --record-interval <n>\n"
+            << "                 Instructions between recorded checkpoints "
+               "(default:\n"
+            << "                 1000000)\n";
+  std::cout << "  --replay <file>\n"
+            << "                 Rerun a recording (no binary_file "
+               "needed)\n";
+  std::cout << "  --bisect <file>\n"
+            << "                 Replay a recording on the engine and the "
+               "reference\n"
+            << "                 interpreter and find their first "
+               "difference\n";
   std::cout << "  -h, --help     Show this help message\n";
 }
 
+// Parse a whole unsigned number no greater than max. Signs, trailing
+// characters and overflow are rejected.
+static bool parse_number(const char *text, int base, unsigned long long max,
+                         unsigned long long &value) {
+  if (!isdigit((unsigned char)text[0])) {
+    return false;
+  }
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long parsed = std::strtoull(text, &end, base);
+  if (errno != 0 || *end != '\0' || parsed > max) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+// Read everything left in fd
+static bool read_all(int fd, std::string &data) {
+  char buf[65536];
+  for (;;) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    if (n > 0) {
+      data.append(buf, (size_t)n);
+    } else if (n == 0) {
+      return true;
+    } else if (errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+// Run instances copies of filename on the batch engine. --limit becomes the
+// per-instance budget.
+// With a checkpoint address, one machine runs the program up to that PC
+// and every instance is forked from a snapshot taken there.
+static int run_batch(const std::string &filename, ExecEngine engine,
+                     size_t instances, unsigned threads, int lockstep,
+                     long checkpoint, uint64_t budget, bool show_output) {
+  std::shared_ptr<std::vector<byte_t>> image(new std::vector<byte_t>());
+  if (!read_program_image(filename, *image)) {
+    return 1;
+  }
+
+  std::shared_ptr<MachineSnapshot> start;
+  if (checkpoint >= 0) {
+    Memory memory;
+    CPU cpu(memory);
+    cpu.set_engine(engine);
+    memory.load_image(image->data(), image->size());
+    cpu.add_breakpoint((addr_t)checkpoint);
+    cpu.run();
+    if (cpu.get_stop_reason() != STOP_BREAKPOINT) {
+      std::cerr << "Error: Program halted before reaching checkpoint\n";
+      return 1;
+    }
+    cpu.clear_breakpoints();
+    start.reset(new MachineSnapshot(cpu.snapshot()));
+    std::cout << "\nCheckpoint at 0x" << std::hex << std::setw(4)
+              << std::setfill('0') << checkpoint << std::dec
+              << std::setfill(' ') << " after "
+              << cpu.get_instruction_count() << " instructions\n";
+  }
+
+  BatchEngine batch(engine, threads);
+  batch.set_lockstep_width(lockstep);
+  for (size_t i = 0; i < instances; i++) {
+    BatchJob job;
+    job.image = image;
+    job.start = start;
+    for (int r = 0; r < NUM_REGISTERS; r++) {
+      job.registers[r] = start ? start->cpu.registers[r] : 0;
+    }
+    job.registers[0] = (word_t)i;
+    job.budget = budget;
+    batch.add(job);
+  }
+
+  std::cout << "\n=== Running " << instances << " instances on "
+            << batch.get_num_threads() << " threads ===\n";
+  batch.run();
+
+  const std::vector<BatchResult> &results = batch.get_results();
+  if (show_output) {
+    for (size_t i = 0; i < results.size(); i++) {
+      const std::string &out = results[i].console;
+      std::cout << "[" << i << "] " << out;
+      if (out.empty() || out[out.size() - 1] != '\n') {
+        std::cout << std::endl;
+      }
+    }
+  }
+
+  BatchSummary s = batch.summary();
+  std::cout << "\n=== Batch Complete ===\n";
+  std::cout << "Instances halted: " << s.halted << "/" << s.instances
+            << std::endl;
+  std::cout << "Budget exhausted: " << s.budget_exhausted << std::endl;
+  if (s.load_errors > 0) {
+    std::cout << "Load errors: " << s.load_errors << std::endl;
+  }
+  std::cout << "Instructions executed: " << s.instructions << std::endl;
+  std::cout << "Elapsed: " << std::fixed << std::setprecision(3) << s.seconds
+            << " s";
+  if (s.seconds > 0) {
+    std::cout << " (" << std::setprecision(1)
+              << s.instructions / s.seconds / 1e6 << " MIPS)";
+  }
+  std::cout << std::endl;
+  return s.load_errors > 0 ? 1 : 0;
+}
+
+// Replay a recording on engine and on the reference interpreter, and
+// report the first step where they differ. Consoles are silent, since
+// bisection runs stretches of the program many times.
+static int run_bisect(const std::string &path, ExecEngine engine,
+                      long jit_threshold, bool lazy_flags) {
+  Recording recording;
+  if (!recording.load(path)) {
+    return 1;
+  }
+  Memory memory;
+  CPU cpu(memory);
+  cpu.set_engine(engine);
+  if (jit_threshold >= 0) {
+    cpu.set_jit_threshold((uint32_t)jit_threshold);
+  }
+  cpu.set_lazy_flags(lazy_flags);
+  memory.set_console_enabled(false);
+  Memory ref_memory;
+  CPU ref_cpu(ref_memory);
+  ref_cpu.set_engine(ENGINE_SWITCH);
+  ref_memory.set_console_enabled(false);
+
+  if (!find_divergence(recording, cpu, memory, ref_cpu, ref_memory)) {
+    return 2;
+  }
+  std::cout << "No divergence from the reference interpreter in "
+            << recording.checkpoints.back().cpu.instruction_count
+            << " instructions\n";
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
   if (argc < 2) {
     print_usage(argv[0]);
@@ -21,6 +255,30 @@ int main(int argc, char *argv[]) {
   std::string filename;
   bool debug_mode = false;
   bool memdump = false;
+  ExecEngine engine = ENGINE_PREDECODED;
+  long jit_threshold = -1;
+  bool lazy_flags = false;
+  bool verify = false;
+  std::vector<addr_t> breakpoints;
+  unsigned long long limit = 0;
+  bool stats = false;
+  bool stats_json = false;
+  long profile_interval = -1;
+  std::string symbol_file;
+  std::string trace_file;
+  TraceFilter trace_filter;
+  unsigned long batch_instances = 0;
+  unsigned long batch_threads = 0;
+  int lockstep = 1;
+  long checkpoint = -1;
+  bool batch_output = false;
+  std::string console_out;
+  std::string console_in;
+  std::string console_flush;
+  std::string record_file;
+  unsigned long long record_interval = 1000000;
+  std::string replay_file;
+  std::string bisect_file;
 
   // Parse command-line arguments
   for (int i = 1; i < argc; i++) {
@@ -29,6 +287,135 @@ int main(int argc, char *argv[]) {
       debug_mode = true;
     } else if (arg == "-m" || arg == "--memdump") {
       memdump = true;
+    } else if ((arg == "-e" || arg == "--engine") && i + 1 < argc) {
+      std::string name = argv[++i];
+      if (name == "switch") {
+        engine = ENGINE_SWITCH;
+      } else if (name == "predecoded") {
+        engine = ENGINE_PREDECODED;
+      } else if (name == "threaded") {
+        engine = ENGINE_THREADED;
+      } else if (name == "block") {
+        engine = ENGINE_BLOCK;
+      } else if (name == "jit") {
+        engine = ENGINE_JIT;
+      } else {
+        std::cerr << "Error: Unknown engine '" << name << "'\n";
+        return 1;
+      }
+    } else if (arg == "--jit-threshold" && i + 1 < argc) {
+      unsigned long long threshold = 0;
+      if (!parse_number(argv[++i], 10, UINT32_MAX, threshold)) {
+        std::cerr << "Error: Invalid JIT threshold '" << argv[i] << "'\n";
+        return 1;
+      }
+      jit_threshold = (long)threshold;
+    } else if (arg == "--lazy-flags") {
+      lazy_flags = true;
+    } else if ((arg == "-b" || arg == "--break") && i + 1 < argc) {
+      unsigned long long address = 0;
+      if (!parse_number(argv[++i], 0, 0xFFFF, address)) {
+        std::cerr << "Error: Invalid breakpoint address '" << argv[i]
+                  << "'\n";
+        return 1;
+      }
+      breakpoints.push_back((addr_t)address);
+    } else if (arg == "--limit" && i + 1 < argc) {
+      if (!parse_number(argv[++i], 10, ULLONG_MAX, limit)) {
+        std::cerr << "Error: Invalid instruction limit '" << argv[i]
+                  << "'\n";
+        return 1;
+      }
+    } else if (arg == "--stats" || arg == "--stats=json") {
+      stats = true;
+      stats_json = arg == "--stats=json";
+    } else if (arg == "--trace" && i + 1 < argc) {
+      trace_file = argv[++i];
+    } else if ((arg == "--trace-pc" || arg == "--trace-window") &&
+               i + 1 < argc) {
+      std::string range = argv[++i];
+      uint64_t first = 0;
+      uint64_t last = arg == "--trace-pc" ? 0xFFFF : UINT64_MAX;
+      if (!parse_trace_range(range, first, last) ||
+          (arg == "--trace-pc" && last > 0xFFFF)) {
+        std::cerr << "Error: Invalid range '" << range << "'\n";
+        return 1;
+      }
+      if (arg == "--trace-pc") {
+        trace_filter.pc_first = (addr_t)first;
+        trace_filter.pc_last = (addr_t)last;
+      } else {
+        trace_filter.count_first = first;
+        trace_filter.count_last = last;
+      }
+    } else if (arg == "--profile") {
+      profile_interval = Profiler::DEFAULT_INTERVAL;
+    } else if (arg.compare(0, 10, "--profile=") == 0) {
+      unsigned long long interval = 0;
+      if (!parse_number(argv[i] + 10, 10, UINT32_MAX, interval) ||
+          interval == 0) {
+        std::cerr << "Error: Profile interval must be a positive number\n";
+        return 1;
+      }
+      profile_interval = (long)interval;
+    } else if (arg == "--symbols" && i + 1 < argc) {
+      symbol_file = argv[++i];
+    } else if (arg == "--batch" && i + 1 < argc) {
+      unsigned long long value = 0;
+      if (!parse_number(argv[++i], 10, ULONG_MAX, value)) {
+        std::cerr << "Error: Invalid instance count '" << argv[i] << "'\n";
+        return 1;
+      }
+      batch_instances = (unsigned long)value;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      unsigned long long value = 0;
+      if (!parse_number(argv[++i], 10, UINT_MAX, value)) {
+        std::cerr << "Error: Invalid thread count '" << argv[i] << "'\n";
+        return 1;
+      }
+      batch_threads = (unsigned long)value;
+    } else if (arg == "--lockstep" && i + 1 < argc) {
+      unsigned long long width = 0;
+      if (!parse_number(argv[++i], 10, INT_MAX, width) || width == 0) {
+        std::cerr << "Error: Lockstep width must be a positive number\n";
+        return 1;
+      }
+      lockstep = (int)width;
+    } else if (arg == "--checkpoint" && i + 1 < argc) {
+      unsigned long long address = 0;
+      if (!parse_number(argv[++i], 0, 0xFFFF, address)) {
+        std::cerr << "Error: Invalid checkpoint address '" << argv[i]
+                  << "'\n";
+        return 1;
+      }
+      checkpoint = (long)address;
+    } else if (arg == "--batch-output") {
+      batch_output = true;
+    } else if (arg == "--console-out" && i + 1 < argc) {
+      console_out = argv[++i];
+    } else if (arg == "--console-in" && i + 1 < argc) {
+      console_in = argv[++i];
+    } else if (arg == "--console-flush" && i + 1 < argc) {
+      console_flush = argv[++i];
+      if (console_flush != "line" && console_flush != "halt") {
+        std::cerr << "Error: Unknown flush policy '" << console_flush
+                  << "'\n";
+        return 1;
+      }
+    } else if (arg == "--verify") {
+      verify = true;
+    } else if (arg == "--record" && i + 1 < argc) {
+      record_file = argv[++i];
+    } else if (arg == "--record-interval" && i + 1 < argc) {
+      if (!parse_number(argv[++i], 10, ULLONG_MAX, record_interval) ||
+          record_interval == 0) {
+        std::cerr << "Error: Record interval must be a positive number\n";
+        return 1;
+      }
+    } else if (arg == "--replay" && i + 1 < argc) {
+      replay_file = argv[++i];
+    } else if (arg == "--bisect" && i + 1 < argc) {
+      bisect_file = argv[++i];
     } else if (arg == "-h" || arg == "--help") {
       print_usage(argv[0]);
       return 0;
@@ -37,18 +424,131 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (filename.empty()) {
+  if (!bisect_file.empty()) {
+    return run_bisect(bisect_file, engine, jit_threshold, lazy_flags);
+  }
+
+  if (filename.empty() && replay_file.empty()) {
     std::cerr << "Error: No input file specified\n";
     print_usage(argv[0]);
     return 1;
   }
+  if (!record_file.empty() && (verify || !breakpoints.empty())) {
+    std::cerr << "Error: --record cannot be combined with --verify or "
+                 "breakpoints\n";
+    return 1;
+  }
+  Recording replay;
+  if (!replay_file.empty() && !replay.load(replay_file)) {
+    return 1;
+  }
+
+  if (batch_instances > 0) {
+    return run_batch(filename, engine, batch_instances, batch_threads,
+                     lockstep, checkpoint, limit, batch_output);
+  }
+
+  // Assemble .asm once; both machines load the in-memory image
+  std::vector<byte_t> image;
+  SymbolTable source_symbols;
+  bool from_source = replay_file.empty() && is_assembly_source(filename);
+  if (from_source && !read_program_image(filename, image, &source_symbols)) {
+    return 1;
+  }
+
+  // Guest console output goes through a writer thread, except when debug
+  // traces on stdout need to interleave with it. Declared before Memory so
+  // it outlives it.
+  FILE *console_file = stdout;
+  if (!console_out.empty()) {
+    console_file = fopen(console_out.c_str(), "wb");
+    if (console_file == nullptr) {
+      std::cerr << "Error: Could not open file '" << console_out << "'\n";
+      return 1;
+    }
+  }
+  std::unique_ptr<ConsoleWriter> console;
+  if (!debug_mode || console_file != stdout) {
+    ConsoleFlush policy = isatty(fileno(console_file)) ? CONSOLE_FLUSH_LINE
+                                                       : CONSOLE_FLUSH_HALT;
+    if (!console_flush.empty()) {
+      policy = console_flush == "line" ? CONSOLE_FLUSH_LINE
+                                       : CONSOLE_FLUSH_HALT;
+    }
+    console.reset(new ConsoleWriter(console_file, policy));
+  }
+
+  // Guest console input. --verify feeds both machines the same bytes: a
+  // regular file is mapped by each reader, and a stream named with
+  // --console-in is read in full up front. A default stdin that is a
+  // stream is not used with --verify, since it may never end.
+  int input_fd = STDIN_FILENO;
+  if (!console_in.empty()) {
+    input_fd = open(console_in.c_str(), O_RDONLY);
+    if (input_fd < 0) {
+      std::cerr << "Error: Could not open file '" << console_in << "'\n";
+      return 1;
+    }
+  }
+  struct stat input_info;
+  bool input_mappable =
+      fstat(input_fd, &input_info) == 0 && S_ISREG(input_info.st_mode);
+  std::string input_data;
+  std::unique_ptr<ConsoleReader> input;
+  std::unique_ptr<ConsoleReader> ref_input;
+  if (verify && !input_mappable) {
+    if (!console_in.empty() && !read_all(input_fd, input_data)) {
+      std::cerr << "Error: Failed to read console input\n";
+      return 1;
+    }
+    input.reset(new ConsoleReader(input_data.data(), input_data.size()));
+    ref_input.reset(new ConsoleReader(input_data.data(), input_data.size()));
+  } else {
+    input.reset(new ConsoleReader(input_fd));
+    if (verify) {
+      ref_input.reset(new ConsoleReader(input_fd));
+    }
+  }
 
   // Create memory and CPU
   Memory memory;
   CPU cpu(memory);
+  memory.set_console_writer(console.get());
+  cpu.set_console_input(input.get());
+  cpu.set_engine(engine);
+  if (jit_threshold >= 0) {
+    cpu.set_jit_threshold((uint32_t)jit_threshold);
+  }
+  cpu.set_lazy_flags(lazy_flags);
+  for (size_t i = 0; i < breakpoints.size(); i++) {
+    cpu.add_breakpoint(breakpoints[i]);
+  }
+  cpu.set_instruction_limit(limit);
+  cpu.set_stats_enabled(stats);
+  TraceWriter trace;
+  if (!trace_file.empty() && !verify) {
+    if (!trace.open(trace_file)) {
+      return 1;
+    }
+    cpu.set_trace(&trace, trace_filter);
+  }
+  std::unique_ptr<Profiler> profiler;
+  if (profile_interval > 0 && !verify) {
+    profiler.reset(new Profiler((uint32_t)profile_interval));
+    cpu.set_profiler(profiler.get());
+  }
 
-  // Load program
-  if (!memory.load_program(filename)) {
+  // Load program, or start from the recording with its input
+  if (!replay_file.empty()) {
+    cpu.restore(replay.checkpoints[0]);
+    cpu.set_input_replay(&replay.input);
+  } else if (from_source) {
+    if (!memory.load_image(image.data(), image.size())) {
+      return 1;
+    }
+    std::cout << "Assembled " << image.size() << " bytes from '" << filename
+              << "'" << std::endl;
+  } else if (!memory.load_program(filename)) {
     return 1;
   }
 
@@ -60,20 +560,102 @@ int main(int argc, char *argv[]) {
 
   // Run program
   std::cout << "\n=== Starting Execution ===\n";
-  cpu.run();
+  if (verify) {
+    // Reference machine: same program, switch interpreter, silent console
+    Memory ref_memory;
+    CPU ref_cpu(ref_memory);
+    ref_cpu.set_engine(ENGINE_SWITCH);
+    ref_memory.set_console_enabled(false);
+    ref_cpu.set_console_input(ref_input.get());
+    if (!replay_file.empty()) {
+      ref_cpu.restore(replay.checkpoints[0]);
+      ref_cpu.set_input_replay(&replay.input);
+    } else if (from_source) {
+      ref_memory.load_image(image.data(), image.size());
+    } else if (!ref_memory.load_program(filename)) {
+      return 1;
+    }
+    bool same = run_differential(cpu, memory, ref_cpu, ref_memory);
+    memory.flush_console();
+    if (!same) {
+      return 2;
+    }
+    std::cout << "\n=== Verified against reference interpreter ===\n";
+  } else if (!record_file.empty()) {
+    Recording recording;
+    record_run(cpu, recording, record_interval, limit);
+    if (!cpu.is_halted()) {
+      std::cout << "\n=== Instruction limit reached ===\n";
+    }
+    if (!recording.save(record_file)) {
+      return 1;
+    }
+    std::cout << "\n=== Recorded " << recording.input.size()
+              << " input values and " << recording.checkpoints.size()
+              << " checkpoints to '" << record_file << "' ===\n";
+  } else {
+    cpu.run();
+    if (cpu.get_stop_reason() == STOP_BREAKPOINT) {
+      std::cout << "\n=== Breakpoint at 0x" << std::hex << std::setw(4)
+                << std::setfill('0') << cpu.get_pc() << std::dec
+                << std::setfill(' ') << " ===\n";
+    } else if (cpu.get_stop_reason() == STOP_LIMIT) {
+      std::cout << "\n=== Instruction limit reached ===\n";
+    }
+  }
 
   // Print final state
   std::cout << "\n=== Execution Complete ===\n";
   std::cout << "Instructions executed: " << cpu.get_instruction_count()
             << std::endl;
+  if (cpu.get_idle_count() != 0) {
+    std::cout << "  of which skipped by WAIT: " << cpu.get_idle_count()
+              << std::endl;
+  }
   cpu.print_registers();
   cpu.print_flags();
 
+  if (stats_json) {
+    print_stats_json(std::cout, cpu.get_stats());
+  } else if (stats) {
+    print_stats(std::cout, cpu.get_stats());
+  }
+
+  if (!trace_file.empty() && !verify) {
+    uint64_t records = trace.get_records();
+    if (!trace.close()) {
+      return 1;
+    }
+    std::cout << "\nTrace: " << records << " instructions written to '"
+              << trace_file << "'" << std::endl;
+  }
+
+  if (profiler) {
+    SymbolTable symbols;
+    if (from_source && symbol_file.empty()) {
+      symbols = source_symbols;
+    } else if (!symbols.load(symbol_file.empty() ? symbol_file_path(filename)
+                                                 : symbol_file) &&
+               !symbol_file.empty()) {
+      std::cerr << "Warning: Could not read symbol file '" << symbol_file
+                << "'\n";
+    }
+    profiler->report(std::cout, symbols);
+  }
+
   // Memory dump if requested
   if (memdump) {
     std::cout << "\n=== Memory Dump ===\n";
     memory.dump(0x0000, 0x00FF); // Dump first 256 bytes
   }
 
+  if (console_file != stdout) {
+    console.reset();
+    fclose(console_file);
+  }
+  if (input_fd != STDIN_FILENO) {
+    input.reset();
+    close(input_fd);
+  }
   return 0;
 }
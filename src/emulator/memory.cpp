@@ -1,34 +1,201 @@
 #include "memory.h"
+#include "console.h"
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 
-Memory::Memory() { clear(); }
+// Shared all-zero page backing every page that has never been written
+static const std::shared_ptr<const MemoryPage> &zero_page() {
+  static const std::shared_ptr<const MemoryPage> page(new MemoryPage());
+  return page;
+}
 
-void Memory::clear() { memset(data, 0, MEMORY_SIZE); }
+Memory::Memory() {
+  init_dispatch();
+  clear();
+}
 
-byte_t Memory::read_byte(addr_t address) const { return data[address]; }
+Memory::Memory(const MemorySnapshot &snapshot) {
+  init_dispatch();
+  for (size_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+    set_page(page, snapshot.pages[page]);
+  }
+}
 
-void Memory::write_byte(addr_t address, byte_t value) {
-  // Handle memory-mapped I/O
-  if (address == IO_CONSOLE_OUT) {
-    // Write character to console
-    std::cout << (char)value << std::flush;
-    return;
+// Classify pages by the memory map and attach the built-in devices
+void Memory::init_dispatch() {
+  for (size_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+    addr_t start = (addr_t)(page * MEMORY_PAGE_SIZE);
+    if (start <= PROGRAM_END) {
+      page_types[page] = PAGE_CODE;
+    } else if (start >= IO_START && start <= IO_END) {
+      page_types[page] = PAGE_IO;
+    } else {
+      page_types[page] = PAGE_RAM;
+    }
+  }
+  for (size_t i = 0; i < MEMORY_PAGE_SIZE; i++) {
+    io_devices[i] = nullptr;
+  }
+  map_device(IO_CONSOLE_OUT, IO_CONSOLE_OUT, &console);
+}
+
+void Memory::clear() {
+  for (size_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+    set_page(page, zero_page());
+  }
+  notify_code_write(PROGRAM_START, PROGRAM_END);
+}
+
+void Memory::set_page(size_t page,
+                      const std::shared_ptr<const MemoryPage> &data) {
+  pages[page] = data;
+  read_table[page] = page_types[page] == PAGE_IO ? nullptr : data->bytes;
+  write_table[page] = nullptr;
+}
+
+// Give this Memory its own copy of a page, if it does not have one yet.
+// Plain RAM pages then go into the write table.
+byte_t *Memory::make_writable(size_t page) {
+  if (pages[page].use_count() != 1) {
+    set_page(page, std::make_shared<MemoryPage>(*pages[page]));
+  }
+  // Sole owner: the page is only const to keep snapshots read-only
+  byte_t *bytes = const_cast<MemoryPage *>(pages[page].get())->bytes;
+  if (page_types[page] == PAGE_RAM) {
+    write_table[page] = bytes;
+  }
+  return bytes;
+}
+
+bool Memory::map_device(addr_t start, addr_t end, MemoryDevice *device) {
+  if (start < IO_START || end > IO_END || start > end) {
+    std::cerr << "Error: Device range outside the I/O page" << std::endl;
+    return false;
+  }
+  for (addr_t addr = start; addr <= end; addr++) {
+    if (io_devices[addr - IO_START] != nullptr) {
+      std::cerr << "Error: I/O address 0x" << std::hex << addr << std::dec
+                << " is already mapped" << std::endl;
+      return false;
+    }
+  }
+  for (addr_t addr = start; addr <= end; addr++) {
+    io_devices[addr - IO_START] = device;
+  }
+  return true;
+}
+
+void Memory::unmap_device(MemoryDevice *device) {
+  for (size_t i = 0; i < MEMORY_PAGE_SIZE; i++) {
+    if (io_devices[i] == device) {
+      io_devices[i] = nullptr;
+    }
   }
+}
+
+MemorySnapshot Memory::snapshot() {
+  MemorySnapshot snap;
+  for (size_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+    snap.pages[page] = pages[page];
+    write_table[page] = nullptr; // Now shared
+  }
+  return snap;
+}
+
+void Memory::restore(const MemorySnapshot &snapshot) {
+  for (size_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+    if (pages[page] == snapshot.pages[page])
+      continue;
+    set_page(page, snapshot.pages[page]);
+    addr_t start = (addr_t)(page * MEMORY_PAGE_SIZE);
+    if (start <= PROGRAM_END) {
+      notify_code_write(start, (addr_t)(start + MEMORY_PAGE_SIZE - 1));
+    }
+  }
+}
 
-  data[address] = value;
+void Memory::add_code_listener(CodeWriteListener *listener) {
+  code_listeners.push_back(listener);
 }
 
-word_t Memory::read_word(addr_t address) const {
+void Memory::remove_code_listener(CodeWriteListener *listener) {
+  code_listeners.erase(
+      std::remove(code_listeners.begin(), code_listeners.end(), listener),
+      code_listeners.end());
+}
+
+void Memory::notify_code_write(addr_t start, addr_t end) {
+  for (size_t i = 0; i < code_listeners.size(); i++) {
+    code_listeners[i]->invalidate_code(start, end);
+  }
+}
+
+void Memory::ConsoleOut::write(addr_t, byte_t value) {
+  if (enabled) {
+    if (capture != nullptr) {
+      capture->push_back((char)value);
+    } else if (writer != nullptr) {
+      writer->put((char)value);
+    } else {
+      std::cout << (char)value << std::flush;
+    }
+  }
+}
+
+void Memory::flush_console() {
+  if (console.writer != nullptr) {
+    console.writer->flush();
+  }
+}
+
+byte_t Memory::read_byte_slow(addr_t address) const {
+  // Only the I/O page is missing from the read table
+  MemoryDevice *device = io_devices[address - IO_START];
+  if (device != nullptr) {
+    return device->read(address);
+  }
+  return pages[address / MEMORY_PAGE_SIZE]->bytes[address % MEMORY_PAGE_SIZE];
+}
+
+void Memory::write_byte_slow(addr_t address, byte_t value) {
+  size_t page = address / MEMORY_PAGE_SIZE;
+  if (page_types[page] == PAGE_IO) {
+    MemoryDevice *device = io_devices[address - IO_START];
+    if (device != nullptr) {
+      device->write(address, value);
+      return;
+    }
+  }
+
+  make_writable(page)[address % MEMORY_PAGE_SIZE] = value;
+
+  // Self-modifying code: drop stale decoded copies
+  if (page_types[page] == PAGE_CODE) {
+    notify_code_write(address, address);
+  }
+}
+
+word_t Memory::read_word_slow(addr_t address) const {
   // Little-endian: low byte at lower address
   byte_t low = read_byte(address);
   byte_t high = read_byte(address + 1);
   return (word_t)((high << 8) | low);
 }
 
-void Memory::write_word(addr_t address, word_t value) {
+void Memory::write_word_slow(addr_t address, word_t value) {
+  size_t page = address / MEMORY_PAGE_SIZE;
+  if (page_types[page] != PAGE_IO &&
+      address % MEMORY_PAGE_SIZE != MEMORY_PAGE_SIZE - 1) {
+    // Shared or program page: one copy, one store, one notification
+    store_le16(make_writable(page) + address % MEMORY_PAGE_SIZE, value);
+    if (page_types[page] == PAGE_CODE) {
+      notify_code_write(address, (addr_t)(address + 1));
+    }
+    return;
+  }
   // Little-endian: low byte at lower address
   write_byte(address, (byte_t)(value & 0xFF));
   write_byte(address + 1, (byte_t)((value >> 8) & 0xFF));
@@ -53,10 +220,12 @@ bool Memory::load_program(const std::string &filename, addr_t start_address) {
   }
 
   // Read file into memory
-  if (!file.read((char *)(data + start_address), size)) {
+  std::vector<byte_t> image((size_t)size);
+  if (!file.read((char *)image.data(), size)) {
     std::cerr << "Error: Failed to read file" << std::endl;
     return false;
   }
+  load_image(image.data(), image.size(), start_address);
 
   std::cout << "Loaded " << size << " bytes from '" << filename
             << "' at address 0x" << std::hex << std::setw(4)
@@ -65,6 +234,27 @@ bool Memory::load_program(const std::string &filename, addr_t start_address) {
   return true;
 }
 
+bool Memory::load_image(const byte_t *image, size_t size,
+                        addr_t start_address) {
+  if (start_address + size > MEMORY_SIZE) {
+    std::cerr << "Error: Program too large for memory" << std::endl;
+    return false;
+  }
+
+  for (size_t done = 0; done < size;) {
+    size_t addr = start_address + done;
+    size_t offset = addr % MEMORY_PAGE_SIZE;
+    size_t chunk = std::min(size - done, MEMORY_PAGE_SIZE - offset);
+    memcpy(make_writable(addr / MEMORY_PAGE_SIZE) + offset, image + done,
+           chunk);
+    done += chunk;
+  }
+  if (size > 0) {
+    notify_code_write(start_address, (addr_t)(start_address + size - 1));
+  }
+  return true;
+}
+
 void Memory::dump(addr_t start, addr_t end) const {
   std::cout << "\nMemory Dump [0x" << std::hex << std::setw(4)
             << std::setfill('0') << start << " - 0x" << std::setw(4)
@@ -77,13 +267,13 @@ void Memory::dump(addr_t start, addr_t end) const {
     // Print hex values
     for (int i = 0; i < 16 && (addr + i) <= end; i++) {
       std::cout << std::hex << std::setw(2) << std::setfill('0')
-                << (int)data[addr + i] << " ";
+                << (int)read_byte(addr + i) << " ";
     }
 
     // Print ASCII representation
     std::cout << " | ";
     for (int i = 0; i < 16 && (addr + i) <= end; i++) {
-      byte_t b = data[addr + i];
+      byte_t b = read_byte(addr + i);
       if (b >= 32 && b < 127) {
         std::cout << (char)b;
       } else {
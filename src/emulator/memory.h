@@ -2,17 +2,123 @@
 #define MEMORY_H
 
 #include "../common/types.h"
+#include <cstring>
+#include <memory>
 #include <string>
 #include <vector>
 
+// Observer for writes into the program region, implemented by caches that
+// hold decoded copies of guest code
+class CodeWriteListener {
+public:
+  virtual ~CodeWriteListener() {}
+  virtual void invalidate_code(addr_t start, addr_t end) = 0;
+};
+
+class ConsoleWriter;
+
+// A memory-mapped device on the I/O page. Accesses are byte-wide; a word
+// access to a device address is split into two byte accesses.
+class MemoryDevice {
+public:
+  virtual ~MemoryDevice() {}
+  virtual byte_t read(addr_t address) = 0;
+  virtual void write(addr_t address, byte_t value) = 0;
+};
+
+// Memory is managed in 256-byte pages, the size of the I/O page
+const size_t MEMORY_PAGE_SIZE = 256;
+const size_t MEMORY_NUM_PAGES = MEMORY_SIZE / MEMORY_PAGE_SIZE;
+
+struct MemoryPage {
+  byte_t bytes[MEMORY_PAGE_SIZE];
+};
+
+// Copy-on-write image of a Memory's contents. Taking one shares every page
+// with the Memory; whichever side writes a shared page first gets its own
+// copy. Snapshots are immutable, so one can be used from many threads.
+class MemorySnapshot {
+  friend class Memory;
+
+private:
+  std::shared_ptr<const MemoryPage> pages[MEMORY_NUM_PAGES];
+};
+
+// Unaligned little-endian 16-bit access; the memcpy compiles to one move
+inline word_t load_le16(const byte_t *p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  return (word_t)(p[0] | (p[1] << 8));
+#else
+  word_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+#endif
+}
+
+inline void store_le16(byte_t *p, word_t value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  p[0] = (byte_t)value;
+  p[1] = (byte_t)(value >> 8);
+#else
+  memcpy(p, &value, sizeof(value));
+#endif
+}
+
 class Memory {
 private:
-  byte_t data[MEMORY_SIZE]; // 64KB memory
+  // How accesses to a page are dispatched
+  enum PageType : uint8_t {
+    PAGE_RAM,  // Plain RAM
+    PAGE_CODE, // RAM in the program region: writes invalidate decoded code
+    PAGE_IO,   // Routed to mapped devices; unmapped addresses act as RAM
+  };
+
+  // Console output device at IO_CONSOLE_OUT
+  class ConsoleOut : public MemoryDevice {
+  public:
+    bool enabled;
+    std::string *capture;  // Receives output instead of cout
+    ConsoleWriter *writer; // Asynchronous output instead of cout
+    ConsoleOut() : enabled(true), capture(nullptr), writer(nullptr) {}
+    byte_t read(addr_t) override { return 0; }
+    void write(addr_t address, byte_t value) override;
+  };
+
+  // Page table. Pages may be shared with snapshots and other Memory
+  // objects and are copied on their first write. read_table holds every
+  // page that can be read directly (all but the I/O page); write_table
+  // only plain RAM pages this Memory owns outright. Null entries take the
+  // slow path.
+  std::shared_ptr<const MemoryPage> pages[MEMORY_NUM_PAGES];
+  const byte_t *read_table[MEMORY_NUM_PAGES];
+  byte_t *write_table[MEMORY_NUM_PAGES];
+  PageType page_types[MEMORY_NUM_PAGES];
+  MemoryDevice *io_devices[MEMORY_PAGE_SIZE]; // Indexed by I/O page offset
+
+  std::vector<CodeWriteListener *> code_listeners;
+  ConsoleOut console;
+
+  void init_dispatch();
+  void notify_code_write(addr_t start, addr_t end);
+  void set_page(size_t page, const std::shared_ptr<const MemoryPage> &data);
+  byte_t *make_writable(size_t page);
+
+  // Slow paths for accesses the page tables do not cover
+  byte_t read_byte_slow(addr_t address) const;
+  void write_byte_slow(addr_t address, byte_t value);
+  word_t read_word_slow(addr_t address) const;
+  void write_word_slow(addr_t address, word_t value);
 
 public:
   Memory();
+  explicit Memory(const MemorySnapshot &snapshot); // Fork from a snapshot
 
-  // Read/write byte
+  // Not copyable: fork through snapshot() instead
+  Memory(const Memory &) = delete;
+  Memory &operator=(const Memory &) = delete;
+
+  // Read/write byte. RAM is accessed inline through the page tables (see
+  // the definitions below); everything else takes the slow path.
   byte_t read_byte(addr_t address) const;
   void write_byte(addr_t address, byte_t value);
 
@@ -24,12 +130,86 @@ public:
   bool load_program(const std::string &filename,
                     addr_t start_address = PROGRAM_START);
 
+  // Copy an in-memory image to start_address without printing anything
+  bool load_image(const byte_t *image, size_t size,
+                  addr_t start_address = PROGRAM_START);
+
   // Memory dump for debugging
   void dump(addr_t start, addr_t end) const;
   void dump_range(addr_t start, size_t length) const;
 
   // Clear memory
   void clear();
+
+  // Copy-on-write snapshots. snapshot() costs one pointer per page;
+  // restore() only notifies code listeners about program pages whose
+  // contents differ from the snapshot's.
+  MemorySnapshot snapshot();
+  void restore(const MemorySnapshot &snapshot);
+
+  // Page tables for engines that access RAM directly. A null entry means
+  // the access must go through read_word/write_word instead.
+  const byte_t *const *read_pages() const { return read_table; }
+  byte_t *const *write_pages() const { return write_table; }
+
+  // Backing store of a page, including the RAM behind the I/O page
+  const byte_t *page_data(size_t page) const { return pages[page]->bytes; }
+
+  // Route accesses to the I/O addresses start..end to device. Fails if the
+  // range leaves the I/O page or overlaps another device.
+  bool map_device(addr_t start, addr_t end, MemoryDevice *device);
+  void unmap_device(MemoryDevice *device);
+
+  // Mute console output (e.g. for the reference CPU in --verify runs)
+  void set_console_enabled(bool enable) { console.enabled = enable; }
+
+  // Append console output to out (nullptr restores stdout)
+  void set_console_capture(std::string *out) { console.capture = out; }
+
+  // Send console output through an asynchronous writer (nullptr restores
+  // synchronous stdout). The writer must outlive its use by this Memory.
+  void set_console_writer(ConsoleWriter *writer) { console.writer = writer; }
+
+  // Wait until console output written so far has reached its sink
+  void flush_console();
+
+  // Register/unregister a cache to be told about program-region writes
+  void add_code_listener(CodeWriteListener *listener);
+  void remove_code_listener(CodeWriteListener *listener);
 };
 
+inline byte_t Memory::read_byte(addr_t address) const {
+  const byte_t *page = read_table[address / MEMORY_PAGE_SIZE];
+  if (page != nullptr) {
+    return page[address % MEMORY_PAGE_SIZE];
+  }
+  return read_byte_slow(address);
+}
+
+inline void Memory::write_byte(addr_t address, byte_t value) {
+  byte_t *page = write_table[address / MEMORY_PAGE_SIZE];
+  if (page != nullptr) {
+    page[address % MEMORY_PAGE_SIZE] = value;
+    return;
+  }
+  write_byte_slow(address, value);
+}
+
+inline word_t Memory::read_word(addr_t address) const {
+  const byte_t *page = read_table[address / MEMORY_PAGE_SIZE];
+  if (page != nullptr && address % MEMORY_PAGE_SIZE != MEMORY_PAGE_SIZE - 1) {
+    return load_le16(page + address % MEMORY_PAGE_SIZE);
+  }
+  return read_word_slow(address);
+}
+
+inline void Memory::write_word(addr_t address, word_t value) {
+  byte_t *page = write_table[address / MEMORY_PAGE_SIZE];
+  if (page != nullptr && address % MEMORY_PAGE_SIZE != MEMORY_PAGE_SIZE - 1) {
+    store_le16(page + address % MEMORY_PAGE_SIZE, value);
+    return;
+  }
+  write_word_slow(address, value);
+}
+
 #endif // MEMORY_H
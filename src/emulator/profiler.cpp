@@ -0,0 +1,84 @@
+/*
+ * profiler.cpp
+ *
+ * PC-sampling profiler and its hot-spot report. Sampling every N executed
+ * instructions, rather than on a host timer, makes profiles repeatable
+ * and independent of host load: the same program always produces the same
+ * histogram.
+ */
+
+#include "profiler.h"
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+Profiler::Profiler(uint32_t interval)
+    : interval(interval == 0 ? 1 : interval), hits(MEMORY_SIZE) {
+  clear();
+}
+
+void Profiler::clear() {
+  countdown = interval;
+  std::fill(hits.begin(), hits.end(), 0);
+  samples = 0;
+}
+
+typedef std::pair<uint64_t, std::string> Row; // Samples, description
+
+static void print_rows(std::ostream &out, std::vector<Row> &rows,
+                       uint64_t samples, size_t top) {
+  std::stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+    return a.first > b.first;
+  });
+  if (rows.size() > top) {
+    rows.resize(top);
+  }
+  for (size_t i = 0; i < rows.size(); i++) {
+    out << std::setfill(' ') << std::setw(7) << std::fixed
+        << std::setprecision(2) << 100.0 * rows[i].first / samples << "%"
+        << std::setw(12) << rows[i].first << "  " << rows[i].second
+        << std::endl;
+  }
+}
+
+void Profiler::report(std::ostream &out, const SymbolTable &symbols,
+                      size_t top) const {
+  out << "\n=== Profile ===\n";
+  out << "Samples: " << samples << " (every " << interval
+      << " instructions)" << std::endl;
+  if (samples == 0) {
+    return;
+  }
+
+  if (!symbols.empty()) {
+    // Attribute each sample to the nearest label at or below its PC
+    std::map<std::string, uint64_t> by_label;
+    for (size_t pc = 0; pc < hits.size(); pc++) {
+      if (hits[pc] != 0) {
+        const SymbolTable::Symbol *symbol = symbols.find((addr_t)pc);
+        by_label[symbol ? symbol->name : "(no label)"] += hits[pc];
+      }
+    }
+    std::vector<Row> rows;
+    for (const auto &entry : by_label) {
+      rows.push_back(Row(entry.second, entry.first));
+    }
+    out << "Top labels:\n";
+    print_rows(out, rows, samples, top);
+  }
+
+  std::vector<Row> rows;
+  for (size_t pc = 0; pc < hits.size(); pc++) {
+    if (hits[pc] != 0) {
+      std::ostringstream where;
+      where << "0x" << std::hex << std::setw(4) << std::setfill('0') << pc;
+      if (!symbols.empty()) {
+        where << "  " << symbols.describe((addr_t)pc);
+      }
+      rows.push_back(Row(hits[pc], where.str()));
+    }
+  }
+  out << "Hottest instructions:\n";
+  print_rows(out, rows, samples, top);
+}
@@ -0,0 +1,45 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "../common/types.h"
+#include "symbol_table.h"
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+// Sampling profiler. The RUN_PROFILE run loop calls tick() with the PC of
+// every instruction it executes; every interval-th one is counted in a
+// per-address histogram. Instructions skipped by WAIT are never sampled,
+// so shares are of executed instructions.
+class Profiler {
+private:
+  uint32_t interval;
+  uint32_t countdown; // Instructions until the next sample
+  std::vector<uint64_t> hits; // Samples per PC
+  uint64_t samples;
+
+public:
+  // A prime default keeps samples from locking onto loop periods
+  static const uint32_t DEFAULT_INTERVAL = 997;
+
+  explicit Profiler(uint32_t interval = DEFAULT_INTERVAL);
+
+  void tick(addr_t pc) {
+    if (--countdown == 0) {
+      countdown = interval;
+      hits[pc]++;
+      samples++;
+    }
+  }
+
+  void clear();
+  uint32_t get_interval() const { return interval; }
+  uint64_t get_samples() const { return samples; }
+  uint64_t get_hits(addr_t pc) const { return hits[pc]; }
+
+  // Top labels and hottest instructions by share of samples
+  void report(std::ostream &out, const SymbolTable &symbols,
+              size_t top = 20) const;
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,49 @@
+/*
+ * program.cpp
+ *
+ * Guest programs from disk. Assembly source goes through the assembler in
+ * the same process, so running a generated program needs no temporary
+ * binary and no assembler launch.
+ */
+
+#include "program.h"
+#include "../assembler/assembler.h"
+#include <fstream>
+#include <iostream>
+
+bool is_assembly_source(const std::string &filename) {
+  const std::string extension = ".asm";
+  return filename.size() > extension.size() &&
+         filename.compare(filename.size() - extension.size(),
+                          extension.size(), extension) == 0;
+}
+
+bool read_program_image(const std::string &filename,
+                        std::vector<byte_t> &image, SymbolTable *symbols) {
+  if (is_assembly_source(filename)) {
+    Assembler assembler;
+    if (!assembler.assemble_file(filename)) {
+      return false;
+    }
+    image = assembler.get_machine_code();
+    if (symbols != nullptr) {
+      symbols->assign(assembler.get_symbols());
+    }
+    return true;
+  }
+
+  std::ifstream file(filename, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    std::cerr << "Error: Could not open file '" << filename << "'" << std::endl;
+    return false;
+  }
+
+  std::streamsize size = file.tellg();
+  file.seekg(0, std::ios::beg);
+  image.resize((size_t)size);
+  if (size > 0 && !file.read((char *)image.data(), size)) {
+    std::cerr << "Error: Failed to read file" << std::endl;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,19 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include "../common/types.h"
+#include "symbol_table.h"
+#include <string>
+#include <vector>
+
+// Whether filename names assembly source (.asm) rather than a binary
+bool is_assembly_source(const std::string &filename);
+
+// Read a program into image, ready for Memory::load_image. Assembly source
+// is assembled in memory, with its labels put in symbols if that is not
+// null; a binary is read as it is. Reports errors on cerr.
+bool read_program_image(const std::string &filename,
+                        std::vector<byte_t> &image,
+                        SymbolTable *symbols = nullptr);
+
+#endif // PROGRAM_H
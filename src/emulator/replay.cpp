@@ -0,0 +1,265 @@
+/*
+ * replay.cpp
+ *
+ * Record/replay and divergence bisection. A recording pins down the only
+ * input the machine cannot reproduce by itself (console input), plus
+ * checkpoints to restart from. Two engines replaying it must then agree
+ * at every instruction, so the first disagreement can be found by binary
+ * search over instruction counts. Each probe restarts from copy-on-write
+ * snapshots of the last state where they agreed, not from reset.
+ */
+
+#include "replay.h"
+#include "difftest.h"
+#include "disasm.h"
+#include "../common/instructions.h"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+static const char REPLAY_MAGIC[8] = {'C', 'P', 'U', 'R', 'E', 'P', 'L', 'Y'};
+static const uint32_t REPLAY_VERSION = 1;
+
+struct ReplayHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t state_size; // sizeof(CPUState)
+  uint32_t event_size; // sizeof(InputEvent)
+  uint32_t reserved;
+  uint64_t events;
+  uint64_t checkpoints;
+};
+// Followed by the events, then per checkpoint a CPUState, a uint32_t count
+// of memory pages that differ from the previous checkpoint's (or from
+// zeroed memory for the first) and that many (uint32_t index, page bytes)
+// pairs. Pages include the RAM behind the I/O page.
+
+bool Recording::save(const std::string &path) const {
+  FILE *file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error: Could not create recording '" << path << "'"
+              << std::endl;
+    return false;
+  }
+
+  ReplayHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+  header.version = REPLAY_VERSION;
+  header.state_size = sizeof(CPUState);
+  header.event_size = sizeof(InputEvent);
+  header.events = input.size();
+  header.checkpoints = checkpoints.size();
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (size_t i = 0; ok && i < input.size(); i++) {
+    ok = fwrite(&input[i], sizeof(InputEvent), 1, file) == 1;
+  }
+  std::unique_ptr<Memory> previous(new Memory());
+  for (size_t i = 0; ok && i < checkpoints.size(); i++) {
+    std::unique_ptr<Memory> image(new Memory(checkpoints[i].memory));
+    std::vector<uint32_t> changed;
+    for (uint32_t page = 0; page < MEMORY_NUM_PAGES; page++) {
+      if (memcmp(image->page_data(page), previous->page_data(page),
+                 MEMORY_PAGE_SIZE) != 0) {
+        changed.push_back(page);
+      }
+    }
+    uint32_t count = (uint32_t)changed.size();
+    ok = fwrite(&checkpoints[i].cpu, sizeof(CPUState), 1, file) == 1 &&
+         fwrite(&count, sizeof(count), 1, file) == 1;
+    for (size_t j = 0; ok && j < changed.size(); j++) {
+      ok = fwrite(&changed[j], sizeof(uint32_t), 1, file) == 1 &&
+           fwrite(image->page_data(changed[j]), MEMORY_PAGE_SIZE, 1,
+                  file) == 1;
+    }
+    previous.swap(image);
+  }
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    std::cerr << "Error: Failed to write recording '" << path << "'"
+              << std::endl;
+  }
+  return ok;
+}
+
+bool Recording::load(const std::string &path) {
+  input.clear();
+  checkpoints.clear();
+
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Error: Could not open recording '" << path << "'"
+              << std::endl;
+    return false;
+  }
+
+  ReplayHeader header;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+            memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) == 0 &&
+            header.version == REPLAY_VERSION &&
+            header.state_size == sizeof(CPUState) &&
+            header.event_size == sizeof(InputEvent) && header.checkpoints > 0;
+  if (!ok) {
+    std::cerr << "Error: '" << path
+              << "' is not a recording written by this build" << std::endl;
+    fclose(file);
+    return false;
+  }
+
+  std::vector<InputEvent> &events = input.data();
+  events.resize(header.events);
+  ok = header.events == 0 ||
+       fread(events.data(), sizeof(InputEvent), events.size(), file) ==
+           events.size();
+  // Patching one Memory keeps unchanged pages shared between checkpoints
+  Memory memory;
+  byte_t page_bytes[MEMORY_PAGE_SIZE];
+  for (uint64_t i = 0; ok && i < header.checkpoints; i++) {
+    MachineSnapshot snap;
+    uint32_t count = 0;
+    ok = fread(&snap.cpu, sizeof(CPUState), 1, file) == 1 &&
+         fread(&count, sizeof(count), 1, file) == 1;
+    for (uint32_t j = 0; ok && j < count; j++) {
+      uint32_t page = 0;
+      ok = fread(&page, sizeof(page), 1, file) == 1 &&
+           page < MEMORY_NUM_PAGES &&
+           fread(page_bytes, MEMORY_PAGE_SIZE, 1, file) == 1;
+      if (ok) {
+        memory.load_image(page_bytes, MEMORY_PAGE_SIZE,
+                          (addr_t)(page * MEMORY_PAGE_SIZE));
+      }
+    }
+    if (ok) {
+      snap.memory = memory.snapshot();
+      checkpoints.push_back(snap);
+    }
+  }
+  fclose(file);
+  if (!ok) {
+    std::cerr << "Error: Recording '" << path << "' is truncated or corrupt"
+              << std::endl;
+    input.clear();
+    checkpoints.clear();
+  }
+  return ok;
+}
+
+void record_run(CPU &cpu, Recording &recording, uint64_t interval,
+                uint64_t limit) {
+  recording.input.clear();
+  recording.checkpoints.clear();
+  cpu.set_input_recording(&recording.input);
+  recording.checkpoints.push_back(cpu.snapshot());
+
+  uint64_t next = cpu.get_instruction_count();
+  while (!cpu.is_halted() &&
+         (limit == 0 || cpu.get_instruction_count() < limit)) {
+    while (next <= cpu.get_instruction_count()) {
+      next += interval;
+    }
+    cpu.run_until(limit != 0 && limit < next ? limit : next);
+    recording.checkpoints.push_back(cpu.snapshot());
+  }
+  cpu.set_input_recording(nullptr);
+}
+
+static bool is_block_engine(const CPU &cpu) {
+  return cpu.get_engine() == ENGINE_BLOCK || cpu.get_engine() == ENGINE_JIT;
+}
+
+// Run cpu to target, then ref to wherever cpu stopped, and compare
+static bool advance_both(CPU &cpu, Memory &mem, CPU &ref, Memory &ref_mem,
+                         uint64_t target, std::string &diff) {
+  cpu.run_until(target);
+  ref.run_until(cpu.get_instruction_count());
+  return compare_state(cpu, mem, ref, ref_mem, diff);
+}
+
+// A code word as stored, without reaching any device
+static word_t code_word(const Memory &mem, addr_t address) {
+  addr_t next = (addr_t)(address + 1);
+  return (word_t)(mem.page_data(address / MEMORY_PAGE_SIZE)
+                      [address % MEMORY_PAGE_SIZE] |
+                  mem.page_data(next / MEMORY_PAGE_SIZE)
+                          [next % MEMORY_PAGE_SIZE]
+                      << 8);
+}
+
+// Print what the reference executes from its current state up to count
+static void print_reference_steps(CPU &ref, const Memory &ref_mem,
+                                  uint64_t count) {
+  while (!ref.is_halted() && ref.get_instruction_count() < count) {
+    addr_t pc = ref.get_pc();
+    std::cerr << "  [" << ref.get_instruction_count() << "] ";
+    disassemble(std::cerr, pc, code_word(ref_mem, pc),
+                code_word(ref_mem, (addr_t)(pc + 2)));
+    std::cerr << std::dec << std::setfill(' ') << std::endl;
+    ref.step();
+  }
+}
+
+bool find_divergence(const Recording &recording, CPU &cpu, Memory &mem,
+                     CPU &ref, Memory &ref_mem) {
+  cpu.set_input_replay(&recording.input);
+  ref.set_input_replay(&recording.input);
+
+  const std::vector<MachineSnapshot> &checkpoints = recording.checkpoints;
+  std::string diff;
+  size_t k = 0;
+  for (; k + 1 < checkpoints.size(); k++) {
+    cpu.restore(checkpoints[k]);
+    ref.restore(checkpoints[k]);
+    if (!advance_both(cpu, mem, ref, ref_mem,
+                      checkpoints[k + 1].cpu.instruction_count, diff)) {
+      break;
+    }
+  }
+  if (k + 1 >= checkpoints.size()) {
+    return true;
+  }
+
+  // Bisect between the last agreeing state (lo) and the first
+  // disagreeing instruction count seen (hi)
+  MachineSnapshot good_cpu = checkpoints[k];
+  MachineSnapshot good_ref = checkpoints[k];
+  uint64_t lo = checkpoints[k].cpu.instruction_count;
+  uint64_t hi = cpu.get_instruction_count();
+  while (hi - lo > 1) {
+    cpu.restore(good_cpu);
+    ref.restore(good_ref);
+    if (advance_both(cpu, mem, ref, ref_mem, lo + (hi - lo) / 2, diff)) {
+      lo = cpu.get_instruction_count();
+      good_cpu = cpu.snapshot();
+      good_ref = ref.snapshot();
+    } else if (cpu.get_instruction_count() < hi) {
+      hi = cpu.get_instruction_count();
+    } else {
+      break; // A block engine cannot stop any closer to lo
+    }
+  }
+
+  // Take the single diverging step from the last good state
+  cpu.restore(good_cpu);
+  ref.restore(good_ref);
+  addr_t start_pc = cpu.get_pc();
+  if (is_block_engine(cpu)) {
+    cpu.step_block();
+  } else {
+    cpu.step();
+  }
+  uint64_t end = cpu.get_instruction_count();
+
+  std::cerr << "First divergence from reference in the step starting at PC=0x"
+            << std::hex << std::setw(4) << std::setfill('0') << start_pc
+            << std::dec << std::setfill(' ') << " (instruction " << lo
+            << "); the reference executes:" << std::endl;
+  print_reference_steps(ref, ref_mem, end);
+  compare_state(cpu, mem, ref, ref_mem, diff);
+  std::cerr << "Then: " << diff << std::endl;
+  return false;
+}
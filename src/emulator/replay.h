@@ -0,0 +1,42 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "cpu.h"
+#include "input_log.h"
+#include "memory.h"
+#include <string>
+#include <vector>
+
+// A recorded run: every console input value the guest received, and
+// full-machine checkpoints taken every so many instructions, starting with
+// the state before the first instruction and ending with the last one.
+// Replaying the log from any checkpoint reproduces the run exactly, on any
+// engine.
+class Recording {
+public:
+  InputLog input;
+  std::vector<MachineSnapshot> checkpoints; // By instruction count
+
+  // Files hold raw host-order structures, like traces; a file is only
+  // readable by a build with the same CPUState layout. Both report errors
+  // on cerr.
+  bool save(const std::string &path) const;
+  bool load(const std::string &path);
+};
+
+// Run cpu from its current state to the end (HALT, or limit instructions
+// if limit is not 0), logging its console input into recording and adding
+// a checkpoint every interval instructions
+void record_run(CPU &cpu, Recording &recording, uint64_t interval,
+                uint64_t limit);
+
+// Replay recording on cpu (the engine under test) and ref (normally
+// ENGINE_SWITCH), both started from each checkpoint in turn. For the first
+// checkpoint interval where they disagree, bisect from snapshots of the
+// last agreeing state, instead of from reset, down to the single step
+// (instruction, or block for the block engines) where they first differ.
+// Reports on stderr and returns false if one is found.
+bool find_divergence(const Recording &recording, CPU &cpu, Memory &mem,
+                     CPU &ref, Memory &ref_mem);
+
+#endif // REPLAY_H
@@ -0,0 +1,50 @@
+/*
+ * scheduler.cpp
+ *
+ * Instruction-count event scheduler. Devices schedule work for a future
+ * instruction count instead of being polled on every instruction; the
+ * heap stays tiny (one entry per armed device), so cancel() just rebuilds
+ * it.
+ */
+
+#include "scheduler.h"
+#include <algorithm>
+
+void EventScheduler::schedule(uint64_t when, EventHandler *handler) {
+  Event event;
+  event.when = when;
+  event.seq = next_seq++;
+  event.handler = handler;
+  heap.push_back(event);
+  std::push_heap(heap.begin(), heap.end(), Later());
+  update_deadline();
+}
+
+void EventScheduler::cancel(EventHandler *handler) {
+  size_t kept = 0;
+  for (size_t i = 0; i < heap.size(); i++) {
+    if (heap[i].handler != handler) {
+      heap[kept++] = heap[i];
+    }
+  }
+  if (kept != heap.size()) {
+    heap.resize(kept);
+    std::make_heap(heap.begin(), heap.end(), Later());
+    update_deadline();
+  }
+}
+
+void EventScheduler::clear() {
+  heap.clear();
+  update_deadline();
+}
+
+void EventScheduler::run_due(uint64_t now) {
+  while (!heap.empty() && heap.front().when <= now) {
+    std::pop_heap(heap.begin(), heap.end(), Later());
+    Event event = heap.back();
+    heap.pop_back();
+    update_deadline();
+    event.handler->on_event(event.when);
+  }
+}
@@ -0,0 +1,53 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <vector>
+
+// Receiver of scheduled events
+class EventHandler {
+public:
+  virtual ~EventHandler() {}
+  // Called once the CPU's instruction count has reached when
+  virtual void on_event(uint64_t when) = 0;
+};
+
+// Future events keyed by instruction count, kept in a min-heap. The CPU
+// only compares its count against next_deadline() at control transfers,
+// so an idle scheduler costs one comparison per taken or untaken branch.
+class EventScheduler {
+private:
+  struct Event {
+    uint64_t when;
+    uint64_t seq; // Keeps events due at the same count in schedule order
+    EventHandler *handler;
+  };
+  struct Later {
+    bool operator()(const Event &a, const Event &b) const {
+      return a.when != b.when ? a.when > b.when : a.seq > b.seq;
+    }
+  };
+
+  std::vector<Event> heap;
+  uint64_t next_seq;
+  uint64_t next_deadline_; // Count of the earliest event, or UINT64_MAX
+
+  void update_deadline() {
+    next_deadline_ = heap.empty() ? UINT64_MAX : heap.front().when;
+  }
+
+public:
+  EventScheduler() : next_seq(0), next_deadline_(UINT64_MAX) {}
+
+  void schedule(uint64_t when, EventHandler *handler);
+  void cancel(EventHandler *handler); // Drop all of handler's events
+  void clear();
+
+  uint64_t next_deadline() const { return next_deadline_; }
+
+  // Deliver every event due at or before now, earliest first. Handlers may
+  // schedule further events; those are delivered too if already due.
+  void run_due(uint64_t now);
+};
+
+#endif // SCHEDULER_H
@@ -0,0 +1,106 @@
+/*
+ * stats.cpp
+ *
+ * Execution counters and their --stats report. The counters are filled in
+ * by the RUN_STATS instantiations of the run loop only; this file just
+ * formats them.
+ */
+
+#include "stats.h"
+#include "../common/instructions.h"
+#include <iomanip>
+
+void ExecStats::clear() {
+  for (int i = 0; i < 64; i++) {
+    opcode_counts[i] = 0;
+  }
+  branches_taken = 0;
+  branches_not_taken = 0;
+  for (int r = 0; r < NUM_REGIONS; r++) {
+    reads[r] = 0;
+    writes[r] = 0;
+  }
+  interrupts = 0;
+  call_depth = 0;
+  max_call_depth = 0;
+  seconds = 0;
+}
+
+uint64_t ExecStats::instructions() const {
+  uint64_t total = 0;
+  for (int i = 0; i < 64; i++) {
+    total += opcode_counts[i];
+  }
+  return total;
+}
+
+double ExecStats::mips() const {
+  return seconds > 0 ? instructions() / seconds / 1e6 : 0;
+}
+
+const char *region_name(MemRegion region) {
+  static const char *const NAMES[NUM_REGIONS] = {"program", "data", "io",
+                                                 "stack"};
+  return NAMES[region];
+}
+
+void print_stats(std::ostream &out, const ExecStats &stats) {
+  out << "\n=== Statistics ===\n";
+  out << "Instructions: " << stats.instructions() << " in " << std::fixed
+      << std::setprecision(3) << stats.seconds << " s";
+  if (stats.seconds > 0) {
+    out << " (" << std::setprecision(1) << stats.mips() << " MIPS)";
+  }
+  out << std::endl;
+
+  out << "Opcodes:\n";
+  for (int op = 0; op < 64; op++) {
+    if (stats.opcode_counts[op] != 0) {
+      out << "  0x" << std::hex << std::setw(2) << std::setfill('0') << op
+          << std::dec << std::setfill(' ') << "  " << std::left
+          << std::setw(6) << get_opcode_name((byte_t)op) << std::right
+          << stats.opcode_counts[op] << std::endl;
+    }
+  }
+
+  out << "Branches: " << stats.branches_taken << " taken, "
+      << stats.branches_not_taken << " not taken" << std::endl;
+  out << "Memory (words):  reads      writes\n";
+  for (int r = 0; r < NUM_REGIONS; r++) {
+    out << "  " << std::left << std::setw(8) << region_name((MemRegion)r)
+        << std::right << std::setw(12) << stats.reads[r] << std::setw(12)
+        << stats.writes[r] << std::endl;
+  }
+  out << "Max call depth: " << stats.max_call_depth << std::endl;
+  out << "Interrupts: " << stats.interrupts << std::endl;
+}
+
+void print_stats_json(std::ostream &out, const ExecStats &stats) {
+  out << "{\"instructions\":" << stats.instructions() << ",\"seconds\":"
+      << std::fixed << std::setprecision(6) << stats.seconds
+      << ",\"mips\":" << std::setprecision(3) << stats.mips()
+      << ",\"opcodes\":{";
+  bool first = true;
+  for (int op = 0; op < 64; op++) {
+    if (stats.opcode_counts[op] != 0) {
+      out << (first ? "" : ",") << "\"0x" << std::hex << std::setw(2)
+          << std::setfill('0') << op << std::dec << std::setfill(' ')
+          << "\":" << stats.opcode_counts[op];
+      first = false;
+    }
+  }
+  out << "},\"branches\":{\"taken\":" << stats.branches_taken
+      << ",\"not_taken\":" << stats.branches_not_taken << "}";
+  const char *const kinds[2] = {"reads", "writes"};
+  const uint64_t *const counts[2] = {stats.reads, stats.writes};
+  for (int k = 0; k < 2; k++) {
+    out << ",\"" << kinds[k] << "\":{";
+    for (int r = 0; r < NUM_REGIONS; r++) {
+      out << (r ? "," : "") << "\"" << region_name((MemRegion)r)
+          << "\":" << counts[k][r];
+    }
+    out << "}";
+  }
+  out << ",\"max_call_depth\":" << stats.max_call_depth
+      << ",\"interrupts\":" << stats.interrupts << "}" << std::endl;
+}
@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "../common/types.h"
+#include <cstdint>
+#include <ostream>
+
+// Address regions of the memory map in types.h
+enum MemRegion {
+  REGION_PROGRAM, // PROGRAM_START..PROGRAM_END
+  REGION_DATA,    // DATA_START..DATA_END
+  REGION_IO,      // IO_START..IO_END
+  REGION_STACK,   // STACK_START..STACK_END
+  NUM_REGIONS
+};
+
+inline MemRegion memory_region(addr_t address) {
+  if (address <= PROGRAM_END) {
+    return REGION_PROGRAM;
+  }
+  if (address <= DATA_END) {
+    return REGION_DATA;
+  }
+  return address <= IO_END ? REGION_IO : REGION_STACK;
+}
+
+// Execution counters gathered by the instrumented run loop (RUN_STATS).
+// Memory accesses are data accesses by LOAD, STORE, the stack instructions
+// and interrupt entry, counted per word by the region of their address;
+// instruction fetches are not included.
+struct ExecStats {
+  uint64_t opcode_counts[64];
+  uint64_t branches_taken;     // Conditional jumps only
+  uint64_t branches_not_taken;
+  uint64_t reads[NUM_REGIONS];
+  uint64_t writes[NUM_REGIONS];
+  uint64_t interrupts; // Interrupts entered
+  uint64_t call_depth; // CALLs not yet matched by a RET
+  uint64_t max_call_depth;
+  double seconds; // Wall time spent in CPU::run()
+
+  ExecStats() { clear(); }
+  void clear();
+
+  uint64_t instructions() const; // Executed, not skipped by WAIT
+  double mips() const;
+
+  void count_read(addr_t address) { reads[memory_region(address)]++; }
+  void count_write(addr_t address) { writes[memory_region(address)]++; }
+};
+
+const char *region_name(MemRegion region);
+
+// Human-readable report, or one JSON object on a single line
+void print_stats(std::ostream &out, const ExecStats &stats);
+void print_stats_json(std::ostream &out, const ExecStats &stats);
+
+#endif // STATS_H
@@ -0,0 +1,75 @@
+/*
+ * symbol_table.cpp
+ *
+ * Reader for assembler symbol files (see symbols.h). Lines that do not
+ * parse are skipped, so a stale or hand-edited file degrades to fewer
+ * labels instead of failing the run.
+ */
+
+#include "symbol_table.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+bool SymbolTable::load(const std::string &symbol_file) {
+  symbols.clear();
+  std::ifstream infile(symbol_file);
+  if (!infile.is_open()) {
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(infile, line)) {
+    std::istringstream fields(line);
+    unsigned address;
+    Symbol symbol;
+    if (fields >> std::hex >> address >> symbol.name && address < MEMORY_SIZE) {
+      symbol.address = (addr_t)address;
+      symbols.push_back(symbol);
+    }
+  }
+  std::stable_sort(symbols.begin(), symbols.end(),
+                   [](const Symbol &a, const Symbol &b) {
+                     return a.address < b.address;
+                   });
+  return true;
+}
+
+void SymbolTable::assign(
+    const std::vector<std::pair<addr_t, std::string>> &labels) {
+  symbols.clear();
+  for (size_t i = 0; i < labels.size(); i++) {
+    Symbol symbol;
+    symbol.address = labels[i].first;
+    symbol.name = labels[i].second;
+    symbols.push_back(symbol);
+  }
+  std::stable_sort(symbols.begin(), symbols.end(),
+                   [](const Symbol &a, const Symbol &b) {
+                     return a.address < b.address;
+                   });
+}
+
+const SymbolTable::Symbol *SymbolTable::find(addr_t address) const {
+  // Last symbol whose address is <= address
+  std::vector<Symbol>::const_iterator it = std::upper_bound(
+      symbols.begin(), symbols.end(), address,
+      [](addr_t a, const Symbol &s) { return a < s.address; });
+  if (it == symbols.begin()) {
+    return nullptr;
+  }
+  return &*--it;
+}
+
+std::string SymbolTable::describe(addr_t address) const {
+  std::ostringstream out;
+  const Symbol *symbol = find(address);
+  if (symbol == nullptr) {
+    out << "0x" << std::hex << address;
+  } else if (symbol->address == address) {
+    out << symbol->name;
+  } else {
+    out << symbol->name << "+0x" << std::hex << (address - symbol->address);
+  }
+  return out.str();
+}
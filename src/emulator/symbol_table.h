@@ -0,0 +1,39 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "../common/symbols.h"
+#include "../common/types.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// Labels of a guest program, loaded from the symbol file the assembler
+// writes next to the binary, for turning addresses into label+offset
+class SymbolTable {
+public:
+  struct Symbol {
+    addr_t address;
+    std::string name;
+  };
+
+private:
+  std::vector<Symbol> symbols; // Sorted by address
+
+public:
+  // Replace the table with the contents of a symbol file. Returns false
+  // (leaving the table empty) if it cannot be read.
+  bool load(const std::string &symbol_file);
+
+  // Replace the table with labels from the assembler
+  void assign(const std::vector<std::pair<addr_t, std::string>> &labels);
+
+  bool empty() const { return symbols.empty(); }
+
+  // Nearest label at or below address, or nullptr if there is none
+  const Symbol *find(addr_t address) const;
+
+  // "label+0x6", "label", or "0x1234" if no label precedes address
+  std::string describe(addr_t address) const;
+};
+
+#endif // SYMBOL_TABLE_H
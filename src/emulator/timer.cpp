@@ -0,0 +1,96 @@
+/*
+ * timer.cpp
+ *
+ * Timer device on IO_TIMER_CTRL/IO_TIMER_VAL. Arming the timer schedules
+ * one event at its deadline; periodic timers schedule the next one when it
+ * fires. Nothing runs between expiries.
+ */
+
+#include "timer.h"
+
+TimerDevice::TimerDevice(const uint64_t &clock, EventScheduler &scheduler,
+                         InterruptController &irq)
+    : clock(clock), scheduler(scheduler), irq(irq) {
+  reset();
+}
+
+void TimerDevice::reset() {
+  scheduler.cancel(this);
+  state.ctrl = 0;
+  state.period = 0;
+  state.latch = 0;
+  state.deadline = 0;
+}
+
+void TimerDevice::load(const TimerState &saved) {
+  scheduler.cancel(this);
+  state = saved;
+  if (state.ctrl & TIMER_ENABLE) {
+    scheduler.schedule(state.deadline, this);
+  }
+}
+
+// (Re)start the countdown from the current instruction count. A zero
+// period leaves the timer stopped.
+void TimerDevice::arm() {
+  scheduler.cancel(this);
+  if (!(state.ctrl & TIMER_ENABLE) || state.period == 0) {
+    state.ctrl &= ~TIMER_ENABLE;
+    return;
+  }
+  state.deadline = clock + state.period;
+  scheduler.schedule(state.deadline, this);
+}
+
+word_t TimerDevice::remaining() const {
+  if (!(state.ctrl & TIMER_ENABLE)) {
+    return state.period;
+  }
+  if (clock < state.deadline) {
+    return (word_t)(state.deadline - clock);
+  }
+  // Expired, but the event has not been delivered yet
+  if (state.ctrl & TIMER_PERIODIC) {
+    return (word_t)(state.period - (clock - state.deadline) % state.period);
+  }
+  return 0;
+}
+
+byte_t TimerDevice::read(addr_t address) {
+  if (address == IO_TIMER_CTRL) {
+    return state.ctrl;
+  }
+  word_t value = remaining();
+  return address == IO_TIMER_VAL ? (byte_t)(value & 0xFF)
+                                 : (byte_t)(value >> 8);
+}
+
+void TimerDevice::write(addr_t address, byte_t value) {
+  if (address == IO_TIMER_CTRL) {
+    // Clears FIRED. Only a 0 -> 1 change of ENABLE restarts the countdown,
+    // so a running periodic timer can be acknowledged without drifting.
+    bool was_enabled = (state.ctrl & TIMER_ENABLE) != 0;
+    state.ctrl = value & (TIMER_ENABLE | TIMER_PERIODIC);
+    if (!(state.ctrl & TIMER_ENABLE)) {
+      scheduler.cancel(this);
+    } else if (!was_enabled) {
+      arm();
+    }
+  } else if (address == IO_TIMER_VAL) {
+    state.latch = value;
+  } else {
+    state.period = (word_t)((value << 8) | state.latch);
+    arm();
+  }
+}
+
+void TimerDevice::on_event(uint64_t when) {
+  state.ctrl |= TIMER_FIRED;
+  irq.raise(IRQ_TIMER);
+  if (state.ctrl & TIMER_PERIODIC) {
+    state.deadline = when + state.period;
+    scheduler.schedule(state.deadline, this);
+  } else {
+    state.ctrl &= ~TIMER_ENABLE;
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "../common/types.h"
+#include "interrupt.h"
+#include "memory.h"
+#include "scheduler.h"
+#include <cstdint>
+
+// Bits of the timer control register at IO_TIMER_CTRL
+const byte_t TIMER_ENABLE = 0x01;   // Counting down; setting it starts
+const byte_t TIMER_PERIODIC = 0x02; // Reload on expiry instead of stopping
+const byte_t TIMER_FIRED = 0x04;    // Expired; cleared by writing CTRL
+
+// Guest-visible timer registers, plus the instruction count at which the
+// armed countdown expires
+struct TimerState {
+  byte_t ctrl;
+  word_t period; // Reload value in instructions
+  byte_t latch;  // Low byte of a VAL write, committed by the high byte
+  uint64_t deadline;
+};
+
+// Countdown timer clocked by the CPU's instruction count. Registers:
+//   IO_TIMER_CTRL      control bits above
+//   IO_TIMER_VAL(+1)   16-bit little-endian value. Writing sets the period
+//                      (and restarts an enabled timer); reading returns the
+//                      instructions left, or the period while disabled.
+// Expiry is a scheduled event, not a per-instruction countdown, and VAL is
+// computed from the clock only when it is read. Each expiry raises
+// IRQ_TIMER.
+class TimerDevice : public MemoryDevice, public EventHandler {
+private:
+  const uint64_t &clock; // Instructions executed so far
+  EventScheduler &scheduler;
+  InterruptController &irq;
+  TimerState state;
+
+  void arm();
+
+public:
+  TimerDevice(const uint64_t &clock, EventScheduler &scheduler,
+              InterruptController &irq);
+
+  byte_t read(addr_t address) override;
+  void write(addr_t address, byte_t value) override;
+  void on_event(uint64_t when) override;
+
+  word_t remaining() const;
+
+  void reset();
+  TimerState save() const { return state; }
+  void load(const TimerState &saved); // Re-arms the pending expiry
+};
+
+#endif // TIMER_H
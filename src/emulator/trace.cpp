@@ -0,0 +1,132 @@
+/*
+ * trace.cpp
+ *
+ * Binary trace files. The writer fills a buffer of fixed-size records in
+ * place and hands it to stdio in 1 MB blocks; the reader does the same in
+ * reverse. Nothing is formatted while the guest runs.
+ */
+
+#include "trace.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const size_t TRACE_BUFFER_RECORDS = (1 << 20) / sizeof(TraceRecord);
+
+static bool parse_bound(const std::string &text, uint64_t &value) {
+  if (text.empty()) {
+    return true;
+  }
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long parsed = std::strtoull(text.c_str(), &end, 0);
+  if (errno != 0 || end != text.c_str() + text.size()) {
+    return false;
+  }
+  value = parsed;
+  return true;
+}
+
+bool parse_trace_range(const std::string &text, uint64_t &first,
+                       uint64_t &last) {
+  size_t colon = text.find(':');
+  if (colon == std::string::npos) {
+    return false;
+  }
+  return parse_bound(text.substr(0, colon), first) &&
+         parse_bound(text.substr(colon + 1), last) && first <= last;
+}
+
+TraceWriter::TraceWriter()
+    : file(nullptr), used(0), written(0), failed(false) {}
+
+TraceWriter::~TraceWriter() { close(); }
+
+bool TraceWriter::open(const std::string &path) {
+  file = fopen(path.c_str(), "wb");
+  if (file == nullptr) {
+    std::cerr << "Error: Could not create trace file '" << path << "'"
+              << std::endl;
+    return false;
+  }
+  buffer.resize(TRACE_BUFFER_RECORDS);
+  used = 0;
+  written = 0;
+  failed = false;
+
+  TraceHeader header;
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(TraceRecord);
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    failed = true;
+  }
+  return true;
+}
+
+void TraceWriter::drain() {
+  if (file != nullptr && used != 0 &&
+      fwrite(buffer.data(), sizeof(TraceRecord), used, file) != used) {
+    failed = true;
+  }
+  written += used;
+  used = 0;
+}
+
+bool TraceWriter::close() {
+  if (file == nullptr) {
+    return !failed;
+  }
+  drain();
+  if (fclose(file) != 0) {
+    failed = true;
+  }
+  file = nullptr;
+  if (failed) {
+    std::cerr << "Error: Failed to write trace file" << std::endl;
+  }
+  return !failed;
+}
+
+TraceReader::TraceReader() : file(nullptr), pos(0), limit(0) {}
+
+TraceReader::~TraceReader() {
+  if (file != nullptr) {
+    fclose(file);
+  }
+}
+
+bool TraceReader::open(const std::string &path) {
+  file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Error: Could not open trace file '" << path << "'"
+              << std::endl;
+    return false;
+  }
+
+  TraceHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION ||
+      header.record_size != sizeof(TraceRecord)) {
+    std::cerr << "Error: '" << path
+              << "' is not a trace file written by this build" << std::endl;
+    return false;
+  }
+  buffer.resize(TRACE_BUFFER_RECORDS);
+  pos = limit = 0;
+  return true;
+}
+
+bool TraceReader::next(TraceRecord &record) {
+  if (pos == limit) {
+    limit = fread(buffer.data(), sizeof(TraceRecord), buffer.size(), file);
+    pos = 0;
+    if (limit == 0) {
+      return false;
+    }
+  }
+  record = buffer[pos++];
+  return true;
+}
@@ -0,0 +1,118 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "../common/types.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Binary execution trace: a TraceHeader followed by one TraceRecord per
+// traced instruction, in host byte order (the magic tells the decoder if
+// it does not match). Render with the tracedump tool.
+
+const char TRACE_MAGIC[8] = {'C', 'P', 'U', 'T', 'R', 'A', 'C', 'E'};
+const uint32_t TRACE_VERSION = 1;
+
+struct TraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size; // sizeof(TraceRecord)
+};
+
+// TraceRecord::info bits
+const byte_t TRACE_REG_MASK = 0x07;    // Register written, if TRACE_REG
+const byte_t TRACE_REG = 0x08;         // A register changed
+const byte_t TRACE_MEM_WRITE = 0x10;   // mem_addr/mem_value are valid
+const byte_t TRACE_INTERRUPT = 0x20;   // An interrupt was entered after it
+
+// One executed instruction and its effects. State fields are the values
+// after the instruction completed.
+struct TraceRecord {
+  uint64_t count;      // Instruction count before executing
+  word_t pc;
+  word_t instruction;
+  word_t operand;      // Trailing address word, if the opcode has one
+  word_t reg_value;    // New value of the register in info
+  word_t sp;
+  word_t mem_addr;     // Word written by the instruction
+  word_t mem_value;
+  byte_t flags;
+  byte_t info;
+};
+
+// Which instructions to record: PC in pc_first..pc_last and instruction
+// count in count_first..count_last, all inclusive
+struct TraceFilter {
+  addr_t pc_first;
+  addr_t pc_last;
+  uint64_t count_first;
+  uint64_t count_last;
+
+  TraceFilter()
+      : pc_first(0), pc_last(0xFFFF), count_first(0),
+        count_last(UINT64_MAX) {}
+  bool accepts(addr_t pc, uint64_t count) const {
+    return pc >= pc_first && pc <= pc_last && count >= count_first &&
+           count <= count_last;
+  }
+};
+
+// Parse "first:last" (either side may be empty for an open end) into an
+// inclusive range. Numbers may be decimal or 0x-prefixed hex.
+bool parse_trace_range(const std::string &text, uint64_t &first,
+                       uint64_t &last);
+
+// Buffered trace output. Records are collected in a large buffer and
+// written out in blocks, so tracing costs a few stores per instruction.
+class TraceWriter {
+private:
+  FILE *file;
+  std::vector<TraceRecord> buffer;
+  size_t used;
+  uint64_t written;
+  bool failed;
+
+  void drain();
+
+public:
+  TraceWriter();
+  ~TraceWriter(); // Closes the file
+
+  TraceWriter(const TraceWriter &) = delete;
+  TraceWriter &operator=(const TraceWriter &) = delete;
+
+  // Create path and write the header. Reports errors on cerr.
+  bool open(const std::string &path);
+  bool close(); // Flush and close; false if any write failed
+
+  TraceRecord &next() { // Slot for the next record
+    if (used == buffer.size()) {
+      drain();
+    }
+    return buffer[used++];
+  }
+  uint64_t get_records() const { return written + used; }
+};
+
+// Sequential reader for trace files
+class TraceReader {
+private:
+  FILE *file;
+  std::vector<TraceRecord> buffer;
+  size_t pos;
+  size_t limit;
+
+public:
+  TraceReader();
+  ~TraceReader();
+
+  TraceReader(const TraceReader &) = delete;
+  TraceReader &operator=(const TraceReader &) = delete;
+
+  // Open path and check its header. Reports errors on cerr.
+  bool open(const std::string &path);
+  bool next(TraceRecord &record); // False at end of file
+};
+
+#endif // TRACE_H
@@ -0,0 +1,113 @@
+#include "../emulator/disasm.h"
+#include "../emulator/symbol_table.h"
+#include "../emulator/trace.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Display usage information when incorrect arguments are provided
+void print_usage(const char *program_name) {
+  std::cout << "Usage: " << program_name << " <trace_file> [options]\n";
+  std::cout << "Renders a binary trace written by 'emulator --trace' as "
+               "text\n";
+  std::cout << "Options:\n";
+  std::cout << "  --symbols <file>  Label addresses from an assembler symbol "
+               "file\n";
+  std::cout << "  --pc <first:last> Only show instructions at these "
+               "addresses\n";
+  std::cout << "  --window <first:last>\n"
+            << "                    Only show these instruction counts\n";
+  std::cout << "  -h, --help        Show this help message\n";
+}
+
+static void print_record(const TraceRecord &record,
+                         const SymbolTable &symbols) {
+  std::ostringstream line;
+  line << "[" << record.count << "] ";
+  disassemble(line, record.pc, record.instruction, record.operand);
+  std::string text = line.str();
+  if (text.size() < 40) {
+    text.resize(40, ' ');
+  }
+  std::cout << text << std::hex << std::setfill('0');
+
+  if (record.info & TRACE_REG) {
+    std::cout << " R" << (record.info & TRACE_REG_MASK) << "=0x"
+              << std::setw(4) << record.reg_value;
+  }
+  if (record.info & TRACE_MEM_WRITE) {
+    std::cout << " [0x" << std::setw(4) << record.mem_addr << "]=0x"
+              << std::setw(4) << record.mem_value;
+  }
+  std::cout << " SP=0x" << std::setw(4) << record.sp << " "
+            << (record.flags & FLAG_ZERO ? 'Z' : '-')
+            << (record.flags & FLAG_CARRY ? 'C' : '-')
+            << (record.flags & FLAG_NEGATIVE ? 'N' : '-')
+            << (record.flags & FLAG_OVERFLOW ? 'O' : '-') << std::dec
+            << std::setfill(' ');
+  if (!symbols.empty()) {
+    std::cout << "  <" << symbols.describe(record.pc) << ">";
+  }
+  if (record.info & TRACE_INTERRUPT) {
+    std::cout << "  (interrupt)";
+  }
+  std::cout << '\n';
+}
+
+int main(int argc, char *argv[]) {
+  std::string trace_file;
+  std::string symbol_file;
+  TraceFilter filter;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--symbols" && i + 1 < argc) {
+      symbol_file = argv[++i];
+    } else if ((arg == "--pc" || arg == "--window") && i + 1 < argc) {
+      std::string range = argv[++i];
+      uint64_t first = 0;
+      uint64_t last = arg == "--pc" ? 0xFFFF : UINT64_MAX;
+      if (!parse_trace_range(range, first, last) ||
+          (arg == "--pc" && last > 0xFFFF)) {
+        std::cerr << "Error: Invalid range '" << range << "'\n";
+        return 1;
+      }
+      if (arg == "--pc") {
+        filter.pc_first = (addr_t)first;
+        filter.pc_last = (addr_t)last;
+      } else {
+        filter.count_first = first;
+        filter.count_last = last;
+      }
+    } else if (arg == "-h" || arg == "--help") {
+      print_usage(argv[0]);
+      return 0;
+    } else {
+      trace_file = arg;
+    }
+  }
+
+  if (trace_file.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  SymbolTable symbols;
+  if (!symbol_file.empty() && !symbols.load(symbol_file)) {
+    std::cerr << "Error: Could not read symbol file '" << symbol_file
+              << "'\n";
+    return 1;
+  }
+
+  TraceReader reader;
+  if (!reader.open(trace_file)) {
+    return 1;
+  }
+  TraceRecord record;
+  while (reader.next(record)) {
+    if (filter.accepts(record.pc, record.count)) {
+      print_record(record, symbols);
+    }
+  }
+  return 0;
+}
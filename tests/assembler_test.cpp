@@ -0,0 +1,68 @@
+/*
+ * assembler_test.cpp
+ *
+ * Instruction encodings the assembler once got wrong. PUSH reads its
+ * register, so it belongs in the rs field; encoding it in rd made every
+ * PUSH push R0. LI values outside 16 bits used to be truncated silently.
+ */
+
+#include "../src/assembler/assembler.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+struct Encoding {
+  const char *source;
+  word_t expected;
+};
+
+static const Encoding ENCODINGS[] = {
+    {"PUSH R0", MAKE_INSTR(OP_PUSH, 0, 0, 0)},
+    {"PUSH R3", MAKE_INSTR(OP_PUSH, 0, 3, 0)},
+    {"PUSH R7", MAKE_INSTR(OP_PUSH, 0, 7, 0)},
+    {"POP R5", MAKE_INSTR(OP_POP, 5, 0, 0)},
+};
+
+// Sources that must fail to assemble
+static const char *const REJECTED[] = {
+    "LI R1, 70000",
+    "LI R1, -32769",
+    "LI R1, 0x10000",
+};
+
+int main() {
+  int failures = 0;
+  for (size_t i = 0; i < sizeof(ENCODINGS) / sizeof(ENCODINGS[0]); i++) {
+    const Encoding &e = ENCODINGS[i];
+    Assembler assembler;
+    if (!assembler.assemble_source(std::string(e.source) + "\n")) {
+      fprintf(stderr, "FAIL: could not assemble '%s'\n", e.source);
+      failures++;
+      continue;
+    }
+    const std::vector<byte_t> &code = assembler.get_machine_code();
+    word_t word = code.size() >= 2 ? (word_t)(code[0] | code[1] << 8) : 0;
+    if (code.size() != 2 || word != e.expected) {
+      fprintf(stderr, "FAIL: '%s' encoded as 0x%04x, expected 0x%04x\n",
+              e.source, word, e.expected);
+      failures++;
+    }
+  }
+
+  // The expected errors go to cerr; keep them out of the test output
+  std::ostringstream errors;
+  std::streambuf *saved = std::cerr.rdbuf(errors.rdbuf());
+  for (size_t i = 0; i < sizeof(REJECTED) / sizeof(REJECTED[0]); i++) {
+    Assembler assembler;
+    if (assembler.assemble_source(std::string(REJECTED[i]) + "\n")) {
+      fprintf(stderr, "FAIL: '%s' assembled\n", REJECTED[i]);
+      failures++;
+    }
+  }
+  std::cerr.rdbuf(saved);
+
+  if (failures == 0) {
+    printf("assembler_test: ok\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
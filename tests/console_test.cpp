@@ -0,0 +1,52 @@
+/*
+ * console_test.cpp
+ *
+ * ConsoleWriter's line policy: a partial line must reach the sink within
+ * the partial line delay, without a newline, flush() or the writer being
+ * destroyed.
+ */
+
+#include "../src/emulator/console.h"
+#include <cstdio>
+#include <poll.h>
+#include <unistd.h>
+
+// Well above the writer's 10 ms delay, so a loaded machine doesn't fail it
+static const int WAIT_MS = 1000;
+
+int main() {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    return 1;
+  }
+  FILE *sink = fdopen(fds[1], "w");
+  if (sink == nullptr) {
+    perror("fdopen");
+    return 1;
+  }
+
+  int failures = 0;
+  {
+    ConsoleWriter writer(sink, CONSOLE_FLUSH_LINE);
+    writer.put('A');
+
+    struct pollfd readable;
+    readable.fd = fds[0];
+    readable.events = POLLIN;
+    char c = 0;
+    if (poll(&readable, 1, WAIT_MS) != 1 || read(fds[0], &c, 1) != 1 ||
+        c != 'A') {
+      fprintf(stderr, "FAIL: partial line not written within %d ms\n",
+              WAIT_MS);
+      failures++;
+    }
+  }
+  fclose(sink);
+  close(fds[0]);
+
+  if (failures == 0) {
+    printf("console_test: ok\n");
+  }
+  return failures == 0 ? 0 : 1;
+}